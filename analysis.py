@@ -1,96 +1,39 @@
-import math
 import sys
-import pandas as pd
-import numpy as np
-import kmeans as kmeans
 import symnmf as symnmf
-from sklearn.metrics import silhouette_score
+from symnmf import SymNMF
 
 """
-Find the closest centroid to a given vector.
+Compare the SymNMF and K-means clusterings of the given vectors by their silhouette scores.
 
-This function calculates the Euclidean distance between the given vector and each centroid,
-and returns the index of the closest centroid.
+Both clusterings and both scores are calculated in one call to C: SymNMF from the same
+initial H as symnmf.py and K-means from the first k vectors as kmeans.py, with the
+pairwise distances of the silhouettes calculated a block at a time on every thread.
 
 Parameters:
-vector (np.ndarray): A numpy array representing the vector.
-centroids (list of lists): A list of centroids where each centroid is a list.
-
-Returns:
-int: The index of the closest centroid.
-"""
-def findClosestCentroid(vector, centroids): 
-    min_distance = math.inf
-    cluster_index = 0
-
-    for j in range(len(centroids)):
-        distance = np.linalg.norm(vector - centroids[j])
-        if distance < min_distance:
-            min_distance = distance
-            cluster_index = j
-
-    return cluster_index
-
-"""
-Calculate K-means labels for the given vectors.
-
-This function converts the input vectors to a numpy array, performs K-means clustering,
-and assigns each vector to the closest centroid. It returns the labels indicating the
-cluster assignment for each vector.
-
-Parameters:
-vectors (pd.DataFrame): A pandas DataFrame containing the input vectors.
-k (int): The number of clusters to form.
-
-Returns:
-list: A list of integers where each integer represents the cluster label for the corresponding vector.
-"""
-def calculateKmeansLabels(vectors, k): 
-    vectors = vectors.to_numpy()  # kmeans requires numpy array
-    kmeansMatrix = kmeans.doKmeans(vectors, k)
-    kmeansLabels = [-1 for i in range(len(vectors))]
-
-    for i in range(len(vectors)):
-        clusterIndex = findClosestCentroid(vectors[i], kmeansMatrix)
-        kmeansLabels[i] = clusterIndex
-
-    return kmeansLabels
-
-"""
-Calculate SymNMF labels for the given vectors.
-
-This function converts the input vectors to a list of lists, performs Symmetric Non-negative Matrix Factorization (SymNMF),
-and returns the cluster assignments.
-
-Parameters:
-vectors (pd.DataFrame): A pandas DataFrame containing the input vectors.
+vectors (np.ndarray): A float64 array containing the input vectors.
 k (int): The number of clusters to form.
+sample (int): The number of vectors to estimate the scores from, 0 for the exact scores.
 
 Returns:
-list: A list representing the cluster assignment for each vector.
+tuple: The silhouette scores of the SymNMF and the K-means clusterings.
 """
-def calculateSymnmfLabels(vectors, k):
-    vectors = vectors.values.tolist() # Convert data to list of lists
-    symnmfMatrix = symnmf.doSymnmf(vectors, k)
+def calculateScores(vectors, k, sample=0):
+    result = SymNMF.analyze(vectors, k, sample=sample)
 
-    return np.array(symnmfMatrix).argmax(axis=1)
+    return result["symnmf"], result["kmeans"]
 
 def main():
     try:
         # Get data from console
         input_data = sys.argv
         k, input_file = int(input_data[1]), input_data[2]
+        sample = int(input_data[3]) if len(input_data) > 3 else 0
 
-        # Create Vectors dataframe from csv file
-        vectors = pd.read_csv(input_file, header=None)
-
-        # Calculate kmeans sillohuette score
-        kmeansLables = calculateKmeansLabels(vectors, k)
-        scoreKmeans = silhouette_score(vectors, kmeansLables)
+        # Read the vectors from a csv file or a matrix file
+        vectors = symnmf.readVectors(input_file)
 
-        # Calculate symnmf sillohuette score
-        symnmfLabels = calculateSymnmfLabels(vectors, k)
-        scoreSymnmf = silhouette_score(vectors, symnmfLabels)
+        # Calculate the symnmf and kmeans sillohuette scores
+        scoreSymnmf, scoreKmeans = calculateScores(vectors, k, sample)
 
         print("nmf: " + format(scoreSymnmf, ".4f"))
         print("kmeans: " + format(scoreKmeans, ".4f"))
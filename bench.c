@@ -0,0 +1,690 @@
+#define _POSIX_C_SOURCE 199309L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+#include "symnmf.h"
+
+/*
+micro-benchmarks for the symnmf kernels
+usage: ./symnmf_bench gemm [N] [k] [repeats]
+       ./symnmf_bench csv [N] [d] [repeats]
+       ./symnmf_bench affinity [N] [d] [repeats]
+       ./symnmf_bench exp [count] [files...]
+       ./symnmf_bench solvers [N|file] [k] [eps]
+       ./symnmf_bench precision [N|file] [k]
+       ./symnmf_bench nystrom [N|file] [k] [landmarks]
+*/
+
+/*
+returns a monotonic timestamp in seconds
+@return double: the current time
+*/
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/*
+fills a matrix with pseudo random values in [0, 1)
+@param mat: the matrix to be filled
+@param seed: the seed of the generator
+@return void
+*/
+static void fill_random(matrix_t* mat, unsigned long seed)
+{
+    int i,j;
+    for(i=0;i<mat->rows;i++)
+    {
+        for(j=0;j<mat->cols;j++)
+        {
+            seed = (seed * 1103515245UL + 12345UL) & 0x7fffffffUL;
+            MATRIX_AT(mat, i, j) = seed / 2147483648.0;
+        }
+    }
+}
+
+/*
+the i-j-k triple loop matrix_multiplication used to be, kept as the baseline
+@param matrix1: the first matrix, n*m
+@param matrix2: the second matrix, m*p
+@param result_matrix: the result matrix, n*p
+@return void
+*/
+static void naive_multiplication(const matrix_t* matrix1, const matrix_t* matrix2, matrix_t* result_matrix)
+{
+    int i,j,k;
+    double sum;
+    for(i=0;i<matrix1->rows;i++)
+    {
+        for(j=0;j<matrix2->cols;j++)
+        {
+            sum = 0;
+            for(k=0;k<matrix1->cols;k++)
+            {
+                sum += MATRIX_AT(matrix1, i, k) * MATRIX_AT(matrix2, k, j);
+            }
+            MATRIX_AT(result_matrix, i, j) = sum;
+        }
+    }
+}
+
+/*
+times (N*N)*(N*k) products with the naive loop and with every supported gemm kernel
+@param N: the number of rows of W
+@param k: the number of columns of H
+@param repeats: the number of products timed per kernel
+@return int: 0 on success
+*/
+static int bench_gemm(int N, int k, int repeats)
+{
+    static const char* names[] = {"scalar", "avx2", "avx512"};
+    int r,level,i,j,best = simd_select(-1);
+    double start, seconds, err, flops = 2.0 * N * (double)N * k * repeats;
+    matrix_t* W = matrix_create(N, N);
+    matrix_t* H = matrix_create(N, k);
+    matrix_t* expected = matrix_create(N, k);
+    matrix_t* result = matrix_create(N, k);
+    if(W == NULL || H == NULL || expected == NULL || result == NULL) return 1;
+
+    fill_random(W, 1);
+    fill_random(H, 2);
+
+    start = now();
+    for(r=0;r<repeats;r++) naive_multiplication(W, H, expected);
+    seconds = now() - start;
+    printf("gemm N=%d k=%d  %-8s %8.3f s %8.2f GFLOP/s\n", N, k, "naive", seconds, flops / seconds * 1e-9);
+
+    for(level=SIMD_SCALAR;level<=best;level++)
+    {
+        simd_select(level);
+        start = now();
+        for(r=0;r<repeats;r++) matrix_multiplication(W, H, result);
+        seconds = now() - start;
+        err = 0;
+        for(i=0;i<N;i++)
+        {
+            for(j=0;j<k;j++)
+            {
+                double d = MATRIX_AT(result, i, j) - MATRIX_AT(expected, i, j);
+                if(d < 0) d = -d;
+                if(d > err) err = d;
+            }
+        }
+        printf("gemm N=%d k=%d  %-8s %8.3f s %8.2f GFLOP/s  max err %.2e\n",
+               N, k, names[level], seconds, flops / seconds * 1e-9, err);
+    }
+    simd_select(-1);
+
+    matrix_destroy(W);
+    matrix_destroy(H);
+    matrix_destroy(expected);
+    matrix_destroy(result);
+    return 0;
+}
+
+/*
+the two-pass fgets/strtok/atof reader read_vectors_from_file used to be, kept as the baseline
+lines longer than 1024 characters are cut short, as they were
+@param filename: the name of the file
+@return matrix_t*: the matrix of vectors, one vector per row
+*/
+static matrix_t* fgets_read_vectors(const char* filename)
+{
+    char line[1024];
+    char* token;
+    int i,j,row_count = 0,col_count = 0;
+    matrix_t* matrix;
+    FILE* file = fopen(filename, "r");
+    if(file == NULL) return NULL;
+
+    while(fgets(line, sizeof(line), file))
+    {
+        if(++row_count == 1)
+        {
+            for(token=strtok(line, ",");token!=NULL;token=strtok(NULL, ",")) col_count++;
+        }
+    }
+    if((matrix = matrix_create(row_count, col_count)) == NULL)
+    {
+        fclose(file);
+        return NULL;
+    }
+    rewind(file);
+    i = 0;
+    while(fgets(line, sizeof(line), file))
+    {
+        j = 0;
+        for(token=strtok(line, ",");token!=NULL && j<col_count;token=strtok(NULL, ","))
+        {
+            MATRIX_AT(matrix, i, j++) = atof(token);
+        }
+        i++;
+    }
+    fclose(file);
+    return matrix;
+}
+
+/*
+times the old and the new CSV reader on a generated file of N vectors of d values in %.4f
+@param N: the number of vectors
+@param d: the number of values per vector, keep d*8 under 1024 for the old reader
+@param repeats: the number of reads timed per reader
+@return int: 0 on success
+*/
+static int bench_csv(int N, int d, int repeats)
+{
+    static const char* path = "symnmf_bench.csv";
+    int r,i,j,mismatches = 0;
+    double start, seconds, megabytes;
+    matrix_t* values = matrix_create(N, d);
+    matrix_t* old_result = NULL;
+    matrix_t* new_result = NULL;
+    FILE* file = fopen(path, "w");
+    if(values == NULL || file == NULL) return 1;
+
+    fill_random(values, 3);
+    for(i=0;i<N;i++)
+    {
+        for(j=0;j<d;j++)
+        {
+            fprintf(file, j == d-1 ? "%.4f\n" : "%.4f,", 100 * MATRIX_AT(values, i, j) - 50);
+        }
+    }
+    megabytes = ftell(file) / 1e6;
+    fclose(file);
+
+    start = now();
+    for(r=0;r<repeats;r++)
+    {
+        matrix_destroy(old_result);
+        old_result = fgets_read_vectors(path);
+    }
+    seconds = now() - start;
+    printf("csv N=%d d=%d  %-8s %8.3f s %8.1f MB/s\n", N, d, "fgets", seconds, megabytes * repeats / seconds);
+
+    start = now();
+    for(r=0;r<repeats;r++)
+    {
+        matrix_destroy(new_result);
+        new_result = read_vectors_from_file(path);
+    }
+    seconds = now() - start;
+    if(old_result == NULL || new_result == NULL) return 1;
+    for(i=0;i<N;i++)
+    {
+        for(j=0;j<d;j++)
+        {
+            if(MATRIX_AT(old_result, i, j) != MATRIX_AT(new_result, i, j)) mismatches++;
+        }
+    }
+    printf("csv N=%d d=%d  %-8s %8.3f s %8.1f MB/s  mismatches %d\n", N, d, "mmap", seconds, megabytes * repeats / seconds, mismatches);
+
+    remove(path);
+    matrix_destroy(values);
+    matrix_destroy(old_result);
+    matrix_destroy(new_result);
+    return 0;
+}
+
+/*
+the pair by pair loop build_affinity used to be, one pow per coordinate and one exp per pair, kept as the baseline
+@param vectors: the matrix of vectors, one vector per row
+@param sym_matrix: the result matrix, N*N, its diagonal zero
+@return void
+*/
+static void naive_affinity(const matrix_t* vectors, symmatrix_t* sym_matrix)
+{
+    int i,j,p;
+    double sum;
+    for(i=0;i<vectors->rows;i++)
+    {
+        for(j=i+1;j<vectors->rows;j++)
+        {
+            sum = 0;
+            for(p=0;p<vectors->cols;p++)
+            {
+                sum += pow(MATRIX_AT(vectors, i, p) - MATRIX_AT(vectors, j, p), 2);
+            }
+            *symmatrix_entry(sym_matrix, i, j) = exp(-sum/2);
+            *symmatrix_entry(sym_matrix, j, i) = exp(-sum/2);
+        }
+    }
+}
+
+/*
+times the similarity matrix of N random d dimensional vectors with the pair by pair loop and with calc_sym
+the vectors are scaled so the affinities spread over (0, 1) instead of all vanishing at large d
+@param N: the number of vectors
+@param d: the number of dimensions
+@param repeats: the number of matrices timed per method
+@return int: 0 on success
+*/
+static int bench_affinity(int N, int d, int repeats)
+{
+    int r,i,j;
+    double start, seconds, diff, err = 0, flops = (double)N * N * d * repeats;
+    matrix_t* vectors = matrix_create(N, d);
+    symmatrix_t* expected = symmatrix_create(N);
+    symmatrix_t* result = NULL;
+    if(vectors == NULL || expected == NULL) return 1;
+
+    fill_random(vectors, 4);
+    for(i=0;i<N;i++)
+    {
+        for(j=0;j<d;j++)
+        {
+            MATRIX_AT(vectors, i, j) *= 2 / sqrt((double)d);
+        }
+    }
+
+    start = now();
+    for(r=0;r<repeats;r++) naive_affinity(vectors, expected);
+    seconds = now() - start;
+    printf("affinity N=%d d=%d  %-8s %8.3f s %8.2f GFLOP/s\n", N, d, "naive", seconds, flops / seconds * 1e-9);
+
+    start = now();
+    for(r=0;r<repeats;r++)
+    {
+        symmatrix_destroy(result);
+        if((result = calc_sym(vectors)) == NULL) return 1;
+    }
+    seconds = now() - start;
+    for(i=0;i<N;i++)
+    {
+        for(j=0;j<N;j++)
+        {
+            diff = fabs(*symmatrix_entry(result, i, j) - *symmatrix_entry(expected, i, j));
+            if(diff > err) err = diff;
+        }
+    }
+    printf("affinity N=%d d=%d  %-8s %8.3f s %8.2f GFLOP/s  max err %.2e\n", N, d, "gemm", seconds, flops / seconds * 1e-9, err);
+
+    matrix_destroy(vectors);
+    symmatrix_destroy(expected);
+    symmatrix_destroy(result);
+    return 0;
+}
+
+/*
+returns the distance between a value and the exact one, in units in the last place of the exact one
+@param value: the value
+@param exact: the exact value
+@return double: the distance in ulp
+*/
+static double ulp_error(double value, double exact)
+{
+    int e;
+    frexp(exact, &e);
+    return fabs(value - exact) / ldexp(1.0, (e - 53 < -1074) ? -1074 : e - 53);
+}
+
+/*
+checks exp_batch against libm exp at every supported instruction set, then on the similarity matrices of files
+the arguments are spread over (-746, 0], the range of the gaussian kernel, half of them within (-40, 0]
+where the affinities are not negligible; every file must print the same at 4 decimals as with libm
+@param count: the number of arguments
+@param files: the files of vectors
+@param nfiles: the number of files
+@return int: 0 if every level is within 2 ulp and prints every file the same
+*/
+static int bench_exp(int count, char** files, int nfiles)
+{
+    static const char* names[] = {"scalar", "avx2", "avx512"};
+    int i,j,f,level,mismatches,failed = 0,best = simd_select(-1);
+    double start, seconds, err;
+    char printed[2][32];
+    matrix_t* args = matrix_create(1, count);
+    matrix_t* values = matrix_create(1, count);
+    matrix_t* vectors;
+    symmatrix_t* exact;
+    symmatrix_t* result;
+    if(args == NULL || values == NULL) return 1;
+
+    fill_random(args, 5);
+    for(i=0;i<count;i++)
+    {
+        args->data[i] = -args->data[i] * ((i % 2) ? 746.0 : 40.0);
+    }
+    for(level=SIMD_SCALAR;level<=best;level++)
+    {
+        simd_select(level);
+        memcpy(values->data, args->data, (size_t)count * sizeof(double));
+        start = now();
+        exp_batch(values->data, count);
+        seconds = now() - start;
+        err = 0;
+        for(i=0;i<count;i++)
+        {
+            if(ulp_error(values->data[i], exp(args->data[i])) > err) err = ulp_error(values->data[i], exp(args->data[i]));
+        }
+        failed |= err > 2;
+        printf("exp count=%d  %-8s %8.3f s %8.1f M/s  max err %.2f ulp\n", count, names[level], seconds, count / seconds * 1e-6, err);
+    }
+
+    for(f=0;f<nfiles;f++)
+    {
+        simd_select(SIMD_SCALAR);
+        if((vectors = read_vectors_from_file(files[f])) == NULL || (exact = calc_sym(vectors)) == NULL) return 1;
+        for(level=SIMD_SCALAR+1;level<=best;level++)
+        {
+            simd_select(level);
+            if((result = calc_sym(vectors)) == NULL) return 1;
+            mismatches = 0;
+            err = 0;
+            for(i=0;i<vectors->rows;i++)
+            {
+                for(j=0;j<vectors->rows;j++)
+                {
+                    sprintf(printed[0], "%.4f", *symmatrix_entry(exact, i, j));
+                    sprintf(printed[1], "%.4f", *symmatrix_entry(result, i, j));
+                    mismatches += strcmp(printed[0], printed[1]) != 0;
+                    if(fabs(*symmatrix_entry(result, i, j) - *symmatrix_entry(exact, i, j)) > err)
+                    {
+                        err = fabs(*symmatrix_entry(result, i, j) - *symmatrix_entry(exact, i, j));
+                    }
+                }
+            }
+            failed |= mismatches != 0;
+            printf("exp %s  %-8s max err %.2e  entries printed differently %d\n", files[f], names[level], err, mismatches);
+            symmatrix_destroy(result);
+        }
+        symmatrix_destroy(exact);
+        matrix_destroy(vectors);
+    }
+    simd_select(-1);
+
+    matrix_destroy(args);
+    matrix_destroy(values);
+    return failed;
+}
+
+/*
+reads the vectors of a CSV or matrix file, or generates N vectors in k clusters
+@param source: a file of vectors, or the number of vectors to generate
+@param k: the number of clusters generated
+@return matrix_t*: the vectors, one per row, NULL on failure
+*/
+static matrix_t* bench_vectors(const char* source, int k)
+{
+    int i,j,N = atoi(source);
+    matrix_t* vectors;
+
+    if(N <= 0) return read_vectors_from_file(source);
+    /* k clusters of 5 dimensional points spread around k far apart centres */
+    if((vectors = matrix_create(N, 5)) == NULL) return NULL;
+    fill_random(vectors, 4);
+    for(i=0;i<N;i++)
+    {
+        for(j=0;j<vectors->cols;j++)
+        {
+            MATRIX_AT(vectors, i, j) += 4 * ((i % k) == j % k);
+        }
+    }
+    return vectors;
+}
+
+/*
+times every symnmf solver to the tolerance eps on the norm matrix of a CSV or matrix file, or of
+N generated vectors in k clusters, all from the same H drawn as symnmf.py does, in [0, 2*sqrt(mean(W)/k))
+@param source: a file of vectors, or the number of vectors to generate
+@param k: the number of columns of H
+@param eps: the tolerance of the solvers
+@return int: 0 on success
+*/
+static int bench_solvers(const char* source, int k, double eps)
+{
+    static const char* names[] = {"mu", "accelerated", "hals"};
+    int i,j,solver,N;
+    double start, seconds, mean = 0, bound;
+    double* sums;
+    matrix_t* vectors;
+    matrix_t* H_init;
+    matrix_t* H;
+    symmatrix_t* W;
+    symnmf_params_t params;
+    symnmf_report_t report;
+
+    if((vectors = bench_vectors(source, k)) == NULL) return 1;
+    N = vectors->rows;
+    start = now();
+    W = calc_norm(vectors);
+    sums = malloc((size_t)N * sizeof(double));
+    H_init = matrix_create(N, k);
+    if(W == NULL || sums == NULL || H_init == NULL) return 1;
+    printf("solvers N=%d k=%d eps=%g  norm %.3f s\n", N, k, eps, now() - start);
+
+    symmatrix_row_sums(W, sums);
+    for(i=0;i<N;i++)
+    {
+        mean += sums[i];
+    }
+    bound = 2 * sqrt(mean / ((double)N * N) / k);
+    fill_random(H_init, 5);
+    for(i=0;i<N;i++)
+    {
+        for(j=0;j<k;j++)
+        {
+            MATRIX_AT(H_init, i, j) *= bound;
+        }
+    }
+
+    symnmf_params_default(&params);
+    params.eps = eps;
+    params.max_iter = 100000;
+    for(solver=SYMNMF_SOLVER_MU;solver<=SYMNMF_SOLVER_HALS;solver++)
+    {
+        params.solver = solver;
+        start = now();
+        if((H = calc_symnmf(W, H_init, &params, &report)) == NULL) return 1;
+        seconds = now() - start;
+        printf("solvers N=%d k=%d  %-12s %8.3f s %6d iterations%s  objective %.6f\n", N, k, names[solver], seconds,
+               report.iterations, report.converged ? "" : " (no convergence)",
+               report.iterations > 0 ? report.objectives[report.iterations-1] : 0.0);
+        symnmf_report_free(&report);
+        matrix_destroy(H);
+    }
+
+    free(sums);
+    matrix_destroy(vectors);
+    matrix_destroy(H_init);
+    symmatrix_destroy(W);
+    return 0;
+}
+
+/*
+returns the column of the largest entry of row i of H, the cluster symnmf gives vector i
+@param H: the symnmf matrix
+@param i: the row
+@return int: the column of the first largest entry
+*/
+static int row_argmax(const matrix_t* H, int i)
+{
+    int j,best = 0;
+    for(j=1;j<H->cols;j++)
+    {
+        if(MATRIX_AT(H, i, j) > MATRIX_AT(H, i, best)) best = j;
+    }
+    return best;
+}
+
+/*
+compares the float32 storage of W against the double one on the norm matrix of a CSV or matrix
+file, or of N generated vectors in k clusters: the largest difference of W, of H from the seed
+symnmf.py uses, the relative difference of the final objectives and the share of equal labels
+@param source: a file of vectors, or the number of vectors to generate
+@param k: the number of columns of H
+@return int: 0 on success
+*/
+static int bench_precision(const char* source, int k)
+{
+    int i,j,agree = 0;
+    double start, norm_seconds, norm_seconds_f32, symnmf_seconds, symnmf_seconds_f32, err_W = 0, err_H = 0, d;
+    double objective, objective_f32;
+    matrix_t* vectors;
+    matrix_t* H;
+    matrix_t* H_f32;
+    symmatrix_t* W;
+    symmatrixf_t* W_f32;
+    symnmf_report_t report, report_f32;
+
+    if((vectors = bench_vectors(source, k)) == NULL) return 1;
+    start = now();
+    W = calc_norm(vectors);
+    norm_seconds = now() - start;
+    start = now();
+    W_f32 = calc_norm_f32(vectors);
+    norm_seconds_f32 = now() - start;
+    if(W == NULL || W_f32 == NULL) return 1;
+    for(i=0;i<vectors->rows;i++)
+    {
+        for(j=i;j<vectors->rows;j++)
+        {
+            d = fabs(*symmatrix_entry(W, i, j) - symmatrixf_tile(W_f32, i / W_f32->tile, j / W_f32->tile)
+                     [(i % W_f32->tile) * W_f32->tile + j % W_f32->tile]);
+            if(d > err_W) err_W = d;
+        }
+    }
+
+    start = now();
+    H = calc_symnmf_random(W, k, 1234, NULL, &report);
+    symnmf_seconds = now() - start;
+    start = now();
+    H_f32 = calc_symnmf_random_f32(W_f32, k, 1234, NULL, &report_f32);
+    symnmf_seconds_f32 = now() - start;
+    if(H == NULL || H_f32 == NULL) return 1;
+    for(i=0;i<H->rows;i++)
+    {
+        for(j=0;j<k;j++)
+        {
+            d = fabs(MATRIX_AT(H, i, j) - MATRIX_AT(H_f32, i, j));
+            if(d > err_H) err_H = d;
+        }
+        agree += row_argmax(H, i) == row_argmax(H_f32, i);
+    }
+    objective = report.iterations > 0 ? report.objectives[report.iterations-1] : 0.0;
+    objective_f32 = report_f32.iterations > 0 ? report_f32.objectives[report_f32.iterations-1] : 0.0;
+
+    printf("precision N=%d k=%d  %-8s norm %8.3f s  symnmf %8.3f s %6d iterations  objective %.9f\n",
+           H->rows, k, "float64", norm_seconds, symnmf_seconds, report.iterations, objective);
+    printf("precision N=%d k=%d  %-8s norm %8.3f s  symnmf %8.3f s %6d iterations  objective %.9f\n",
+           H->rows, k, "float32", norm_seconds_f32, symnmf_seconds_f32, report_f32.iterations, objective_f32);
+    printf("precision N=%d k=%d  max err W %.2e  H %.2e  objective rel err %.2e  labels agree %.4f\n",
+           H->rows, k, err_W, err_H, objective != 0 ? fabs(objective_f32 - objective) / objective : 0.0,
+           (double)agree / H->rows);
+
+    symnmf_report_free(&report);
+    symnmf_report_free(&report_f32);
+    matrix_destroy(vectors);
+    matrix_destroy(H);
+    matrix_destroy(H_f32);
+    symmatrix_destroy(W);
+    symmatrixf_destroy(W_f32);
+    return 0;
+}
+
+/*
+compares the Nystrom approximation of W from m landmarks against the exact W on a CSV or matrix file,
+or on N generated vectors in k clusters: the times of norm and symnmf on both, the relative and largest
+error of W, and the share of equal labels of the two H from the seed symnmf.py uses
+@param source: a file of vectors, or the number of vectors to generate
+@param k: the number of columns of H
+@param landmarks: the number of landmarks
+@return int: 0 on success
+*/
+static int bench_nystrom(const char* source, int k, int landmarks)
+{
+    int i,agree = 0;
+    double start, norm_seconds, norm_seconds_lowrank, symnmf_seconds, symnmf_seconds_lowrank, error, max_error;
+    matrix_t* vectors;
+    matrix_t* H;
+    matrix_t* H_lowrank;
+    symmatrix_t* W;
+    lowrank_t* W_lowrank;
+
+    if((vectors = bench_vectors(source, k)) == NULL) return 1;
+    start = now();
+    W = calc_norm(vectors);
+    norm_seconds = now() - start;
+    start = now();
+    W_lowrank = calc_norm_nystrom(vectors, landmarks, 1234);
+    norm_seconds_lowrank = now() - start;
+    if(W == NULL || W_lowrank == NULL) return 1;
+
+    start = now();
+    H = calc_symnmf_random(W, k, 1234, NULL, NULL);
+    symnmf_seconds = now() - start;
+    start = now();
+    H_lowrank = calc_symnmf_random_lowrank(W_lowrank, k, 1234, NULL, NULL);
+    symnmf_seconds_lowrank = now() - start;
+    if(H == NULL || H_lowrank == NULL) return 1;
+    for(i=0;i<H->rows;i++)
+    {
+        agree += row_argmax(H, i) == row_argmax(H_lowrank, i);
+    }
+    error = lowrank_error(vectors, W_lowrank, &max_error);
+
+    printf("nystrom N=%d k=%d  %-12s norm %8.3f s  symnmf %8.3f s\n", H->rows, k, "exact", norm_seconds, symnmf_seconds);
+    printf("nystrom N=%d k=%d  m=%-10d norm %8.3f s  symnmf %8.3f s  rank %d\n", H->rows, k, landmarks,
+           norm_seconds_lowrank, symnmf_seconds_lowrank, W_lowrank->factor->cols);
+    printf("nystrom N=%d k=%d  W rel err %.2e  max err %.2e  labels agree %.4f\n", H->rows, k, error, max_error,
+           (double)agree / H->rows);
+
+    matrix_destroy(vectors);
+    matrix_destroy(H);
+    matrix_destroy(H_lowrank);
+    symmatrix_destroy(W);
+    lowrank_destroy(W_lowrank);
+    return 0;
+}
+
+int main(int argc, char* argv[])
+{
+    if(argc >= 2 && !strcmp(argv[1], "gemm"))
+    {
+        return bench_gemm(argc > 2 ? atoi(argv[2]) : 4000,
+                          argc > 3 ? atoi(argv[3]) : 5,
+                          argc > 4 ? atoi(argv[4]) : 5);
+    }
+    if(argc >= 2 && !strcmp(argv[1], "csv"))
+    {
+        return bench_csv(argc > 2 ? atoi(argv[2]) : 200000,
+                         argc > 3 ? atoi(argv[3]) : 10,
+                         argc > 4 ? atoi(argv[4]) : 3);
+    }
+    if(argc >= 2 && !strcmp(argv[1], "affinity"))
+    {
+        return bench_affinity(argc > 2 ? atoi(argv[2]) : 4000,
+                              argc > 3 ? atoi(argv[3]) : 768,
+                              argc > 4 ? atoi(argv[4]) : 1);
+    }
+    if(argc >= 2 && !strcmp(argv[1], "exp"))
+    {
+        return bench_exp(argc > 2 ? atoi(argv[2]) : 10000000, argv + 3, argc > 3 ? argc - 3 : 0);
+    }
+    if(argc >= 2 && !strcmp(argv[1], "solvers"))
+    {
+        return bench_solvers(argc > 2 ? argv[2] : "4000",
+                             argc > 3 ? atoi(argv[3]) : 5,
+                             argc > 4 ? atof(argv[4]) : 1e-4);
+    }
+    if(argc >= 2 && !strcmp(argv[1], "precision"))
+    {
+        return bench_precision(argc > 2 ? argv[2] : "4000",
+                               argc > 3 ? atoi(argv[3]) : 5);
+    }
+    if(argc >= 2 && !strcmp(argv[1], "nystrom"))
+    {
+        return bench_nystrom(argc > 2 ? argv[2] : "4000",
+                             argc > 3 ? atoi(argv[3]) : 5,
+                             argc > 4 ? atoi(argv[4]) : 200);
+    }
+    printf("usage: %s gemm [N] [k] [repeats]\n       %s csv [N] [d] [repeats]\n       %s affinity [N] [d] [repeats]\n"
+           "       %s exp [count] [files...]\n       %s solvers [N|file] [k] [eps]\n       %s precision [N|file] [k]\n"
+           "       %s nystrom [N|file] [k] [landmarks]\n",
+           argv[0], argv[0], argv[0], argv[0], argv[0], argv[0], argv[0]);
+    return 1;
+}
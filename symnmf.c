@@ -1,584 +1,5888 @@
+#if defined(__unix__) || defined(__APPLE__)
+#define _POSIX_C_SOURCE 200112L /* mmap, posix_madvise */
+#define SYMNMF_HAVE_MMAP
+#endif
 #include <stdio.h>
 #include <stdlib.h>
 #include <math.h>
 #include <string.h>
-#define MAX_LINE_LENGTH 1024  /* Define max line length for buffer */
+#include <time.h>
+#ifdef SYMNMF_HAVE_MMAP
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+#include "symnmf.h"
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SYMNMF_X86_SIMD
+#include <immintrin.h>
+#endif
+#define GEMM_MR 8    /* max rows of C held in registers by a gemm kernel */
+#define GEMM_NR 8    /* columns of C held in registers by a gemm kernel */
+#define GEMM_KC 256  /* length of the inner dimension panel kept in L1 */
+#define REDUCE_ROWS 256 /* rows per partial sum of the reductions over H, fixed so sums do not depend on threads */
+#define EXTRAPOLATION_FLOOR 1e-16 /* smallest entry of an extrapolated H of the accelerated solver */
+#define MT_STATE 624 /* words of state of the Mersenne Twister */
+#define STREAM_TILES 4 /* tiles of a tile row streamed by one thread at a time, about the size of L2 */
+#define JACOBI_SWEEPS 100 /* cap on the sweeps of the Jacobi eigenvalue iteration */
+#define JACOBI_TOLERANCE 1e-14 /* off-diagonal frobenius norm, relative to the whole, at which Jacobi stops */
+#define NYSTROM_TOLERANCE 1e-10 /* eigenvalues of the landmark affinities below this part of the largest are dropped */
+#define EXP_LOWEST -746.0 /* arguments of exp_batch are clamped to [EXP_LOWEST, EXP_HIGHEST], past them exp is 0 or inf */
+#define EXP_HIGHEST 710.0
+#define HALS_PENALTY 1.0 /* weight alpha of ||H - X||^2 in the hals solver, the spectral norm bound of a norm matrix */
 
-static int N_c, vecdim_c;
+static int simd_level = -1; /* instruction set of the matrix kernels, -1 until first selected */
 
-/* 
-prints a matrix of doubles with dimensions n*m
+/*
+prints one entry of a printed matrix row
+@param value: the entry
+@param is_last: a flag to determine if this is the last entry of its row
+@return void
+*/
+static void print_entry(double value, int is_last)
+{
+    printf("%.4f ", value);
+    printf(is_last ? "\n" : ",");
+}
+
+/*
+prints a matrix of doubles
 @param matrix: the matrix to be printed
-@param n: the number of rows
-@param m: the number of columns
 @return void
 */
-void print_matrix(double** matrix, int n, int m)
+void print_matrix(const matrix_t* matrix)
 {
     int i,j;
-    for(i=0;i<n;i++)
+    for(i=0;i<matrix->rows;i++)
     {
-        for(j=0;j<m;j++)
+        for(j=0;j<matrix->cols;j++)
         {
-            printf("%.4f ", matrix[i][j]);
-            if(j != m-1)
-            {
-                printf(",");
-            }
+            print_entry(MATRIX_AT(matrix, i, j), j == matrix->cols-1);
         }
-        printf("\n");
     }
-}   
+}
 
 /*
-frees a matrix of doubles with dimensions n*m
-@param p: the matrix to be freed
-@param n: the number of rows
+prints a packed symmetric matrix of doubles
+@param matrix: the matrix to be printed
 @return void
 */
-void matrix_free(double** p, int n)
+void print_symmatrix(const symmatrix_t* matrix)
 {
-    int i;
-    for(i=0;i<n;i++)
+    int i,j;
+    for(i=0;i<matrix->n;i++)
     {
-        free(p[i]);
+        for(j=0;j<matrix->n;j++)
+        {
+            print_entry(*symmatrix_entry(matrix, i, j), j == matrix->n-1);
+        }
     }
-    free(p); 
 }
 
 /*
-allocates memory for a matrix of doubles with dimensions n*m
-@param new_matrix: the matrix to be allocated
-@param n: the number of rows
-@param m: the number of columns
-@return double**: the allocated matrix
+prints a sparse matrix of doubles with its zeros
+@param matrix: the matrix to be printed
+@return void
 */
-double** matrix_malloc(double** new_matrix, int n, int m)
+void print_csrmatrix(const csrmatrix_t* matrix)
 {
-    int i;
-    if((new_matrix = malloc(n*sizeof(double*))) == NULL)
+    int i,j;
+    size_t p;
+    for(i=0;i<matrix->n;i++)
     {
-        printf("An Error Has Occured");
-        free(new_matrix);
-        return NULL;
+        p = matrix->row_ptr[i];
+        for(j=0;j<matrix->n;j++)
+        {
+            /* the columns of a row are sorted, so walk them along with j */
+            if(p < matrix->row_ptr[i+1] && matrix->col_idx[p] == j)
+            {
+                print_entry(matrix->values[p++], j == matrix->n-1);
+            }
+            else
+            {
+                print_entry(0, j == matrix->n-1);
+            }
+        }
     }
+}
+
+/*
+prints the n*n diagonal matrix of a vector of doubles
+@param diagonal: the diagonal of the matrix
+@param n: the order of the matrix
+@return void
+*/
+void print_diagonal(const double* diagonal, int n)
+{
+    int i,j;
     for(i=0;i<n;i++)
     {
-        if ((new_matrix[i] = malloc(m * sizeof(double))) == NULL)
+        for(j=0;j<n;j++)
         {
-            printf("An Error Has Occured");
-            matrix_free(new_matrix, n);
-            return NULL;
+            print_entry((i == j) ? diagonal[i] : 0, j == n-1);
         }
     }
-    return new_matrix;
 }
 
 /*
-multiplies two matrices of doubles
-@param matrix1: the first matrix
-@param matrix2: the second matrix
-@param n: the number of rows of the first matrix
-@param m: the number of columns of the first matrix and the number of rows of the second matrix
-@param p: the number of columns of the second matrix
-@return double**: the result matrix
+prints the cluster of every vector, the column of the largest entry of its row of H, one per line
+@param H: the symnmf matrix
+@param labels: the N*1 matrix the labels are written to if not NULL, instead of printing them
+@return void
 */
-double** matrix_multiplication(double** matrix1, double** matrix2, int n, int m, int p)
+void print_labels(const matrix_t* H, matrix_t* labels)
 {
-    int i,j,k;
-    double sum;
-    double** result_matrix = NULL;
-    
-    if((result_matrix = matrix_malloc(result_matrix, n, p)) == NULL) return NULL; /* Memory allocation failed */
-
-    for(i=0;i<n;i++)
+    int i,j,best;
+    for(i=0;i<H->rows;i++)
     {
-        for(j=0;j<p;j++)
+        best = 0;
+        for(j=1;j<H->cols;j++)
         {
-            sum = 0;
-            for(k=0;k<m;k++)
-            {
-                sum += matrix1[i][k] * matrix2[k][j];
-            }
-            result_matrix[i][j] = sum;
+            if(MATRIX_AT(H, i, j) > MATRIX_AT(H, i, best)) best = j;
         }
+        if(labels != NULL) MATRIX_AT(labels, i, 0) = best;
+        else printf("%d\n", best);
     }
-    return result_matrix;
 }
 
 /*
-transposes a matrix of doubles
-@param matrix: the matrix to be transposed
+returns the stride of the rows of a matrix_create matrix with m columns
+@param m: the number of columns
+@return size_t: m rounded up to a whole cache line of doubles
+*/
+static size_t matrix_stride(int m)
+{
+    size_t row_align = MATRIX_ALIGNMENT / sizeof(double);
+    return ((size_t)m + row_align - 1) / row_align * row_align;
+}
+
+/*
+allocates a dense n*m matrix of doubles in a single aligned block
+the padding at the end of every row is zeroed, the entries are left uninitialized
 @param n: the number of rows
 @param m: the number of columns
-@return double**: the transposed matrix
+@return matrix_t*: the allocated matrix, NULL if allocation failed
 */
-double** matrix_transpose(double** matrix, int n, int m)
+matrix_t* matrix_create(int n, int m)
 {
-    int i,j;
-    double** transposed_matrix = NULL;
-    
-    if((transposed_matrix = matrix_malloc(transposed_matrix, m, n)) == NULL) return NULL; /* Memory allocation failed */
+    int i;
+    char* raw;
+    matrix_t* mat;
 
-    for(i=0;i<n;i++)
+    if((mat = malloc(sizeof(matrix_t))) == NULL)
+    {
+        printf("An Error Has Occured");
+        return NULL;
+    }
+    mat->rows = n;
+    mat->cols = m;
+    mat->stride = (int)matrix_stride(m);
+
+    /* over-allocate by one alignment unit so data can be moved up to the next boundary */
+    if((raw = malloc((size_t)n * (size_t)mat->stride * sizeof(double) + MATRIX_ALIGNMENT)) == NULL)
+    {
+        printf("An Error Has Occured");
+        free(mat);
+        return NULL;
+    }
+    mat->block = raw;
+    mat->data = (double*)(raw + (MATRIX_ALIGNMENT - (size_t)raw % MATRIX_ALIGNMENT) % MATRIX_ALIGNMENT);
+
+    if(mat->stride != m)
     {
-        for(j=0;j<m;j++)
+        for(i=0;i<n;i++)
         {
-            transposed_matrix[j][i] = matrix[i][j];
+            memset(MATRIX_ROW(mat, i) + m, 0, (size_t)(mat->stride - m) * sizeof(double));
         }
     }
-
-    return transposed_matrix;
+    return mat;
 }
 
 /*
-substracts two matrices of doubles
-@param matrix1: the first matrix
-@param matrix2: the second matrix
+wraps an n*m matrix of doubles owned by the caller without copying it
+the data does not have to meet the alignment and padding of matrix_create, every kernel
+falls back to unaligned accesses, and matrix_destroy leaves it alone
+@param data: the first entry of the matrix
 @param n: the number of rows
 @param m: the number of columns
-@return double**: the result matrix
+@param stride: the number of doubles between the starts of two rows, at least m
+@return matrix_t*: the borrowing matrix, NULL if allocation failed
 */
-double** matrix_substraction(double** matrix1, double** matrix2, int n, int m)
+matrix_t* matrix_borrow(double* data, int n, int m, int stride)
 {
-    int i,j;
-    double** result_matrix = NULL;
-    
-    if((result_matrix = matrix_malloc(result_matrix, n, m)) == NULL) return NULL; /* Memory allocation failed */
+    matrix_t* mat;
 
-    for(i=0;i<n;i++)
+    if((mat = malloc(sizeof(matrix_t))) == NULL)
     {
-        for(j=0;j<m;j++)
-        {
-            result_matrix[i][j] = matrix1[i][j] - matrix2[i][j];
-        }
+        printf("An Error Has Occured");
+        return NULL;
     }
-
-    return result_matrix;
+    mat->data = data;
+    mat->rows = n;
+    mat->cols = m;
+    mat->stride = stride;
+    mat->block = NULL;
+    return mat;
 }
 
 /*
-performs the update step of the symnmf algorithm by using the recursive formula
-@param new_H: the new H matrix
-@param H: the old H matrix
-@param nom_matrix: the numerator matrix
-@param denom_matrix: the denominator matrix
-@param N: the number of rows
-@param k: the number of columns
+frees a matrix created by matrix_create
+@param mat: the matrix to be freed, may be NULL
 @return void
 */
-void update_new_H(double** new_H, double** H, double** nom_matrix, double** denom_matrix, int N, int k)
+void matrix_destroy(matrix_t* mat)
 {
-    int i,j;
-    double beta = 0.5;
-    for(i=0;i<N;i++)
-        {
-            for(j=0;j<k;j++)
-            {
-                new_H[i][j] = H[i][j] * (1 - beta + beta*(nom_matrix[i][j] / denom_matrix[i][j]));
-            }
-        }
+    if(mat == NULL) return;
+    free(mat->block);
+    free(mat);
 }
 
 /*
-swiches the old H matrix with the new H matrix
-@param H: the old H matrix
-@param new_H: the new H matrix
-@param N: the number of rows
-@param k: the number of columns
+frees a matrix of doubles with dimensions n*m
+@param p: the matrix to be freed
+@param n: the number of rows
 @return void
 */
-void advance_H(double** H, double** new_H, int N, int k)
+void matrix_free(double** p, int n)
 {
-    int i,j;
-    for(i=0;i<N;i++)
+    int i;
+    for(i=0;i<n;i++)
     {
-        for(j=0;j<k;j++)
-        {
-            H[i][j] = new_H[i][j];
-        }
+        free(p[i]);
     }
+    free(p);
 }
 
 /*
-calculates the forbius norm of a matrix of doubles
-@param matrix: the matrix
+allocates memory for a matrix of doubles with dimensions n*m
+@param new_matrix: the matrix to be allocated
 @param n: the number of rows
 @param m: the number of columns
-@param is_squared: a flag to determine if the squared norm should be returned
-@return double: the forbius norm
+@return double**: the allocated matrix
 */
-double forbius_norm(double** matrix, int n, int m, int is_squared)
+double** matrix_malloc(double** new_matrix, int n, int m)
 {
-    int i,j;
-    double sum = 0;
+    int i;
+    if((new_matrix = malloc(n*sizeof(double*))) == NULL)
+    {
+        printf("An Error Has Occured");
+        free(new_matrix);
+        return NULL;
+    }
     for(i=0;i<n;i++)
     {
-        for(j=0;j<m;j++)
+        if ((new_matrix[i] = malloc(m * sizeof(double))) == NULL)
         {
-            sum += pow(matrix[i][j], 2);
+            printf("An Error Has Occured");
+            matrix_free(new_matrix, n);
+            return NULL;
         }
     }
-    return (is_squared == 0) ? sqrt(sum) : sum;
+    return new_matrix;
 }
 
 /*
-checks the convergence of two matrices of doubles by calculating the forbius norm of their difference
-@param matrix1: the first matrix
-@param matrix2: the second matrix
+copies a pointer-of-rows matrix into a new dense matrix
+@param rows: the pointer-of-rows matrix
 @param n: the number of rows
 @param m: the number of columns
-@return double: the forbius norm of the difference
+@return matrix_t*: the dense copy, NULL if allocation failed
 */
-double matrix_convergence(double** matrix1, double** matrix2, int n, int m)
+matrix_t* matrix_from_rows(double** rows, int n, int m)
 {
-    double** result_matrix = matrix_substraction(matrix1, matrix2, n, m);
-    double norm = forbius_norm(result_matrix, n, m, 1);
-    matrix_free(result_matrix, n);
-    
-    return norm;
+    int i;
+    matrix_t* mat = matrix_create(n, m);
+    if(mat == NULL) return NULL; /* Memory allocation failed */
+
+    for(i=0;i<n;i++)
+    {
+        memcpy(MATRIX_ROW(mat, i), rows[i], (size_t)m * sizeof(double));
+    }
+    return mat;
 }
 
 /*
-calculates the euclidean distance between two vectors of doubles
-@param vec1: the first vector
-@param vec2: the second vector
-@param vecdim: the number of dimensions
-@param is_squared: a flag to determine if the squared distance should be returned
-@return double: the euclidean distance
+copies a dense matrix into a new pointer-of-rows matrix
+@param mat: the dense matrix
+@return double**: the pointer-of-rows copy, NULL if allocation failed
 */
-double euclidean_distance(double* vec1, double* vec2, int vecdim, int is_squared)
+double** matrix_to_rows(const matrix_t* mat)
 {
     int i;
-    double sum = 0;
-    for (i=0;i<vecdim;i++)
+    double** rows = NULL;
+    if((rows = matrix_malloc(rows, mat->rows, mat->cols)) == NULL) return NULL; /* Memory allocation failed */
+
+    for(i=0;i<mat->rows;i++)
     {
-        sum += pow(vec1[i] - vec2[i], 2);
+        memcpy(rows[i], MATRIX_ROW(mat, i), (size_t)mat->cols * sizeof(double));
     }
-    return (is_squared==0) ? sqrt(sum) : sum;
+    return rows;
 }
 
 /*
-calculates the symilarity matrix of a matrix of doubles
-@param vectors: the matrix of vectors
-@param N: the number of rows
-@param vecdim: the number of dimensions
-@return double**: the symilarity matrix
+returns the widest instruction set the matrix kernels may use on this CPU
+@return int: SIMD_AVX512, SIMD_AVX2 or SIMD_SCALAR
 */
-double** sym(double** vectors, int N, int vecdim)
+static int simd_detect(void)
 {
-    int i,j;
-    double value;
-    double** sym_matrix = NULL;
-
-    /* malloc a matrix of doubles sized N*N */
-    if((sym_matrix = matrix_malloc(sym_matrix, N, N)) == NULL) return NULL; /* Memory allocation failed */
+#ifdef SYMNMF_X86_SIMD
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx512f")) return SIMD_AVX512;
+    if(__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) return SIMD_AVX2;
+#endif
+    return SIMD_SCALAR;
+}
 
-    /* calculate the symilarity matrix */
-    for(i=0;i<N;i++)
-    {
-        for(j=i;j<N;j++)
-        {
-            if (i==j)
-            {
-                sym_matrix[i][j] = 0;
-            }
-            else
-            {
-                value = euclidean_distance(vectors[i], vectors[j], vecdim, 1);
-                value = exp(-value/2);
+/*
+selects the instruction set of the matrix kernels
+@param requested: the wanted level, or -1 for the best one the CPU supports
+@return int: the selected level, never wider than what the CPU supports
+*/
+int simd_select(int requested)
+{
+    int supported = simd_detect();
+    simd_level = (requested < 0 || requested > supported) ? supported : requested;
+    return simd_level;
+}
 
-                sym_matrix[i][j] = value;
-                sym_matrix[j][i] = value;
-            }
-        }
-    }
+/*
+sets the number of threads used by the calls made from the calling thread
+@param threads: the number of threads, 0 or less for one per available core
+@return void
+*/
+void symnmf_set_threads(int threads)
+{
+#ifdef _OPENMP
+    omp_set_num_threads(threads > 0 ? threads : omp_get_num_procs());
+#else
+    (void)threads;
+#endif
+}
 
-    return sym_matrix;
+/*
+returns the number of threads used by the calls made from the calling thread
+@return int: the number of threads, 1 when built without OpenMP
+*/
+int symnmf_get_threads(void)
+{
+#ifdef _OPENMP
+    return omp_get_max_threads();
+#else
+    return 1;
+#endif
 }
 
 /*
-calculates the ddg matrix of a matrix of doubles
-@param vectors: the matrix of vectors
-@param N: the number of rows
-@param vecdim: the number of dimensions
-@return double**: the ddg matrix
+returns the number of threads sharing the work of the enclosing parallel region
+@return int: the size of the team, 1 outside of a parallel region
 */
-double** ddg(double** vectors, int N, int vecdim)
+static int team_size(void)
 {
-    int i,j;
-    double sum;
-    double** sym_matrix = NULL;
-    double** ddg_matrix = NULL;
+#ifdef _OPENMP
+    return omp_get_num_threads();
+#else
+    return 1;
+#endif
+}
 
-    /* calculate sym and malloc a matrix of doubles sized N*n */
-    if((sym_matrix = sym(vectors, N, vecdim)) == NULL) return NULL;  /* Memory allocation failed */
+/*
+generic register block of the gemm: adds A*B to C for up to GEMM_MR rows and GEMM_NR columns
+@param mr: the number of rows of the block
+@param nr: the number of columns of the block
+@param kc: the length of the inner dimension
+@param A: the first entry of the A panel, entry (r,p) is at A[r*ars + p*acs]
+@param B: the first row of the B panel, ldb doubles between rows
+@param C: the first row of the C block, ldc doubles between rows
+@return void
+*/
+static void gemm_kernel_scalar(int mr, int nr, int kc, const double* A, size_t ars, size_t acs,
+                               const double* B, size_t ldb, double* C, size_t ldc)
+{
+    int r,p,j;
+    double a;
+    double acc[GEMM_MR][GEMM_NR];
 
-    if ((ddg_matrix = matrix_malloc(ddg_matrix, N, N)) == NULL) /* Memory allocation failed */
+    for(r=0;r<mr;r++)
     {
-        matrix_free(sym_matrix, N);
-        return NULL;
+        for(j=0;j<nr;j++)
+        {
+            acc[r][j] = 0;
+        }
     }
-    
-
-    /* initialize the ddg matrix */
-    for(i=0;i<N;i++)
+    for(p=0;p<kc;p++)
     {
-        for(j=0;j<N;j++)
+        for(r=0;r<mr;r++)
         {
-            ddg_matrix[i][j] = 0;
+            a = A[r*ars + p*acs];
+            for(j=0;j<nr;j++)
+            {
+                acc[r][j] += a * B[p*ldb + j];
+            }
         }
     }
-    /* calculate the ddg matrix */
-    for(i=0;i<N;i++)
+    for(r=0;r<mr;r++)
     {
-        sum = 0;
-        for(j=0;j<N;j++)
+        for(j=0;j<nr;j++)
         {
-            sum += sym_matrix[i][j];
+            C[r*ldc + j] += acc[r][j];
         }
-        ddg_matrix[i][i] = sum;
     }
-
-    matrix_free(sym_matrix, N);
-    return ddg_matrix;
 }
 
+#ifdef SYMNMF_X86_SIMD
 /*
-calculates the norm matrix of a matrix of doubles
-@param vectors: the matrix of vectors
-@param N: the number of rows
-@param vecdim: the number of dimensions
-@return double**: the norm matrix
+AVX2 register block of the gemm: adds A*B to C for 4 rows and 8 columns
+the 4x8 block is held in eight ymm accumulators, each step broadcasts one entry of A per row
+@param kc: the length of the inner dimension
+@param A: the first entry of the A panel, entry (r,p) is at A[r*ars + p*acs]
+@param B: the first row of the B panel, ldb doubles between rows
+@param C: the first row of the C block, ldc doubles between rows
+@return void
 */
-double** norm(double** vectors, int N, int vecdim)
+__attribute__((target("avx2,fma")))
+static void gemm_kernel_avx2(int kc, const double* A, size_t ars, size_t acs,
+                              const double* B, size_t ldb, double* C, size_t ldc)
 {
-    int i,j;
-    double** sym_matrix = NULL;
-    double** ddg_matrix = NULL;
-    double** norm_matrix = NULL;
+    int p;
+    __m256d a, b0, b1;
+    __m256d c00 = _mm256_setzero_pd(), c01 = _mm256_setzero_pd();
+    __m256d c10 = _mm256_setzero_pd(), c11 = _mm256_setzero_pd();
+    __m256d c20 = _mm256_setzero_pd(), c21 = _mm256_setzero_pd();
+    __m256d c30 = _mm256_setzero_pd(), c31 = _mm256_setzero_pd();
 
-    /* malloc a matrix of doubles sized N on vecdim */
-    if((sym_matrix = sym(vectors, N, vecdim)) == NULL) return NULL; /* Memory allocation failed */
-
-    if((ddg_matrix = ddg(vectors, N, vecdim)) == NULL) /* Memory allocation failed */
+    for(p=0;p<kc;p++)
     {
-        matrix_free(sym_matrix, N);
-        return NULL;
+        b0 = _mm256_loadu_pd(B + p*ldb);
+        b1 = _mm256_loadu_pd(B + p*ldb + 4);
+        a = _mm256_broadcast_sd(A);
+        c00 = _mm256_fmadd_pd(a, b0, c00);
+        c01 = _mm256_fmadd_pd(a, b1, c01);
+        a = _mm256_broadcast_sd(A + ars);
+        c10 = _mm256_fmadd_pd(a, b0, c10);
+        c11 = _mm256_fmadd_pd(a, b1, c11);
+        a = _mm256_broadcast_sd(A + 2*ars);
+        c20 = _mm256_fmadd_pd(a, b0, c20);
+        c21 = _mm256_fmadd_pd(a, b1, c21);
+        a = _mm256_broadcast_sd(A + 3*ars);
+        c30 = _mm256_fmadd_pd(a, b0, c30);
+        c31 = _mm256_fmadd_pd(a, b1, c31);
+        A += acs;
     }
+    _mm256_storeu_pd(C, _mm256_add_pd(_mm256_loadu_pd(C), c00));
+    _mm256_storeu_pd(C + 4, _mm256_add_pd(_mm256_loadu_pd(C + 4), c01));
+    _mm256_storeu_pd(C + ldc, _mm256_add_pd(_mm256_loadu_pd(C + ldc), c10));
+    _mm256_storeu_pd(C + ldc + 4, _mm256_add_pd(_mm256_loadu_pd(C + ldc + 4), c11));
+    _mm256_storeu_pd(C + 2*ldc, _mm256_add_pd(_mm256_loadu_pd(C + 2*ldc), c20));
+    _mm256_storeu_pd(C + 2*ldc + 4, _mm256_add_pd(_mm256_loadu_pd(C + 2*ldc + 4), c21));
+    _mm256_storeu_pd(C + 3*ldc, _mm256_add_pd(_mm256_loadu_pd(C + 3*ldc), c30));
+    _mm256_storeu_pd(C + 3*ldc + 4, _mm256_add_pd(_mm256_loadu_pd(C + 3*ldc + 4), c31));
+}
+
+/*
+AVX-512 register block of the gemm: adds A*B to C for 8 rows and 8 columns
+every row of the block is one zmm accumulator
+@param kc: the length of the inner dimension
+@param A: the first entry of the A panel, entry (r,p) is at A[r*ars + p*acs]
+@param B: the first row of the B panel, ldb doubles between rows
+@param C: the first row of the C block, ldc doubles between rows
+@return void
+*/
+__attribute__((target("avx512f")))
+static void gemm_kernel_avx512(int kc, const double* A, size_t ars, size_t acs,
+                              const double* B, size_t ldb, double* C, size_t ldc)
+{
+    int p;
+    __m512d b;
+    __m512d c0 = _mm512_setzero_pd(), c1 = _mm512_setzero_pd();
+    __m512d c2 = _mm512_setzero_pd(), c3 = _mm512_setzero_pd();
+    __m512d c4 = _mm512_setzero_pd(), c5 = _mm512_setzero_pd();
+    __m512d c6 = _mm512_setzero_pd(), c7 = _mm512_setzero_pd();
 
-    if ((norm_matrix = matrix_malloc(norm_matrix, N, N)) == NULL) /* Memory allocation failed */
+    for(p=0;p<kc;p++)
     {
-        matrix_free(sym_matrix, N);
-        matrix_free(ddg_matrix, N);
-        return NULL;
+        b = _mm512_loadu_pd(B + p*ldb);
+        c0 = _mm512_fmadd_pd(_mm512_set1_pd(A[0]), b, c0);
+        c1 = _mm512_fmadd_pd(_mm512_set1_pd(A[ars]), b, c1);
+        c2 = _mm512_fmadd_pd(_mm512_set1_pd(A[2*ars]), b, c2);
+        c3 = _mm512_fmadd_pd(_mm512_set1_pd(A[3*ars]), b, c3);
+        c4 = _mm512_fmadd_pd(_mm512_set1_pd(A[4*ars]), b, c4);
+        c5 = _mm512_fmadd_pd(_mm512_set1_pd(A[5*ars]), b, c5);
+        c6 = _mm512_fmadd_pd(_mm512_set1_pd(A[6*ars]), b, c6);
+        c7 = _mm512_fmadd_pd(_mm512_set1_pd(A[7*ars]), b, c7);
+        A += acs;
     }
+    _mm512_storeu_pd(C, _mm512_add_pd(_mm512_loadu_pd(C), c0));
+    _mm512_storeu_pd(C + ldc, _mm512_add_pd(_mm512_loadu_pd(C + ldc), c1));
+    _mm512_storeu_pd(C + 2*ldc, _mm512_add_pd(_mm512_loadu_pd(C + 2*ldc), c2));
+    _mm512_storeu_pd(C + 3*ldc, _mm512_add_pd(_mm512_loadu_pd(C + 3*ldc), c3));
+    _mm512_storeu_pd(C + 4*ldc, _mm512_add_pd(_mm512_loadu_pd(C + 4*ldc), c4));
+    _mm512_storeu_pd(C + 5*ldc, _mm512_add_pd(_mm512_loadu_pd(C + 5*ldc), c5));
+    _mm512_storeu_pd(C + 6*ldc, _mm512_add_pd(_mm512_loadu_pd(C + 6*ldc), c6));
+    _mm512_storeu_pd(C + 7*ldc, _mm512_add_pd(_mm512_loadu_pd(C + 7*ldc), c7));
+}
+#endif
 
-    /* calculate the norm matrix */
-    for(i=0;i<N;i++)
+/*
+adds A*B to C, where A is m*inner, B is inner*ncols and C is m*ncols
+the inner dimension is split into GEMM_KC long panels so the GEMM_KC*GEMM_NR panel of B
+stays in L1 while every row block of A streams past it once; with the small k of symnmf
+B has a single column panel and A (the N*N matrix) is read exactly once
+@param m: the number of rows of A and C
+@param ncols: the number of columns of B and C
+@param inner: the number of columns of A and rows of B
+@param A: the first matrix, entry (i,p) is at A[i*ars + p*acs] so a transposed operand costs nothing
+@param B: the second matrix, ldb doubles between rows
+@param C: the result matrix, ldc doubles between rows
+@return void
+*/
+static void gemm_accumulate(int m, int ncols, int inner, const double* A, size_t ars, size_t acs,
+                            const double* B, size_t ldb, double* C, size_t ldc)
+{
+    int pc,ic,jc,kc,mr,nr,mr_full;
+    int padded = (ncols + GEMM_NR - 1) / GEMM_NR * GEMM_NR;
+
+    if(simd_level < 0) simd_select(-1);
+    /* the zeroed row padding lets the vector kernels run over whole GEMM_NR wide column panels */
+    if(simd_level != SIMD_SCALAR && (size_t)padded <= ldb && (size_t)padded <= ldc) ncols = padded;
+    mr_full = (simd_level == SIMD_AVX512) ? 8 : 4;
+
+    for(pc=0;pc<inner;pc+=GEMM_KC)
     {
-        for(j=0;j<N;j++)
+        kc = (inner - pc < GEMM_KC) ? inner - pc : GEMM_KC;
+        for(ic=0;ic<m;ic+=mr_full)
         {
-            norm_matrix[i][j] = sym_matrix[i][j] / sqrt(ddg_matrix[i][i] * ddg_matrix[j][j]);
+            mr = (m - ic < mr_full) ? m - ic : mr_full;
+            for(jc=0;jc<ncols;jc+=GEMM_NR)
+            {
+                const double* a = A + ic*ars + pc*acs;
+                const double* b = B + pc*ldb + jc;
+                double* c = C + ic*ldc + jc;
+                nr = (ncols - jc < GEMM_NR) ? ncols - jc : GEMM_NR;
+#ifdef SYMNMF_X86_SIMD
+                if(mr == mr_full && nr == GEMM_NR && simd_level == SIMD_AVX512)
+                {
+                    gemm_kernel_avx512(kc, a, ars, acs, b, ldb, c, ldc);
+                    continue;
+                }
+                if(mr == mr_full && nr == GEMM_NR && simd_level == SIMD_AVX2)
+                {
+                    gemm_kernel_avx2(kc, a, ars, acs, b, ldb, c, ldc);
+                    continue;
+                }
+#endif
+                gemm_kernel_scalar(mr, nr, kc, a, ars, acs, b, ldb, c, ldc);
+            }
         }
     }
-
-    matrix_free(sym_matrix, N);
-    matrix_free(ddg_matrix, N);
-    return norm_matrix;
 }
 
 /*
-calculates the symnmf matrix of a matrix of doubles using norm and H matrices
-check the convergence of the H matrix and updates it until convergence is reached for epsilon = 0.0001
-or until 300 iterations are reached
-@param W: the norm matrix
-@param H: the H matrix
-@param N: the number of rows
-@param k: the number of columns
-@return double**: the symnmf matrix
+multiplies two matrices of doubles into a preallocated result matrix
+cache-blocked and register-blocked, using the widest kernel selected by simd_select
+@param matrix1: the first matrix, n*m
+@param matrix2: the second matrix, m*p
+@param result_matrix: the result matrix, n*p, must not alias the inputs
+@return void
 */
-double** symnmf(double** W, double** H, int N, int k)
+void matrix_multiplication(const matrix_t* matrix1, const matrix_t* matrix2, matrix_t* result_matrix)
 {
     int i;
-    double** new_H = NULL;
-    int iter = 300;
-    double eps = 0.0001;
-    new_H = matrix_malloc(new_H, N, k);
-    if(new_H == NULL) return NULL; /* Memory allocation failed */
 
-    for(i=0;i<iter;i++)
+    for(i=0;i<result_matrix->rows;i++)
     {
-        /* calculate the numerator and denominator matrices */
-        double** nom_matrix;
-        double** transposed_matrix;
-        double** denom_matrix;
-        double** helper_matrix;
-
-        if((nom_matrix = matrix_multiplication(W, H, N, N, k)) == NULL) return NULL;/* Memory allocation failed */
+        memset(MATRIX_ROW(result_matrix, i), 0, (size_t)result_matrix->stride * sizeof(double));
+    }
+    gemm_accumulate(matrix1->rows, matrix2->cols, matrix1->cols, matrix1->data, (size_t)matrix1->stride, 1,
+                    matrix2->data, (size_t)matrix2->stride, result_matrix->data, (size_t)result_matrix->stride);
+}
 
-        if((transposed_matrix = matrix_transpose(H, N, k)) == NULL) /* Memory allocation failed */
-        {
-            matrix_free(nom_matrix, N);
-            return NULL;
-        }
+/*
+coefficients 1/i! of the Taylor polynomial of exp on [-ln2/2, ln2/2], highest first; the first left out,
+r^14/14!, is below 4e-18 there, so the polynomial adds well under an ulp to the rounding of the evaluation
+*/
+static const double exp_coefficients[] = {
+    1.0/6227020800.0, 1.0/479001600.0, 1.0/39916800.0, 1.0/3628800.0, 1.0/362880.0, 1.0/40320.0,
+    1.0/5040.0, 1.0/720.0, 1.0/120.0, 1.0/24.0, 1.0/6.0, 0.5, 1.0, 1.0
+};
+#define EXP_DEGREE 13
+#define LOG2E 1.4426950408889634
+#define LN2_HI 0.6931471805599453    /* ln2 rounded to a double */
+#define LN2_LO 2.3190468138462996e-17 /* ln2 - LN2_HI */
 
-        helper_matrix = matrix_multiplication(H, transposed_matrix, N, k, N);
-        matrix_free(transposed_matrix, k);
-        if(helper_matrix == NULL) /* Memory allocation failed */
+#ifdef SYMNMF_X86_SIMD
+/*
+AVX2 batch exponential, exp(x) = 2^n * exp(r) with n = round(x/ln2) and |r| <= ln2/2
+r is reduced with a two-part ln2 under fma, exp(r) is the Taylor polynomial by Horner, and 2^n is
+applied as two powers of two built in the exponent bits, so results down to the subnormals need no
+special case; within 2 ulp of libm
+@param values: the arguments, replaced by their exponentials
+@param n: the number of values
+@return int: the number of values done, the tail short of a whole vector is left to the caller
+*/
+__attribute__((target("avx2,fma")))
+static int exp_batch_avx2(double* values, int n)
+{
+    int i,c;
+    __m256d x, k, r, p, half;
+    __m128i e;
+
+    for(i=0;i+4<=n;i+=4)
+    {
+        x = _mm256_loadu_pd(values + i);
+        x = _mm256_min_pd(_mm256_max_pd(x, _mm256_set1_pd(EXP_LOWEST)), _mm256_set1_pd(EXP_HIGHEST));
+        k = _mm256_round_pd(_mm256_mul_pd(x, _mm256_set1_pd(LOG2E)), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+        r = _mm256_fnmadd_pd(k, _mm256_set1_pd(LN2_HI), x);
+        r = _mm256_fnmadd_pd(k, _mm256_set1_pd(LN2_LO), r);
+        p = _mm256_set1_pd(exp_coefficients[0]);
+        for(c=1;c<=EXP_DEGREE;c++)
+        {
+            p = _mm256_fmadd_pd(p, r, _mm256_set1_pd(exp_coefficients[c]));
+        }
+        /* 2^k as 2^half * 2^(k-half), each within the exponent range of a double */
+        half = _mm256_round_pd(_mm256_mul_pd(k, _mm256_set1_pd(0.5)), _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC);
+        e = _mm_add_epi32(_mm256_cvtpd_epi32(half), _mm_set1_epi32(1023));
+        p = _mm256_mul_pd(p, _mm256_castsi256_pd(_mm256_slli_epi64(_mm256_cvtepi32_epi64(e), 52)));
+        e = _mm_add_epi32(_mm256_cvtpd_epi32(_mm256_sub_pd(k, half)), _mm_set1_epi32(1023));
+        p = _mm256_mul_pd(p, _mm256_castsi256_pd(_mm256_slli_epi64(_mm256_cvtepi32_epi64(e), 52)));
+        _mm256_storeu_pd(values + i, p);
+    }
+    return i;
+}
+
+/*
+AVX-512 batch exponential, the reduction and polynomial of exp_batch_avx2 with 2^n applied by scalef,
+which rounds subnormal results once
+@param values: the arguments, replaced by their exponentials
+@param n: the number of values
+@return int: the number of values done, the tail short of a whole vector is left to the caller
+*/
+__attribute__((target("avx512f")))
+static int exp_batch_avx512(double* values, int n)
+{
+    int i,c;
+    __m512d x, k, r, p;
+
+    for(i=0;i+8<=n;i+=8)
+    {
+        x = _mm512_loadu_pd(values + i);
+        x = _mm512_min_pd(_mm512_max_pd(x, _mm512_set1_pd(EXP_LOWEST)), _mm512_set1_pd(EXP_HIGHEST));
+        k = _mm512_roundscale_pd(_mm512_mul_pd(x, _mm512_set1_pd(LOG2E)), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+        r = _mm512_fnmadd_pd(k, _mm512_set1_pd(LN2_HI), x);
+        r = _mm512_fnmadd_pd(k, _mm512_set1_pd(LN2_LO), r);
+        p = _mm512_set1_pd(exp_coefficients[0]);
+        for(c=1;c<=EXP_DEGREE;c++)
+        {
+            p = _mm512_fmadd_pd(p, r, _mm512_set1_pd(exp_coefficients[c]));
+        }
+        _mm512_storeu_pd(values + i, _mm512_scalef_pd(p, k));
+    }
+    return i;
+}
+#endif
+
+/*
+replaces n values by their exponentials, with the widest kernel selected by simd_select
+the vector kernels stay within 2 ulp of libm, the scalar level and the tails call libm exp
+@param values: the arguments, replaced by their exponentials
+@param n: the number of values
+@return void
+*/
+void exp_batch(double* values, int n)
+{
+    int i = 0;
+
+    if(simd_level < 0) simd_select(-1);
+#ifdef SYMNMF_X86_SIMD
+    if(simd_level == SIMD_AVX512) i = exp_batch_avx512(values, n);
+    else if(simd_level == SIMD_AVX2) i = exp_batch_avx2(values, n);
+#endif
+    for(;i<n;i++)
+    {
+        values[i] = exp(values[i]);
+    }
+}
+
+/*
+returns the tile edge of a packed symmetric matrix of order n
+small matrices get a single tile rounded up to a cache line instead of a mostly empty full tile
+@param n: the order of the matrix
+@return int: the edge of its tiles
+*/
+static int symmatrix_tile_size(int n)
+{
+    int tile = (n < SYMMATRIX_TILE) ? (n + 7) / 8 * 8 : SYMMATRIX_TILE;
+    return (tile == 0) ? 8 : tile;
+}
+
+/*
+allocates a zeroed packed symmetric n*n matrix of doubles
+@param n: the order of the matrix
+@return symmatrix_t*: the allocated matrix, NULL if allocation failed
+*/
+symmatrix_t* symmatrix_create(int n)
+{
+    size_t bytes;
+    char* raw;
+    symmatrix_t* mat;
+
+    if((mat = malloc(sizeof(symmatrix_t))) == NULL)
+    {
+        printf("An Error Has Occured");
+        return NULL;
+    }
+    mat->n = n;
+    mat->tile = symmatrix_tile_size(n);
+    mat->tiles = (n + mat->tile - 1) / mat->tile;
+
+    bytes = (size_t)mat->tiles * (size_t)(mat->tiles + 1) / 2 * (size_t)mat->tile * (size_t)mat->tile * sizeof(double);
+    if((raw = malloc(bytes + MATRIX_ALIGNMENT)) == NULL)
+    {
+        printf("An Error Has Occured");
+        free(mat);
+        return NULL;
+    }
+    mat->block = raw;
+    mat->data = (double*)(raw + (MATRIX_ALIGNMENT - (size_t)raw % MATRIX_ALIGNMENT) % MATRIX_ALIGNMENT);
+    memset(mat->data, 0, bytes);
+    return mat;
+}
+
+/*
+frees a matrix created by symmatrix_create
+@param mat: the matrix to be freed, may be NULL
+@return void
+*/
+void symmatrix_destroy(symmatrix_t* mat)
+{
+    if(mat == NULL) return;
+    free(mat->block);
+    free(mat);
+}
+
+/*
+returns the storage index of the tile (I,J) of a triangle of tiles x tiles tiles, the inverse of tile_coords
+@param tiles: the number of tile rows
+@param I: the tile row, I <= J
+@param J: the tile column
+@return size_t: the index of the tile in storage order
+*/
+static size_t tile_index(int tiles, int I, int J)
+{
+    return (size_t)I * (size_t)tiles - (size_t)I * (size_t)(I - 1) / 2 + (size_t)(J - I);
+}
+
+/*
+returns the stored tile (I,J) of a packed symmetric matrix
+@param mat: the matrix
+@param I: the tile row, I <= J
+@param J: the tile column
+@return double*: the tile*tile row-major block
+*/
+double* symmatrix_tile(const symmatrix_t* mat, int I, int J)
+{
+    return mat->data + tile_index(mat->tiles, I, J) * (size_t)mat->tile * (size_t)mat->tile;
+}
+
+/*
+returns the stored copy of entry (i,j) of a packed symmetric matrix
+@param mat: the matrix
+@param i: the row
+@param j: the column
+@return double*: the entry, shared with (j,i)
+*/
+double* symmatrix_entry(const symmatrix_t* mat, int i, int j)
+{
+    int swap;
+    if(i / mat->tile > j / mat->tile)
+    {
+        swap = i;
+        i = j;
+        j = swap;
+    }
+    return symmatrix_tile(mat, i / mat->tile, j / mat->tile) + (i % mat->tile) * mat->tile + j % mat->tile;
+}
+
+/*
+multiplies a packed symmetric matrix by a dense matrix (SYMM) into a preallocated result matrix
+run by one thread, every stored off-diagonal tile is used twice, once as is for its tile row and
+once transposed for its tile column, so the matrix is streamed from memory exactly once
+inside a parallel region the tile rows of the result are shared out instead, each one summed by
+its owner from its tile column and tile row; the owner adds the tiles in the same order as the
+single thread does, so the result is the same for any number of threads
+@param W: the symmetric matrix, N*N
+@param H: the dense matrix, N*k
+@param result_matrix: the result matrix, N*k, must not alias H
+@return void
+*/
+void symmatrix_multiplication(const symmatrix_t* W, const matrix_t* H, matrix_t* result_matrix)
+{
+    int i,I,J,rows,cols;
+    int T = W->tile;
+    size_t ldh = (size_t)H->stride, ldr = (size_t)result_matrix->stride;
+    const double* tile;
+
+    if(team_size() == 1)
+    {
+        for(i=0;i<result_matrix->rows;i++)
+        {
+            memset(MATRIX_ROW(result_matrix, i), 0, (size_t)result_matrix->stride * sizeof(double));
+        }
+        for(I=0;I<W->tiles;I++)
+        {
+            rows = (W->n - I*T < T) ? W->n - I*T : T;
+            for(J=I;J<W->tiles;J++)
+            {
+                cols = (W->n - J*T < T) ? W->n - J*T : T;
+                tile = symmatrix_tile(W, I, J);
+                gemm_accumulate(rows, H->cols, cols, tile, (size_t)T, 1,
+                                MATRIX_ROW(H, J*T), ldh, MATRIX_ROW(result_matrix, I*T), ldr);
+                if(I != J)
+                {
+                    gemm_accumulate(cols, H->cols, rows, tile, 1, (size_t)T,
+                                    MATRIX_ROW(H, I*T), ldh, MATRIX_ROW(result_matrix, J*T), ldr);
+                }
+            }
+        }
+        return;
+    }
+
+#pragma omp for schedule(dynamic, 1)
+    for(I=0;I<W->tiles;I++)
+    {
+        rows = (W->n - I*T < T) ? W->n - I*T : T;
+        for(i=0;i<rows;i++)
+        {
+            memset(MATRIX_ROW(result_matrix, I*T + i), 0, (size_t)result_matrix->stride * sizeof(double));
+        }
+        for(J=0;J<I;J++)
+        {
+            gemm_accumulate(rows, H->cols, T, symmatrix_tile(W, J, I), 1, (size_t)T,
+                            MATRIX_ROW(H, J*T), ldh, MATRIX_ROW(result_matrix, I*T), ldr);
+        }
+        for(J=I;J<W->tiles;J++)
+        {
+            cols = (W->n - J*T < T) ? W->n - J*T : T;
+            gemm_accumulate(rows, H->cols, cols, symmatrix_tile(W, I, J), (size_t)T, 1,
+                            MATRIX_ROW(H, J*T), ldh, MATRIX_ROW(result_matrix, I*T), ldr);
+        }
+    }
+}
+
+/*
+finds the tile row and column of the t-th stored tile of a triangle of tiles x tiles tiles
+@param tiles: the number of tile rows
+@param t: the index of the tile in storage order
+@param I: the tile row is written here
+@param J: the tile column is written here
+@return void
+*/
+static void tile_coords(int tiles, size_t t, int* I, int* J)
+{
+    double b = 2.0 * tiles + 1;
+    int row = (int)((b - sqrt(b * b - 8.0 * (double)t)) / 2);
+
+    /* tile row I starts at index I*tiles - I*(I-1)/2, correct the floating point estimate */
+    if(row < 0) row = 0;
+    while(row > 0 && (size_t)row * tiles - (size_t)row * (row - 1) / 2 > t) row--;
+    while(row + 1 < tiles && (size_t)(row + 1) * tiles - (size_t)(row + 1) * row / 2 <= t) row++;
+    *I = row;
+    *J = row + (int)(t - ((size_t)row * tiles - (size_t)row * (row - 1) / 2));
+}
+
+/*
+finds the tile row and column of the t-th stored tile of a packed symmetric matrix
+@param mat: the matrix
+@param t: the index of the tile in storage order
+@param I: the tile row is written here
+@param J: the tile column is written here
+@return void
+*/
+void symmatrix_tile_coords(const symmatrix_t* mat, size_t t, int* I, int* J)
+{
+    tile_coords(mat->tiles, t, I, J);
+}
+
+/*
+calculates the row sums of a packed symmetric matrix
+every tile row is reduced by one thread in a fixed order, so the sums do not depend on the thread count:
+the column sums of each tile above the tile row, added in tile order, plus the running row sums of its own tiles;
+calc_norm_f32 sums its tiles the same way
+@param W: the symmetric matrix, N*N
+@param sums: the result vector, N long
+@return void
+*/
+void symmatrix_row_sums(const symmatrix_t* W, double* sums)
+{
+    int r,c,I,J,rows;
+    int T = W->tile;
+    double acc[SYMMATRIX_TILE];
+    double part[SYMMATRIX_TILE];
+    double own[SYMMATRIX_TILE];
+    const double* tile;
+
+#pragma omp parallel for schedule(dynamic, 1) private(r, c, J, rows, acc, part, own, tile)
+    for(I=0;I<W->tiles;I++)
+    {
+        rows = (W->n - I*T < T) ? W->n - I*T : T;
+        for(c=0;c<T;c++)
+        {
+            acc[c] = 0;
+            own[c] = 0;
+        }
+        /* tiles above tile row I hold its rows as their columns */
+        for(J=0;J<I;J++)
+        {
+            tile = symmatrix_tile(W, J, I);
+            for(c=0;c<T;c++)
+            {
+                part[c] = 0;
+            }
+            for(r=0;r<T;r++)
+            {
+                for(c=0;c<T;c++)
+                {
+                    part[c] += tile[r*T + c];
+                }
+            }
+            for(c=0;c<T;c++)
+            {
+                acc[c] += part[c];
+            }
+        }
+        for(J=I;J<W->tiles;J++)
+        {
+            tile = symmatrix_tile(W, I, J);
+            for(r=0;r<T;r++)
+            {
+                for(c=0;c<T;c++)
+                {
+                    own[r] += tile[r*T + c];
+                }
+            }
+        }
+        for(r=0;r<rows;r++)
+        {
+            sums[I*T + r] = acc[r] + own[r];
+        }
+    }
+}
+
+/*
+asks the kernel to start reading tile row I of a packed symmetric matrix held in a mapped file,
+so the read overlaps the work on the tile row before it
+@param W: the symmetric matrix
+@param I: the tile row
+@return void
+*/
+static void prefetch_tile_row(const symmatrix_t* W, int I)
+{
+#ifdef SYMNMF_HAVE_MMAP
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    char* first = (char*)symmatrix_tile(W, I, I);
+    char* last = (char*)(symmatrix_tile(W, I, W->tiles - 1) + (size_t)W->tile * (size_t)W->tile);
+    char* start = first - (size_t)first % page;
+    posix_madvise(start, (size_t)(last - start), POSIX_MADV_WILLNEED);
+#else
+    (void)W;
+    (void)I;
+#endif
+}
+
+/*
+multiplies a packed symmetric matrix by a dense matrix, reading W once in storage order
+for a W mapped from a file larger than memory: the tile rows are taken one after the other while the
+next one is prefetched, so only a few tile rows of W have to be resident at a time
+a tile row is cut into chunks of STREAM_TILES tiles, each taken by one thread that uses every tile twice
+while it is in cache, transposed for the result rows of its tile column and as is for a partial sum of
+the result rows of the tile row; the partial sums are added in chunk order, so the result is the same
+for any number of threads
+the partial sums are kept in a buffer of symmatrix_stream_scratch doubles allocated once by the caller,
+without it every tile row is a single chunk
+called by every thread of a team, or by a single thread outside one
+@param W: the symmetric matrix, N*N
+@param H: the dense matrix, N*k
+@param result_matrix: the result matrix, N*k, must not alias H
+@param partials: the buffer of the partial sums, NULL to take every tile row as one chunk
+@return void
+*/
+void symmatrix_stream_multiplication(const symmatrix_t* W, const matrix_t* H, matrix_t* result_matrix, double* partials)
+{
+    int i,j,I,J,c,rows,cols,chunks;
+    int T = W->tile;
+    int width = (partials != NULL) ? STREAM_TILES : W->tiles;
+    size_t ldh = (size_t)H->stride, ldr = (size_t)result_matrix->stride;
+    size_t part = (size_t)T * ldr;
+    double* sums;
+    const double* tile;
+
+#pragma omp single nowait
+    prefetch_tile_row(W, 0);
+#pragma omp for schedule(static)
+    for(i=0;i<result_matrix->rows;i++)
+    {
+        memset(MATRIX_ROW(result_matrix, i), 0, (size_t)result_matrix->stride * sizeof(double));
+    }
+
+    for(I=0;I<W->tiles;I++)
+    {
+        rows = (W->n - I*T < T) ? W->n - I*T : T;
+        chunks = (W->tiles - I + width - 1) / width;
+#pragma omp single nowait
+        {
+            if(I + 1 < W->tiles) prefetch_tile_row(W, I + 1);
+        }
+#pragma omp for schedule(dynamic, 1)
+        for(c=0;c<chunks;c++)
+        {
+            /* the first chunk adds straight to the result rows of the tile row */
+            sums = (c == 0) ? MATRIX_ROW(result_matrix, I*T) : partials + (size_t)(c - 1) * part;
+            if(c > 0) memset(sums, 0, part * sizeof(double));
+            for(J=I+c*width;J<I+(c+1)*width && J<W->tiles;J++)
+            {
+                cols = (W->n - J*T < T) ? W->n - J*T : T;
+                tile = symmatrix_tile(W, I, J);
+                gemm_accumulate(rows, H->cols, cols, tile, (size_t)T, 1, MATRIX_ROW(H, J*T), ldh, sums, ldr);
+                if(J != I)
+                {
+                    gemm_accumulate(cols, H->cols, rows, tile, 1, (size_t)T,
+                                    MATRIX_ROW(H, I*T), ldh, MATRIX_ROW(result_matrix, J*T), ldr);
+                }
+            }
+        }
+#pragma omp for schedule(static)
+        for(i=0;i<rows;i++)
+        {
+            for(c=1;c<chunks;c++)
+            {
+                sums = partials + (size_t)(c - 1) * part + (size_t)i * ldr;
+                for(j=0;j<H->cols;j++)
+                {
+                    MATRIX_AT(result_matrix, I*T + i, j) += sums[j];
+                }
+            }
+        }
+    }
+}
+
+/*
+returns the size of the buffer of partial sums of symmatrix_stream_multiplication
+@param W: the symmetric matrix, N*N
+@param k: the number of columns of H
+@return size_t: the number of doubles of the buffer
+*/
+size_t symmatrix_stream_scratch(const symmatrix_t* W, int k)
+{
+    return (size_t)((W->tiles + STREAM_TILES - 1) / STREAM_TILES) * (size_t)W->tile * matrix_stride(k);
+}
+
+/*
+calculates the row sums of a packed symmetric matrix as the product of W by ones, see symmatrix_stream_multiplication
+@param W: the symmetric matrix, N*N
+@param sums: the result vector, N long
+@return int: 0 on success, 1 if allocation failed
+*/
+static int symmatrix_stream_row_sums(const symmatrix_t* W, double* sums)
+{
+    int i;
+    matrix_t* ones = matrix_create(W->n, 1);
+    matrix_t* result = matrix_create(W->n, 1);
+    double* partials = malloc(symmatrix_stream_scratch(W, 1) * sizeof(double));
+
+    if(ones == NULL || result == NULL || partials == NULL) /* Memory allocation failed */
+    {
+        if(partials == NULL) printf("An Error Has Occured");
+        matrix_destroy(ones);
+        matrix_destroy(result);
+        free(partials);
+        return 1;
+    }
+    for(i=0;i<W->n;i++)
+    {
+        MATRIX_AT(ones, i, 0) = 1;
+    }
+#pragma omp parallel
+    symmatrix_stream_multiplication(W, ones, result, partials);
+    for(i=0;i<W->n;i++)
+    {
+        sums[i] = MATRIX_AT(result, i, 0);
+    }
+    matrix_destroy(ones);
+    matrix_destroy(result);
+    free(partials);
+    return 0;
+}
+
+/*
+allocates a zeroed packed symmetric n*n matrix of floats, with the tiles of symmatrix_create(n)
+@param n: the order of the matrix
+@return symmatrixf_t*: the allocated matrix, NULL if allocation failed
+*/
+symmatrixf_t* symmatrixf_create(int n)
+{
+    size_t bytes;
+    char* raw;
+    symmatrixf_t* mat;
+
+    if((mat = malloc(sizeof(symmatrixf_t))) == NULL)
+    {
+        printf("An Error Has Occured");
+        return NULL;
+    }
+    mat->n = n;
+    mat->tile = symmatrix_tile_size(n);
+    mat->tiles = (n + mat->tile - 1) / mat->tile;
+
+    bytes = (size_t)mat->tiles * (size_t)(mat->tiles + 1) / 2 * (size_t)mat->tile * (size_t)mat->tile * sizeof(float);
+    if((raw = malloc(bytes + MATRIX_ALIGNMENT)) == NULL)
+    {
+        printf("An Error Has Occured");
+        free(mat);
+        return NULL;
+    }
+    mat->block = raw;
+    mat->data = (float*)(raw + (MATRIX_ALIGNMENT - (size_t)raw % MATRIX_ALIGNMENT) % MATRIX_ALIGNMENT);
+    memset(mat->data, 0, bytes);
+    return mat;
+}
+
+/*
+frees a matrix created by symmatrixf_create
+@param mat: the matrix to be freed, may be NULL
+@return void
+*/
+void symmatrixf_destroy(symmatrixf_t* mat)
+{
+    if(mat == NULL) return;
+    free(mat->block);
+    free(mat);
+}
+
+/*
+returns the stored tile (I,J) of a packed symmetric matrix of floats
+@param mat: the matrix
+@param I: the tile row, I <= J
+@param J: the tile column
+@return float*: the tile*tile row-major block
+*/
+float* symmatrixf_tile(const symmatrixf_t* mat, int I, int J)
+{
+    return mat->data + tile_index(mat->tiles, I, J) * (size_t)mat->tile * (size_t)mat->tile;
+}
+
+/*
+rounds a packed symmetric matrix of doubles to floats
+@param mat: the matrix of doubles
+@return symmatrixf_t*: the matrix of floats, NULL if allocation failed
+*/
+symmatrixf_t* symmatrixf_from_symmatrix(const symmatrix_t* mat)
+{
+    size_t e, count = (size_t)mat->tiles * (size_t)(mat->tiles + 1) / 2 * (size_t)mat->tile * (size_t)mat->tile;
+    symmatrixf_t* single = symmatrixf_create(mat->n);
+    if(single == NULL) return NULL; /* Memory allocation failed */
+
+    for(e=0;e<count;e++)
+    {
+        single->data[e] = (float)mat->data[e];
+    }
+    return single;
+}
+
+/*
+widens a tile of floats to doubles, so the gemm kernels run on it from cache
+@param tile: the tile*tile block of floats
+@param T: the edge of the tile
+@param wide: the tile*tile block of doubles
+@return void
+*/
+static void widen_tile(const float* tile, int T, double* wide)
+{
+    int e;
+    for(e=0;e<T*T;e++)
+    {
+        wide[e] = tile[e];
+    }
+}
+
+/*
+multiplies a packed symmetric matrix of floats by a dense matrix of doubles into a preallocated result matrix
+the products and sums are all in double: every tile is widened into a buffer in cache and handed
+to the gemm kernels as symmatrix_multiplication does, so only half the bytes of W come from memory
+@param W: the symmetric matrix, N*N
+@param H: the dense matrix, N*k
+@param result_matrix: the result matrix, N*k, must not alias H
+@return void
+*/
+void symmatrixf_multiplication(const symmatrixf_t* W, const matrix_t* H, matrix_t* result_matrix)
+{
+    int i,I,J,rows,cols;
+    int T = W->tile;
+    size_t ldh = (size_t)H->stride, ldr = (size_t)result_matrix->stride;
+    double wide[SYMMATRIX_TILE * SYMMATRIX_TILE];
+
+    if(team_size() == 1)
+    {
+        for(i=0;i<result_matrix->rows;i++)
+        {
+            memset(MATRIX_ROW(result_matrix, i), 0, (size_t)result_matrix->stride * sizeof(double));
+        }
+        for(I=0;I<W->tiles;I++)
+        {
+            rows = (W->n - I*T < T) ? W->n - I*T : T;
+            for(J=I;J<W->tiles;J++)
+            {
+                cols = (W->n - J*T < T) ? W->n - J*T : T;
+                widen_tile(symmatrixf_tile(W, I, J), T, wide);
+                gemm_accumulate(rows, H->cols, cols, wide, (size_t)T, 1,
+                                MATRIX_ROW(H, J*T), ldh, MATRIX_ROW(result_matrix, I*T), ldr);
+                if(I != J)
+                {
+                    gemm_accumulate(cols, H->cols, rows, wide, 1, (size_t)T,
+                                    MATRIX_ROW(H, I*T), ldh, MATRIX_ROW(result_matrix, J*T), ldr);
+                }
+            }
+        }
+        return;
+    }
+
+#pragma omp for schedule(dynamic, 1)
+    for(I=0;I<W->tiles;I++)
+    {
+        rows = (W->n - I*T < T) ? W->n - I*T : T;
+        for(i=0;i<rows;i++)
+        {
+            memset(MATRIX_ROW(result_matrix, I*T + i), 0, (size_t)result_matrix->stride * sizeof(double));
+        }
+        for(J=0;J<I;J++)
+        {
+            widen_tile(symmatrixf_tile(W, J, I), T, wide);
+            gemm_accumulate(rows, H->cols, T, wide, 1, (size_t)T,
+                            MATRIX_ROW(H, J*T), ldh, MATRIX_ROW(result_matrix, I*T), ldr);
+        }
+        for(J=I;J<W->tiles;J++)
+        {
+            cols = (W->n - J*T < T) ? W->n - J*T : T;
+            widen_tile(symmatrixf_tile(W, I, J), T, wide);
+            gemm_accumulate(rows, H->cols, cols, wide, (size_t)T, 1,
+                            MATRIX_ROW(H, J*T), ldh, MATRIX_ROW(result_matrix, I*T), ldr);
+        }
+    }
+}
+
+/*
+calculates the row sums of a packed symmetric matrix of floats, summed in double
+every tile row is reduced by one thread in a fixed order, so the sums do not depend on the thread count
+@param W: the symmetric matrix, N*N
+@param sums: the result vector, N long
+@return void
+*/
+void symmatrixf_row_sums(const symmatrixf_t* W, double* sums)
+{
+    int r,c,I,J,rows;
+    int T = W->tile;
+    double acc[SYMMATRIX_TILE];
+    const float* tile;
+
+#pragma omp parallel for schedule(dynamic, 1) private(r, c, J, rows, acc, tile)
+    for(I=0;I<W->tiles;I++)
+    {
+        rows = (W->n - I*T < T) ? W->n - I*T : T;
+        for(c=0;c<T;c++)
+        {
+            acc[c] = 0;
+        }
+        /* tiles above tile row I hold its rows as their columns */
+        for(J=0;J<I;J++)
+        {
+            tile = symmatrixf_tile(W, J, I);
+            for(r=0;r<T;r++)
+            {
+                for(c=0;c<T;c++)
+                {
+                    acc[c] += tile[r*T + c];
+                }
+            }
+        }
+        for(J=I;J<W->tiles;J++)
+        {
+            tile = symmatrixf_tile(W, I, J);
+            for(r=0;r<T;r++)
+            {
+                for(c=0;c<T;c++)
+                {
+                    acc[r] += tile[r*T + c];
+                }
+            }
+        }
+        for(r=0;r<rows;r++)
+        {
+            sums[I*T + r] = acc[r];
+        }
+    }
+}
+
+/*
+allocates a sparse n*n matrix of doubles in CSR format with room for nnz entries
+the row pointers are zeroed, the columns and values are left uninitialized
+@param n: the order of the matrix
+@param nnz: the number of stored entries
+@return csrmatrix_t*: the allocated matrix, NULL if allocation failed
+*/
+csrmatrix_t* csrmatrix_create(int n, size_t nnz)
+{
+    csrmatrix_t* mat;
+
+    if((mat = malloc(sizeof(csrmatrix_t))) == NULL)
+    {
+        printf("An Error Has Occured");
+        return NULL;
+    }
+    mat->n = n;
+    mat->row_ptr = calloc((size_t)n + 1, sizeof(size_t));
+    /* never ask malloc for 0 bytes, an empty graph is still a valid matrix */
+    mat->col_idx = malloc((nnz ? nnz : 1) * sizeof(int));
+    mat->values = malloc((nnz ? nnz : 1) * sizeof(double));
+    if(mat->row_ptr == NULL || mat->col_idx == NULL || mat->values == NULL)
+    {
+        printf("An Error Has Occured");
+        csrmatrix_destroy(mat);
+        return NULL;
+    }
+    return mat;
+}
+
+/*
+frees a matrix created by csrmatrix_create
+@param mat: the matrix to be freed, may be NULL
+@return void
+*/
+void csrmatrix_destroy(csrmatrix_t* mat)
+{
+    if(mat == NULL) return;
+    free(mat->row_ptr);
+    free(mat->col_idx);
+    free(mat->values);
+    free(mat);
+}
+
+/*
+multiplies a sparse matrix by a dense matrix (SpMM) into a preallocated result matrix
+every row of the result is summed by one thread in column order, inside a parallel region the
+rows are shared out between the threads of the team
+@param W: the sparse matrix, N*N
+@param H: the dense matrix, N*k
+@param result_matrix: the result matrix, N*k, must not alias H
+@return void
+*/
+void csrmatrix_multiplication(const csrmatrix_t* W, const matrix_t* H, matrix_t* result_matrix)
+{
+    int i,j;
+    int k = H->cols;
+    size_t p;
+    double value;
+    double* result_row;
+    const double* h_row;
+
+#pragma omp for schedule(dynamic, 64)
+    for(i=0;i<W->n;i++)
+    {
+        result_row = MATRIX_ROW(result_matrix, i);
+        memset(result_row, 0, (size_t)result_matrix->stride * sizeof(double));
+        for(p=W->row_ptr[i];p<W->row_ptr[i+1];p++)
+        {
+            value = W->values[p];
+            h_row = MATRIX_ROW(H, W->col_idx[p]);
+            for(j=0;j<k;j++)
+            {
+                result_row[j] += value * h_row[j];
+            }
+        }
+    }
+}
+
+/*
+calculates the row sums of a sparse matrix, every row is summed in column order
+@param W: the sparse matrix, N*N
+@param sums: the result vector, N long
+@return void
+*/
+void csrmatrix_row_sums(const csrmatrix_t* W, double* sums)
+{
+    int i;
+    size_t p;
+    double sum;
+
+#pragma omp parallel for schedule(dynamic, 256) private(p, sum)
+    for(i=0;i<W->n;i++)
+    {
+        sum = 0;
+        for(p=W->row_ptr[i];p<W->row_ptr[i+1];p++)
+        {
+            sum += W->values[p];
+        }
+        sums[i] = sum;
+    }
+}
+
+/*
+calculates the partial gram matrices H^T*H of consecutive REDUCE_ROWS long blocks of rows of H
+inside a parallel region the blocks are shared out between the threads
+@param H: the matrix, N*k
+@param parts: the k*k partial sums of the blocks, one after the other
+@return void
+*/
+void gram_partials(const matrix_t* H, double* parts)
+{
+    int i,a,b,chunk,end;
+    int k = H->cols;
+    int chunks = (H->rows + REDUCE_ROWS - 1) / REDUCE_ROWS;
+    double* part;
+    const double* row;
+
+#pragma omp for schedule(static)
+    for(chunk=0;chunk<chunks;chunk++)
+    {
+        part = parts + (size_t)chunk * k * k;
+        memset(part, 0, (size_t)k * k * sizeof(double));
+        end = (chunk + 1) * REDUCE_ROWS < H->rows ? (chunk + 1) * REDUCE_ROWS : H->rows;
+        /* stream the block once row by row, accumulating only the upper triangle */
+        for(i=chunk*REDUCE_ROWS;i<end;i++)
+        {
+            row = MATRIX_ROW(H, i);
+            for(a=0;a<k;a++)
+            {
+                for(b=a;b<k;b++)
+                {
+                    part[a*k + b] += row[a] * row[b];
+                }
+            }
+        }
+    }
+}
+
+/*
+sums the partial gram matrices of gram_partials in block order into the k*k gram matrix H^T*H
+@param parts: the k*k partial sums of the blocks
+@param chunks: the number of blocks
+@param gram: the result matrix, k*k
+@return void
+*/
+void gram_reduce(const double* parts, int chunks, matrix_t* gram)
+{
+    int a,b,chunk;
+    int k = gram->cols;
+
+    for(a=0;a<k;a++)
+    {
+        for(b=a;b<k;b++)
+        {
+            MATRIX_AT(gram, a, b) = 0;
+            for(chunk=0;chunk<chunks;chunk++)
+            {
+                MATRIX_AT(gram, a, b) += parts[(size_t)chunk * k * k + a*k + b];
+            }
+            MATRIX_AT(gram, b, a) = MATRIX_AT(gram, a, b);
+        }
+    }
+}
+
+/*
+performs the update step of the symnmf algorithm by using the recursive formula
+the denominator (H*H^T*H) is formed one row at a time as H*(H^T*H), and the squared
+forbius norm of new_H - H and the trace of H^T*W*H are accumulated in the same pass, one
+partial sum per REDUCE_ROWS long block of rows; inside a parallel region the blocks are
+shared out between the threads
+@param new_H: the new H matrix
+@param H: the old H matrix
+@param nom_matrix: the numerator matrix W*H
+@param gram: the gram matrix H^T*H
+@param beta: the step of the update, 1 for the plain multiplicative update
+@param diff_parts: the partial squared norms of the difference between new_H and H, one per block
+@param trace_parts: the partial traces of H^T*W*H, one per block
+@return void
+*/
+void update_new_H(matrix_t* new_H, const matrix_t* H, const matrix_t* nom_matrix, const matrix_t* gram, double beta,
+                  double* diff_parts, double* trace_parts)
+{
+    int i,j,a,chunk,end;
+    int k = H->cols;
+    int chunks = (H->rows + REDUCE_ROWS - 1) / REDUCE_ROWS;
+    double denom, value, diff, sum, trace;
+    const double* h_row;
+
+#pragma omp for schedule(static)
+    for(chunk=0;chunk<chunks;chunk++)
+    {
+        sum = 0;
+        trace = 0;
+        end = (chunk + 1) * REDUCE_ROWS < H->rows ? (chunk + 1) * REDUCE_ROWS : H->rows;
+        for(i=chunk*REDUCE_ROWS;i<end;i++)
+        {
+            h_row = MATRIX_ROW(H, i);
+            for(j=0;j<k;j++)
+            {
+                denom = 0;
+                for(a=0;a<k;a++)
+                {
+                    denom += h_row[a] * MATRIX_AT(gram, a, j);
+                }
+                value = h_row[j] * (1 - beta + beta*(MATRIX_AT(nom_matrix, i, j) / denom));
+                diff = value - h_row[j];
+                sum += diff * diff;
+                trace += h_row[j] * MATRIX_AT(nom_matrix, i, j);
+                MATRIX_AT(new_H, i, j) = value;
+            }
+        }
+        diff_parts[chunk] = sum;
+        trace_parts[chunk] = trace;
+    }
+}
+
+/*
+performs the update step of the accelerated symnmf algorithm, the update of update_new_H taken
+from the extrapolated point Y instead of H
+the squared forbius norm of new_H - H, the trace of Y^T*W*Y and the inner product of the gradient
+at Y with new_H - H, which tells when the momentum overshoots, are accumulated in the same pass,
+one partial sum per REDUCE_ROWS long block of rows
+@param new_H: the new H matrix
+@param H: the old H matrix
+@param Y: the extrapolated matrix the update is taken from
+@param nom_matrix: the numerator matrix W*Y
+@param gram: the gram matrix Y^T*Y
+@param beta: the step of the update
+@param diff_parts: the partial squared norms of the difference between new_H and H, one per block
+@param trace_parts: the partial traces of Y^T*W*Y, one per block
+@param restart_parts: the partial inner products of (Y*Y^T*Y - W*Y) and new_H - H, one per block
+@return void
+*/
+static void accelerated_update(matrix_t* new_H, const matrix_t* H, const matrix_t* Y, const matrix_t* nom_matrix,
+                               const matrix_t* gram, double beta, double* diff_parts, double* trace_parts, double* restart_parts)
+{
+    int i,j,a,chunk,end;
+    int k = H->cols;
+    int chunks = (H->rows + REDUCE_ROWS - 1) / REDUCE_ROWS;
+    double denom, nom, value, diff, sum, trace, restart;
+    const double* y_row;
+
+#pragma omp for schedule(static)
+    for(chunk=0;chunk<chunks;chunk++)
+    {
+        sum = 0;
+        trace = 0;
+        restart = 0;
+        end = (chunk + 1) * REDUCE_ROWS < H->rows ? (chunk + 1) * REDUCE_ROWS : H->rows;
+        for(i=chunk*REDUCE_ROWS;i<end;i++)
+        {
+            y_row = MATRIX_ROW(Y, i);
+            for(j=0;j<k;j++)
+            {
+                denom = 0;
+                for(a=0;a<k;a++)
+                {
+                    denom += y_row[a] * MATRIX_AT(gram, a, j);
+                }
+                nom = MATRIX_AT(nom_matrix, i, j);
+                value = y_row[j] * (1 - beta + beta*(nom / denom));
+                diff = value - MATRIX_AT(H, i, j);
+                sum += diff * diff;
+                trace += y_row[j] * nom;
+                restart += (denom - nom) * diff;
+                MATRIX_AT(new_H, i, j) = value;
+            }
+        }
+        diff_parts[chunk] = sum;
+        trace_parts[chunk] = trace;
+        restart_parts[chunk] = restart;
+    }
+}
+
+/*
+extrapolates Y = H + momentum*(H - old_H), kept at least EXTRAPOLATION_FLOOR so no entry
+is stuck at zero under the multiplicative update
+inside a parallel region the rows are shared out between the threads
+@param Y: the result matrix
+@param H: the current H matrix
+@param old_H: the previous H matrix
+@param momentum: the weight of the step
+@return void
+*/
+static void extrapolate(matrix_t* Y, const matrix_t* H, const matrix_t* old_H, double momentum)
+{
+    int i,j;
+    double value;
+
+#pragma omp for schedule(static)
+    for(i=0;i<H->rows;i++)
+    {
+        for(j=0;j<H->cols;j++)
+        {
+            value = MATRIX_AT(H, i, j) + momentum * (MATRIX_AT(H, i, j) - MATRIX_AT(old_H, i, j));
+            MATRIX_AT(Y, i, j) = value > EXTRAPOLATION_FLOOR ? value : EXTRAPOLATION_FLOOR;
+        }
+    }
+}
+
+/*
+performs one half of an iteration of the HALS symnmf algorithm, which minimizes
+||W - H*X^T||^2 + alpha*||H - X||^2 over H for the fixed copy X one column at a time
+the columns of a row only depend on the earlier columns of the same row, so the rows are
+updated in place independently; the squared forbius norm of the update and the trace of
+X^T*W*X are accumulated in the same pass, one partial sum per REDUCE_ROWS long block of rows
+@param H: the matrix updated in place
+@param X: the fixed copy
+@param nom_matrix: the matrix W*X
+@param gram: the gram matrix X^T*X
+@param alpha: the weight of the coupling of H and X
+@param diff_parts: the partial squared norms of the update, one per block, or NULL
+@param trace_parts: the partial traces of X^T*W*X, one per block, or NULL
+@return void
+*/
+static void hals_update(matrix_t* H, const matrix_t* X, const matrix_t* nom_matrix, const matrix_t* gram, double alpha,
+                        double* diff_parts, double* trace_parts)
+{
+    int i,j,a,chunk,end;
+    int k = H->cols;
+    int chunks = (H->rows + REDUCE_ROWS - 1) / REDUCE_ROWS;
+    double num, value, diff, sum, trace;
+    double* h_row;
+
+#pragma omp for schedule(static)
+    for(chunk=0;chunk<chunks;chunk++)
+    {
+        sum = 0;
+        trace = 0;
+        end = (chunk + 1) * REDUCE_ROWS < H->rows ? (chunk + 1) * REDUCE_ROWS : H->rows;
+        for(i=chunk*REDUCE_ROWS;i<end;i++)
+        {
+            h_row = MATRIX_ROW(H, i);
+            for(j=0;j<k;j++)
+            {
+                num = MATRIX_AT(nom_matrix, i, j) + alpha * MATRIX_AT(X, i, j);
+                for(a=0;a<k;a++)
+                {
+                    if(a != j) num -= h_row[a] * MATRIX_AT(gram, a, j);
+                }
+                value = num / (MATRIX_AT(gram, j, j) + alpha);
+                if(value < 0) value = 0;
+                diff = value - h_row[j];
+                sum += diff * diff;
+                trace += MATRIX_AT(X, i, j) * MATRIX_AT(nom_matrix, i, j);
+                h_row[j] = value;
+            }
+        }
+        if(diff_parts != NULL) diff_parts[chunk] = sum;
+        if(trace_parts != NULL) trace_parts[chunk] = trace;
+    }
+}
+
+/*
+calculates the euclidean distance between two vectors of doubles
+@param vec1: the first vector
+@param vec2: the second vector
+@param vecdim: the number of dimensions
+@param is_squared: a flag to determine if the squared distance should be returned
+@return double: the euclidean distance
+*/
+double euclidean_distance(const double* vec1, const double* vec2, int vecdim, int is_squared)
+{
+    int i;
+    double sum = 0;
+    for (i=0;i<vecdim;i++)
+    {
+        sum += pow(vec1[i] - vec2[i], 2);
+    }
+    return (is_squared==0) ? sqrt(sum) : sum;
+}
+
+/*
+gathers vectors into the columns of a matrix, the right operand of the gemm of gaussian_block,
+and calculates their squared norms
+@param vectors: the matrix of vectors, one vector per row
+@param order: the indices of the vectors to gather, NULL for all of them in order
+@param count: the number of vectors to gather
+@param norms: the count squared norms, in the order of the columns
+@return matrix_t*: the d*count matrix of the gathered vectors, NULL if allocation failed
+*/
+static matrix_t* transpose_vectors(const matrix_t* vectors, const int* order, int count, double* norms)
+{
+    int a,p;
+    double sum;
+    const double* row;
+    matrix_t* transposed;
+
+    if(simd_level < 0) simd_select(-1); /* before the kernels run in parallel */
+    if((transposed = matrix_create(vectors->cols, count)) == NULL) return NULL; /* Memory allocation failed */
+    for(a=0;a<count;a++)
+    {
+        row = MATRIX_ROW(vectors, (order == NULL) ? a : order[a]);
+        sum = 0;
+        for(p=0;p<vectors->cols;p++)
+        {
+            MATRIX_AT(transposed, p, a) = row[p];
+            sum += row[p] * row[p];
+        }
+        norms[a] = sum;
+    }
+    return transposed;
+}
+
+/*
+calculates a block of squared euclidean distances ||x_i - y_j||^2 of consecutive vectors x_i against
+the columns y_j of a transposed matrix
+the distances are ||x_i||^2 + ||y_j||^2 - 2*x_i^T*y_j, with the inner products from the blocked gemm,
+cut at zero where round-off makes them negative
+@param vectors: the matrix of vectors, one vector per row
+@param row_norms: the squared norms of the rows of the block, rows long
+@param first: the index of the vector of the first row of the block
+@param rows: the number of rows of the block
+@param columns: the first column of the block in a matrix from transpose_vectors, ldt doubles between rows
+@param column_norms: the squared norms of the columns of the block, cols long
+@param cols: the number of columns of the block
+@param block: the result block, ldb doubles between rows, its row padding zeroed
+@return void
+*/
+static void distance_block(const matrix_t* vectors, const double* row_norms, int first, int rows,
+                           const double* columns, size_t ldt, const double* column_norms, int cols,
+                           double* block, size_t ldb)
+{
+    int r,c;
+    double value;
+    double* row;
+
+    for(r=0;r<rows;r++)
+    {
+        memset(block + r*ldb, 0, ldb * sizeof(double));
+    }
+    gemm_accumulate(rows, cols, vectors->cols, MATRIX_ROW(vectors, first), (size_t)vectors->stride, 1,
+                    columns, ldt, block, ldb);
+    for(r=0;r<rows;r++)
+    {
+        row = block + r*ldb;
+        for(c=0;c<cols;c++)
+        {
+            value = row_norms[r] + column_norms[c] - 2*row[c];
+            row[c] = value > 0 ? value : 0;
+        }
+    }
+}
+
+/*
+calculates a block of gaussian affinities exp(-||x_i - y_j||^2/2) of consecutive vectors x_i against
+the columns y_j of a transposed matrix, the exponentials of the distance_block taken a whole row at a
+time by exp_batch while the block is still in cache
+@param vectors: the matrix of vectors, one vector per row
+@param row_norms: the squared norms of the rows of the block, rows long
+@param first: the index of the vector of the first row of the block
+@param rows: the number of rows of the block
+@param columns: the first column of the block in a matrix from transpose_vectors, ldt doubles between rows
+@param column_norms: the squared norms of the columns of the block, cols long
+@param cols: the number of columns of the block
+@param block: the result block, ldb doubles between rows, its row padding zeroed
+@return void
+*/
+static void gaussian_block(const matrix_t* vectors, const double* row_norms, int first, int rows,
+                           const double* columns, size_t ldt, const double* column_norms, int cols,
+                           double* block, size_t ldb)
+{
+    int r,c;
+    double* row;
+
+    distance_block(vectors, row_norms, first, rows, columns, ldt, column_norms, cols, block, ldb);
+    for(r=0;r<rows;r++)
+    {
+        row = block + r*ldb;
+        for(c=0;c<cols;c++)
+        {
+            row[c] = -row[c]/2;
+        }
+        exp_batch(row, cols);
+    }
+}
+
+/*
+calculates the symilarity tile (I,J), I <= J, of a packed matrix
+the tile is one gaussian_block, a diagonal tile is mirrored from above the diagonal so the
+matrix stays exactly symmetric
+@param vectors: the matrix of vectors, one vector per row
+@param transposed: the vectors from transpose_vectors
+@param norms: the squared norms of the vectors
+@param I: the tile row
+@param J: the tile column
+@param T: the edge of the tiles
+@param tile: the result tile, T*T row-major, its padding zeroed
+@return void
+*/
+static void affinity_tile(const matrix_t* vectors, const matrix_t* transposed, const double* norms,
+                          int I, int J, int T, double* tile)
+{
+    int r,c;
+    int N = vectors->rows;
+    int rows = (N - I*T < T) ? N - I*T : T;
+    int cols = (N - J*T < T) ? N - J*T : T;
+
+    gaussian_block(vectors, norms + I*T, I*T, rows, transposed->data + J*T, (size_t)transposed->stride,
+                   norms + J*T, cols, tile, (size_t)T);
+    for(r=rows;r<T;r++)
+    {
+        memset(tile + r*T, 0, (size_t)T * sizeof(double));
+    }
+    if(I == J)
+    {
+        for(r=0;r<rows;r++)
+        {
+            tile[r*T + r] = 0;
+            for(c=r+1;c<cols;c++)
+            {
+                tile[c*T + r] = tile[r*T + c];
+            }
+        }
+    }
+}
+
+/*
+calculates the symilarity tiles first to last-1, in storage order, of a packed matrix
+the stored tiles are handed out to the threads one at a time, so the short diagonal tiles
+and the long tile rows at the top of the triangle balance out
+@param sym_matrix: the packed matrix, N*N
+@param vectors: the matrix of vectors, one vector per row
+@param transposed: the vectors from transpose_vectors
+@param norms: the squared norms of the vectors
+@param first: the index of the first tile
+@param last: one past the index of the last tile
+@return void
+*/
+static void affinity_tiles(symmatrix_t* sym_matrix, const matrix_t* vectors, const matrix_t* transposed,
+                           const double* norms, long first, long last)
+{
+    int I,J;
+    long t;
+
+#pragma omp parallel for schedule(dynamic, 1) private(I, J)
+    for(t=first;t<last;t++)
+    {
+        symmatrix_tile_coords(sym_matrix, (size_t)t, &I, &J);
+        affinity_tile(vectors, transposed, norms, I, J, sym_matrix->tile, symmatrix_tile(sym_matrix, I, J));
+    }
+}
+
+/*
+calculates the symilarity matrix of a matrix of doubles tile by tile
+@param vectors: the matrix of vectors, one vector per row
+@return symmatrix_t*: the symilarity matrix
+*/
+static symmatrix_t* build_affinity(const matrix_t* vectors)
+{
+    double* norms;
+    matrix_t* transposed = NULL;
+    symmatrix_t* sym_matrix = NULL;
+
+    if((norms = malloc((size_t)vectors->rows * sizeof(double))) == NULL) /* Memory allocation failed */
+    {
+        printf("An Error Has Occured");
+        return NULL;
+    }
+    if((transposed = transpose_vectors(vectors, NULL, vectors->rows, norms)) != NULL &&
+       (sym_matrix = symmatrix_create(vectors->rows)) != NULL)
+    {
+        affinity_tiles(sym_matrix, vectors, transposed, norms, 0, (long)sym_matrix->tiles * (sym_matrix->tiles + 1) / 2);
+    }
+    matrix_destroy(transposed);
+    free(norms);
+    return sym_matrix;
+}
+
+/*
+calculates the symilarity matrix of a matrix of doubles
+@param vectors: the matrix of vectors, one vector per row
+@return symmatrix_t*: the symilarity matrix
+*/
+symmatrix_t* calc_sym(const matrix_t* vectors)
+{
+    return build_affinity(vectors);
+}
+
+/*
+calculates the diagonal of the ddg matrix of a matrix of doubles
+@param vectors: the matrix of vectors, one vector per row
+@return double*: the N degrees on the diagonal of the ddg matrix
+*/
+double* calc_ddg(const matrix_t* vectors)
+{
+    symmatrix_t* sym_matrix;
+    double* ddg_vector;
+
+    if ((ddg_vector = malloc((size_t)vectors->rows * sizeof(double))) == NULL) /* Memory allocation failed */
+    {
+        printf("An Error Has Occured");
+        return NULL;
+    }
+    if((sym_matrix = build_affinity(vectors)) == NULL) /* Memory allocation failed */
+    {
+        free(ddg_vector);
+        return NULL;
+    }
+
+    symmatrix_row_sums(sym_matrix, ddg_vector);
+
+    symmatrix_destroy(sym_matrix);
+    return ddg_vector;
+}
+
+/*
+scales the tiles first to last-1, in storage order, of a packed symmetric matrix from both sides by a diagonal
+@param mat: the matrix, its tiles become S * mat * S
+@param scales: the N entries on the diagonal of S
+@param first: the index of the first tile
+@param last: one past the index of the last tile
+@return void
+*/
+static void scale_tiles(symmatrix_t* mat, const double* scales, long first, long last)
+{
+    int r,c,I,J,rows,cols;
+    int T = mat->tile;
+    long t;
+    double scale;
+    double* tile;
+
+#pragma omp parallel for schedule(static) private(r, c, I, J, rows, cols, scale, tile)
+    for(t=first;t<last;t++)
+    {
+        symmatrix_tile_coords(mat, (size_t)t, &I, &J);
+        rows = (mat->n - I*T < T) ? mat->n - I*T : T;
+        cols = (mat->n - J*T < T) ? mat->n - J*T : T;
+        tile = symmatrix_tile(mat, I, J);
+        for(r=0;r<rows;r++)
+        {
+            scale = scales[I*T + r];
+            for(c=0;c<cols;c++)
+            {
+                tile[r*T + c] *= scale * scales[J*T + c];
+            }
+        }
+    }
+}
+
+/*
+scales a packed symmetric matrix in place from both sides by D^-1/2, where D is diagonal
+@param mat: the matrix, becomes D^-1/2 * mat * D^-1/2
+@param degrees: the N entries on the diagonal of D, overwritten with their inverse square roots
+@return void
+*/
+static void normalize_affinity(symmatrix_t* mat, double* degrees)
+{
+    int i;
+
+    for(i=0;i<mat->n;i++)
+    {
+        degrees[i] = 1 / sqrt(degrees[i]);
+    }
+    scale_tiles(mat, degrees, 0, (long)mat->tiles * (mat->tiles + 1) / 2);
+}
+
+/*
+calculates the norm matrix of a matrix of doubles
+sym is built into a single packed buffer, reduced to its degrees and then scaled in place
+@param vectors: the matrix of vectors, one vector per row
+@return symmatrix_t*: the norm matrix
+*/
+symmatrix_t* calc_norm(const matrix_t* vectors)
+{
+    double* ddg_vector;
+    symmatrix_t* norm_matrix;
+
+    if ((ddg_vector = malloc((size_t)vectors->rows * sizeof(double))) == NULL) /* Memory allocation failed */
+    {
+        printf("An Error Has Occured");
+        return NULL;
+    }
+    if((norm_matrix = build_affinity(vectors)) == NULL) /* Memory allocation failed */
+    {
+        free(ddg_vector);
+        return NULL;
+    }
+
+    symmatrix_row_sums(norm_matrix, ddg_vector);
+    normalize_affinity(norm_matrix, ddg_vector);
+
+    free(ddg_vector);
+    return norm_matrix;
+}
+
+/*
+calculates the norm matrix of a matrix of doubles straight into floats
+the same W as rounding calc_norm, so the N*N doubles are never allocated: every stored tile is calculated once
+for the degrees, its row sums running along its tile row and the column sums of the tiles above the diagonal
+kept per tile and added in tile order, as symmatrix_row_sums does; the tiles are then calculated again,
+scaled as normalize_affinity and rounded once, so each affinity tile is taken twice instead of once
+@param vectors: the matrix of vectors, one vector per row
+@return symmatrixf_t*: the norm matrix of floats, NULL if allocation failed
+*/
+symmatrixf_t* calc_norm_f32(const matrix_t* vectors)
+{
+    int r,c,I,J,rows,cols;
+    int N = vectors->rows;
+    int T;
+    long t, stored;
+    double wide[SYMMATRIX_TILE * SYMMATRIX_TILE];
+    double acc[SYMMATRIX_TILE];
+    double scale;
+    double* norms;
+    double* degrees;
+    double* column_sums;
+    double* part;
+    float* tile;
+    matrix_t* transposed;
+    symmatrixf_t* norm_matrix;
+
+    if((norms = malloc(2 * (size_t)N * sizeof(double))) == NULL) /* Memory allocation failed */
+    {
+        printf("An Error Has Occured");
+        return NULL;
+    }
+    degrees = norms + N;
+    if((transposed = transpose_vectors(vectors, NULL, N, norms)) == NULL) /* Memory allocation failed */
+    {
+        free(norms);
+        return NULL;
+    }
+    if((norm_matrix = symmatrixf_create(N)) == NULL) /* Memory allocation failed */
+    {
+        matrix_destroy(transposed);
+        free(norms);
+        return NULL;
+    }
+    T = norm_matrix->tile;
+    stored = (long)norm_matrix->tiles * (norm_matrix->tiles + 1) / 2;
+    /* T column sums per stored tile, at the storage index of the tile, N*N/(2*T) doubles in all */
+    if((column_sums = malloc((size_t)stored * (size_t)T * sizeof(double))) == NULL) /* Memory allocation failed */
+    {
+        printf("An Error Has Occured");
+        symmatrixf_destroy(norm_matrix);
+        matrix_destroy(transposed);
+        free(norms);
+        return NULL;
+    }
+
+    /* every stored tile once, by the thread of its tile row: its row sums and, above the diagonal, its column sums */
+#pragma omp parallel for schedule(dynamic, 1) private(r, c, J, rows, wide, acc, part)
+    for(I=0;I<norm_matrix->tiles;I++)
+    {
+        rows = (N - I*T < T) ? N - I*T : T;
+        for(c=0;c<T;c++)
+        {
+            acc[c] = 0;
+        }
+        for(J=I;J<norm_matrix->tiles;J++)
+        {
+            affinity_tile(vectors, transposed, norms, I, J, T, wide);
+            for(r=0;r<T;r++)
+            {
+                for(c=0;c<T;c++)
+                {
+                    acc[r] += wide[r*T + c];
+                }
+            }
+            if(J == I) continue;
+            part = column_sums + tile_index(norm_matrix->tiles, I, J) * (size_t)T;
+            for(c=0;c<T;c++)
+            {
+                part[c] = 0;
+            }
+            for(r=0;r<T;r++)
+            {
+                for(c=0;c<T;c++)
+                {
+                    part[c] += wide[r*T + c];
+                }
+            }
+        }
+        for(r=0;r<rows;r++)
+        {
+            degrees[I*T + r] = acc[r];
+        }
+    }
+    /* the column sums of the tiles above every tile row, in tile order */
+#pragma omp parallel for schedule(static) private(r, c, J, rows, acc)
+    for(I=0;I<norm_matrix->tiles;I++)
+    {
+        rows = (N - I*T < T) ? N - I*T : T;
+        for(c=0;c<T;c++)
+        {
+            acc[c] = 0;
+        }
+        for(J=0;J<I;J++)
+        {
+            for(c=0;c<T;c++)
+            {
+                acc[c] += column_sums[tile_index(norm_matrix->tiles, J, I) * (size_t)T + (size_t)c];
+            }
+        }
+        for(r=0;r<rows;r++)
+        {
+            degrees[I*T + r] = 1 / sqrt(acc[r] + degrees[I*T + r]);
+        }
+    }
+    free(column_sums);
+
+    /* the affinities again, scaled by D^-1/2 from both sides as scale_tiles and only then rounded */
+#pragma omp parallel for schedule(dynamic, 1) private(r, c, I, J, rows, cols, scale, tile, wide)
+    for(t=0;t<stored;t++)
+    {
+        tile_coords(norm_matrix->tiles, (size_t)t, &I, &J);
+        rows = (N - I*T < T) ? N - I*T : T;
+        cols = (N - J*T < T) ? N - J*T : T;
+        tile = symmatrixf_tile(norm_matrix, I, J);
+        affinity_tile(vectors, transposed, norms, I, J, T, wide);
+        for(r=0;r<rows;r++)
+        {
+            scale = degrees[I*T + r];
+            for(c=0;c<cols;c++)
+            {
+                wide[r*T + c] *= scale * degrees[J*T + c];
+                tile[r*T + c] = (float)wide[r*T + c];
+            }
+        }
+    }
+
+    matrix_destroy(transposed);
+    free(norms);
+    return norm_matrix;
+}
+
+/* one neighbour of a point, its squared distance while searching and its affinity afterwards */
+typedef struct neighbour_t
+{
+    int col;
+    double value;
+} neighbour_t;
+
+/*
+orders two neighbours by their column, used to sort the rows of a sparse matrix
+@param a: the first neighbour
+@param b: the second neighbour
+@return int: negative, zero or positive as a comes before, with or after b
+*/
+static int neighbour_compare_col(const void* a, const void* b)
+{
+    int col_a = ((const neighbour_t*)a)->col;
+    int col_b = ((const neighbour_t*)b)->col;
+    return (col_a > col_b) - (col_a < col_b);
+}
+
+/*
+checks if a neighbour is farther than another, equal distances are broken by the column
+so the nearest neighbours of a point are always the same set
+@param a: the first neighbour
+@param b: the second neighbour
+@return int: 1 if a is farther than b, 0 otherwise
+*/
+static int neighbour_farther(const neighbour_t* a, const neighbour_t* b)
+{
+    return a->value > b->value || (a->value == b->value && a->col > b->col);
+}
+
+/*
+finds the knn nearest neighbours of one point by a full scan kept in a max-heap of size knn
+@param vectors: the matrix of vectors, one vector per row
+@param i: the point
+@param knn: the number of neighbours, less than the number of points
+@param heap: the knn neighbours are written here, sorted by column, with their affinities
+@return void
+*/
+static void knn_search(const matrix_t* vectors, int i, int knn, neighbour_t* heap)
+{
+    int j,p,child,size = 0;
+    neighbour_t candidate, swap;
+
+    for(j=0;j<vectors->rows;j++)
+    {
+        if(j == i) continue;
+        candidate.col = j;
+        candidate.value = euclidean_distance(MATRIX_ROW(vectors, i), MATRIX_ROW(vectors, j), vectors->cols, 1);
+        if(size < knn)
+        {
+            /* sift the new neighbour up from the bottom of the heap */
+            p = size++;
+            heap[p] = candidate;
+            while(p > 0 && neighbour_farther(&heap[p], &heap[(p-1)/2]))
+            {
+                swap = heap[p];
+                heap[p] = heap[(p-1)/2];
+                heap[(p-1)/2] = swap;
+                p = (p-1)/2;
+            }
+        }
+        else if(neighbour_farther(&heap[0], &candidate))
+        {
+            /* replace the farthest neighbour and sift it down */
+            heap[0] = candidate;
+            p = 0;
+            while((child = 2*p + 1) < size)
+            {
+                if(child + 1 < size && neighbour_farther(&heap[child+1], &heap[child])) child++;
+                if(!neighbour_farther(&heap[child], &heap[p])) break;
+                swap = heap[p];
+                heap[p] = heap[child];
+                heap[child] = swap;
+                p = child;
+            }
+        }
+    }
+    for(p=0;p<size;p++)
+    {
+        heap[p].value = exp(-heap[p].value/2);
+    }
+    qsort(heap, (size_t)size, sizeof(neighbour_t), neighbour_compare_col);
+}
+
+/*
+calculates the sparse symilarity matrix of the k nearest neighbour graph of a matrix of doubles
+an entry is kept if either of its points is one of the knn nearest neighbours of the other, so the
+matrix stays symmetric; the affinity of a pair is the same from both sides so merging is exact
+@param vectors: the matrix of vectors, one vector per row
+@param knn: the number of neighbours of every point
+@return csrmatrix_t*: the sparse symilarity matrix, NULL if allocation failed
+*/
+static csrmatrix_t* build_knn_affinity(const matrix_t* vectors, int knn)
+{
+    int i,col;
+    int N = vectors->rows;
+    size_t p,q,kept;
+    size_t* start;
+    size_t* fill;
+    neighbour_t* neighbours;
+    neighbour_t* edges;
+    neighbour_t* row;
+    csrmatrix_t* sym_matrix = NULL;
+
+    if(knn > N - 1) knn = N - 1;
+    if(knn < 0) knn = 0;
+    neighbours = malloc(((size_t)N * knn + 1) * sizeof(neighbour_t));
+    edges = malloc((2 * (size_t)N * knn + 1) * sizeof(neighbour_t));
+    start = calloc((size_t)N + 1, sizeof(size_t));
+    fill = malloc(((size_t)N + 1) * sizeof(size_t));
+    if(neighbours == NULL || edges == NULL || start == NULL || fill == NULL)
+    {
+        printf("An Error Has Occured");
+        free(neighbours);
+        free(edges);
+        free(start);
+        free(fill);
+        return NULL;
+    }
+
+#pragma omp parallel for schedule(dynamic, 16)
+    for(i=0;i<N;i++)
+    {
+        knn_search(vectors, i, knn, neighbours + (size_t)i * knn);
+    }
+
+    /* lay the directed edges and their reverses out row by row */
+    for(i=0;i<N;i++)
+    {
+        for(p=(size_t)i*knn;p<(size_t)(i+1)*knn;p++)
+        {
+            start[i+1]++;
+            start[neighbours[p].col + 1]++;
+        }
+    }
+    for(i=0;i<N;i++)
+    {
+        start[i+1] += start[i];
+        fill[i] = start[i];
+    }
+    for(i=0;i<N;i++)
+    {
+        for(p=(size_t)i*knn;p<(size_t)(i+1)*knn;p++)
+        {
+            col = neighbours[p].col;
+            edges[fill[i]++] = neighbours[p];
+            edges[fill[col]].col = i;
+            edges[fill[col]++].value = neighbours[p].value;
+        }
+    }
+
+    /* sort every row by column and drop the pairs found from both sides */
+#pragma omp parallel for schedule(dynamic, 256) private(p, q, kept, row)
+    for(i=0;i<N;i++)
+    {
+        row = edges + start[i];
+        kept = 0;
+        qsort(row, start[i+1] - start[i], sizeof(neighbour_t), neighbour_compare_col);
+        for(q=0;q<start[i+1]-start[i];q++)
+        {
+            if(kept == 0 || row[kept-1].col != row[q].col) row[kept++] = row[q];
+        }
+        fill[i] = kept;
+    }
+
+    kept = 0;
+    for(i=0;i<N;i++)
+    {
+        kept += fill[i];
+    }
+    if((sym_matrix = csrmatrix_create(N, kept)) != NULL)
+    {
+        for(i=0;i<N;i++)
+        {
+            sym_matrix->row_ptr[i+1] = sym_matrix->row_ptr[i] + fill[i];
+            for(q=0;q<fill[i];q++)
+            {
+                sym_matrix->col_idx[sym_matrix->row_ptr[i] + q] = edges[start[i] + q].col;
+                sym_matrix->values[sym_matrix->row_ptr[i] + q] = edges[start[i] + q].value;
+            }
+        }
+    }
+
+    free(neighbours);
+    free(edges);
+    free(start);
+    free(fill);
+    return sym_matrix;
+}
+
+/*
+calculates the sparse symilarity matrix keeping only the affinities of at least epsilon
+the graph is scanned twice, once to size the rows and once to fill them, so no more than
+the kept entries are ever held in memory
+@param vectors: the matrix of vectors, one vector per row
+@param epsilon: the smallest affinity kept
+@return csrmatrix_t*: the sparse symilarity matrix, NULL if allocation failed
+*/
+static csrmatrix_t* build_epsilon_affinity(const matrix_t* vectors, double epsilon)
+{
+    int i,j,pass;
+    int N = vectors->rows;
+    size_t p;
+    size_t* counts;
+    double value;
+    csrmatrix_t* sym_matrix = NULL;
+
+    if((counts = calloc((size_t)N + 1, sizeof(size_t))) == NULL)
+    {
+        printf("An Error Has Occured");
+        return NULL;
+    }
+
+    for(pass=0;pass<2;pass++)
+    {
+#pragma omp parallel for schedule(dynamic, 16) private(j, p, value)
+        for(i=0;i<N;i++)
+        {
+            p = (pass == 0) ? 0 : sym_matrix->row_ptr[i];
+            for(j=0;j<N;j++)
+            {
+                if(j == i) continue;
+                value = exp(-euclidean_distance(MATRIX_ROW(vectors, i), MATRIX_ROW(vectors, j), vectors->cols, 1)/2);
+                if(value < epsilon) continue;
+                if(pass == 1)
+                {
+                    sym_matrix->col_idx[p] = j;
+                    sym_matrix->values[p] = value;
+                }
+                p++;
+            }
+            if(pass == 0) counts[i+1] = p;
+        }
+        if(pass == 0)
+        {
+            for(i=0;i<N;i++)
+            {
+                counts[i+1] += counts[i];
+            }
+            if((sym_matrix = csrmatrix_create(N, counts[N])) == NULL) break; /* Memory allocation failed */
+            memcpy(sym_matrix->row_ptr, counts, ((size_t)N + 1) * sizeof(size_t));
+        }
+    }
+    free(counts);
+    return sym_matrix;
+}
+
+/*
+calculates the sparse symilarity matrix of a matrix of doubles
+memory grows with the number of kept entries instead of N*N, the neighbour search still
+compares every pair of points
+@param vectors: the matrix of vectors, one vector per row
+@param knn: if positive, the number of nearest neighbours kept for every point
+@param epsilon: if knn is not positive, the smallest affinity kept
+@return csrmatrix_t*: the sparse symilarity matrix, NULL if allocation failed
+*/
+csrmatrix_t* calc_sparse_sym(const matrix_t* vectors, int knn, double epsilon)
+{
+    return (knn > 0) ? build_knn_affinity(vectors, knn) : build_epsilon_affinity(vectors, epsilon);
+}
+
+/*
+calculates the degrees of the sparse symilarity matrix of a matrix of doubles
+@param vectors: the matrix of vectors, one vector per row
+@param knn: if positive, the number of nearest neighbours kept for every point
+@param epsilon: if knn is not positive, the smallest affinity kept
+@return double*: the N degrees on the diagonal of the ddg matrix
+*/
+double* calc_sparse_ddg(const matrix_t* vectors, int knn, double epsilon)
+{
+    csrmatrix_t* sym_matrix;
+    double* ddg_vector;
+
+    if ((ddg_vector = malloc((size_t)vectors->rows * sizeof(double))) == NULL) /* Memory allocation failed */
+    {
+        printf("An Error Has Occured");
+        return NULL;
+    }
+    if((sym_matrix = calc_sparse_sym(vectors, knn, epsilon)) == NULL) /* Memory allocation failed */
+    {
+        free(ddg_vector);
+        return NULL;
+    }
+
+    csrmatrix_row_sums(sym_matrix, ddg_vector);
+
+    csrmatrix_destroy(sym_matrix);
+    return ddg_vector;
+}
+
+/*
+calculates the sparse norm matrix of a matrix of doubles
+a point without kept neighbours has an empty row and column, so its zero degree is never used
+@param vectors: the matrix of vectors, one vector per row
+@param knn: if positive, the number of nearest neighbours kept for every point
+@param epsilon: if knn is not positive, the smallest affinity kept
+@return csrmatrix_t*: the sparse norm matrix
+*/
+csrmatrix_t* calc_sparse_norm(const matrix_t* vectors, int knn, double epsilon)
+{
+    int i;
+    size_t p;
+    double* ddg_vector;
+    csrmatrix_t* norm_matrix;
+
+    if ((ddg_vector = malloc((size_t)vectors->rows * sizeof(double))) == NULL) /* Memory allocation failed */
+    {
+        printf("An Error Has Occured");
+        return NULL;
+    }
+    if((norm_matrix = calc_sparse_sym(vectors, knn, epsilon)) == NULL) /* Memory allocation failed */
+    {
+        free(ddg_vector);
+        return NULL;
+    }
+
+    csrmatrix_row_sums(norm_matrix, ddg_vector);
+    for(i=0;i<norm_matrix->n;i++)
+    {
+        ddg_vector[i] = 1 / sqrt(ddg_vector[i]);
+    }
+#pragma omp parallel for schedule(dynamic, 256) private(p)
+    for(i=0;i<norm_matrix->n;i++)
+    {
+        for(p=norm_matrix->row_ptr[i];p<norm_matrix->row_ptr[i+1];p++)
+        {
+            norm_matrix->values[p] *= ddg_vector[i] * ddg_vector[norm_matrix->col_idx[p]];
+        }
+    }
+
+    free(ddg_vector);
+    return norm_matrix;
+}
+
+/*
+calculates the squared frobenius norm of a packed symmetric matrix
+the tiles off the diagonal stand for two tiles of the full matrix, the hanging over parts are zero
+@param W: the symmetric matrix, N*N
+@return double: the sum of the squares of all N*N entries
+*/
+static double symmatrix_squared_norm(const symmatrix_t* W)
+{
+    int I,J,e;
+    int T = W->tile;
+    double sum = 0, tile_sum;
+    const double* tile;
+
+    for(I=0;I<W->tiles;I++)
+    {
+        for(J=I;J<W->tiles;J++)
+        {
+            tile = symmatrix_tile(W, I, J);
+            tile_sum = 0;
+            for(e=0;e<T*T;e++)
+            {
+                tile_sum += tile[e] * tile[e];
+            }
+            sum += (I == J) ? tile_sum : 2 * tile_sum;
+        }
+    }
+    return sum;
+}
+
+/*
+calculates the squared frobenius norm of a packed symmetric matrix of floats, summed in double
+@param W: the symmetric matrix, N*N
+@return double: the sum of the squares of its entries
+*/
+static double symmatrixf_squared_norm(const symmatrixf_t* W)
+{
+    int I,J,e;
+    int T = W->tile;
+    double sum = 0, tile_sum;
+    const float* tile;
+
+    for(I=0;I<W->tiles;I++)
+    {
+        for(J=I;J<W->tiles;J++)
+        {
+            tile = symmatrixf_tile(W, I, J);
+            tile_sum = 0;
+            for(e=0;e<T*T;e++)
+            {
+                tile_sum += (double)tile[e] * tile[e];
+            }
+            sum += (I == J) ? tile_sum : 2 * tile_sum;
+        }
+    }
+    return sum;
+}
+
+/*
+calculates the squared frobenius norm of a sparse matrix
+@param W: the sparse matrix, N*N
+@return double: the sum of the squares of its entries
+*/
+static double csrmatrix_squared_norm(const csrmatrix_t* W)
+{
+    size_t p;
+    double sum = 0;
+
+    for(p=0;p<W->row_ptr[W->n];p++)
+    {
+        sum += W->values[p] * W->values[p];
+    }
+    return sum;
+}
+
+/*
+calculates the squared frobenius norm of a dense matrix
+@param mat: the matrix
+@return double: the sum of the squares of its entries
+*/
+static double matrix_squared_norm(const matrix_t* mat)
+{
+    int i,j;
+    double sum = 0;
+
+    for(i=0;i<mat->rows;i++)
+    {
+        for(j=0;j<mat->cols;j++)
+        {
+            sum += MATRIX_AT(mat, i, j) * MATRIX_AT(mat, i, j);
+        }
+    }
+    return sum;
+}
+
+/*
+returns a wall clock timestamp in seconds
+@return double: the current time
+*/
+static double wall_time(void)
+{
+#ifdef _OPENMP
+    return omp_get_wtime();
+#else
+    return (double)clock() / CLOCKS_PER_SEC;
+#endif
+}
+
+/*
+sets the parameters of symnmf to the defaults: the mu solver, 300 iterations at most, eps = 0.0001 and beta = 0.5
+@param params: the parameters
+@return void
+*/
+void symnmf_params_default(symnmf_params_t* params)
+{
+    params->max_iter = SYMNMF_MAX_ITER;
+    params->eps = SYMNMF_EPS;
+    params->beta = SYMNMF_BETA;
+    params->solver = SYMNMF_SOLVER_MU;
+}
+
+/*
+frees the per iteration arrays of a report filled by symnmf
+@param report: the report, may be NULL
+@return void
+*/
+void symnmf_report_free(symnmf_report_t* report)
+{
+    if(report == NULL) return;
+    free(report->objectives);
+    free(report->seconds);
+    report->objectives = NULL;
+    report->seconds = NULL;
+}
+
+/*
+symnmf_product_t over a packed symmetric matrix
+*/
+static void symmatrix_product(const void* W, const matrix_t* H, matrix_t* result_matrix, double* scratch)
+{
+    (void)scratch;
+    symmatrix_multiplication((const symmatrix_t*)W, H, result_matrix);
+}
+
+/*
+symnmf_product_t over a packed symmetric matrix streamed from a mapped file
+*/
+static void symmatrix_stream_product(const void* W, const matrix_t* H, matrix_t* result_matrix, double* scratch)
+{
+    symmatrix_stream_multiplication((const symmatrix_t*)W, H, result_matrix, scratch);
+}
+
+/*
+symnmf_product_t over a packed symmetric matrix of floats
+*/
+static void symmatrixf_product(const void* W, const matrix_t* H, matrix_t* result_matrix, double* scratch)
+{
+    (void)scratch;
+    symmatrixf_multiplication((const symmatrixf_t*)W, H, result_matrix);
+}
+
+/*
+symnmf_product_t over a sparse matrix
+*/
+static void csrmatrix_product(const void* W, const matrix_t* H, matrix_t* result_matrix, double* scratch)
+{
+    (void)scratch;
+    csrmatrix_multiplication((const csrmatrix_t*)W, H, result_matrix);
+}
+
+/*
+names of the solvers, in the order of the SYMNMF_SOLVER_* constants
+*/
+static const char* solver_names[] = {"mu", "accelerated", "hals"};
+
+/*
+finds a solver by its name
+@param name: the name of the solver: mu, accelerated or hals
+@return int: the SYMNMF_SOLVER_* constant of the solver, -1 if there is none by that name
+*/
+int symnmf_solver_id(const char* name)
+{
+    int solver;
+    for(solver=0;solver<(int)(sizeof(solver_names)/sizeof(solver_names[0]));solver++)
+    {
+        if(!strcmp(name, solver_names[solver])) return solver;
+    }
+    return -1;
+}
+
+/*
+state of a factorization shared by the threads of its team
+H is the current iterate; new_H is the next one of mu and accelerated, swapped with H after
+every iteration, and the copy X of hals; Y is the extrapolated point of accelerated
+diff, objective and momentum are set by one thread and read by all after the barrier
+*/
+typedef struct factorization_t
+{
+    const void* W;
+    symnmf_product_t product;
+    double* scratch;
+    double w_squares;
+    const symnmf_params_t* params;
+    int chunks;
+    matrix_t* H;
+    matrix_t* new_H;
+    matrix_t* Y;
+    matrix_t* nom_matrix;
+    matrix_t* gram;
+    double* gram_parts;
+    double* diff_parts;
+    double* trace_parts;
+    double* restart_parts;
+    double gram_squares;
+    double diff;
+    double objective;
+    double momentum;
+} factorization_t;
+
+/*
+one iteration of a symnmf solver, called by every thread of the team
+it sets diff to the squared forbius norm of the change of H, and objective to ||W - Y*Y^T||^2
+of the point Y the iteration started from
+*/
+typedef void (*symnmf_solver_t)(factorization_t* f);
+
+/*
+calculates W*Y and Y^T*Y with the whole team, the squared norm of Y^T*Y is kept for the objective
+@param f: the factorization
+@param Y: the matrix, N*k
+@return void
+*/
+static void team_products(factorization_t* f, const matrix_t* Y)
+{
+    f->product(f->W, Y, f->nom_matrix, f->scratch);
+    gram_partials(Y, f->gram_parts);
+#pragma omp single
+    {
+        gram_reduce(f->gram_parts, f->chunks, f->gram);
+        f->gram_squares = matrix_squared_norm(f->gram);
+    }
+}
+
+/*
+sums the partial diffs and traces of the blocks in block order into diff and objective
+@param f: the factorization
+@return void
+*/
+static void sum_parts(factorization_t* f)
+{
+    int chunk;
+    double trace = 0;
+
+    f->diff = 0;
+    for(chunk=0;chunk<f->chunks;chunk++)
+    {
+        f->diff += f->diff_parts[chunk];
+        trace += f->trace_parts[chunk];
+    }
+    f->objective = f->w_squares - 2 * trace + f->gram_squares;
+}
+
+/*
+symnmf_solver_t of the damped multiplicative update, H <- H*(1 - beta + beta*(W*H)/(H*H^T*H))
+@param f: the factorization
+@return void
+*/
+static void mu_iteration(factorization_t* f)
+{
+    matrix_t* swap;
+
+    /* calculate the numerator W*H and the gram matrix H^T*H used by the denominator */
+    team_products(f, f->H);
+
+    /* update the new_H matrix and make it the current one */
+    update_new_H(f->new_H, f->H, f->nom_matrix, f->gram, f->params->beta, f->diff_parts, f->trace_parts);
+#pragma omp single
+    {
+        sum_parts(f);
+        swap = f->H;
+        f->H = f->new_H;
+        f->new_H = swap;
+    }
+}
+
+/*
+symnmf_solver_t of the multiplicative update with Nesterov momentum
+the update is taken from Y = H + (t-1)/(t+2)*(H - old_H), t counting the iterations since the
+last restart; the momentum restarts whenever the gradient at Y points along the step taken
+(O'Donoghue and Candes), so the objective cannot run away
+@param f: the factorization
+@return void
+*/
+static void accelerated_iteration(factorization_t* f)
+{
+    int chunk;
+    double restart;
+    matrix_t* swap;
+
+    team_products(f, f->Y);
+    accelerated_update(f->new_H, f->H, f->Y, f->nom_matrix, f->gram, f->params->beta,
+                       f->diff_parts, f->trace_parts, f->restart_parts);
+#pragma omp single
+    {
+        sum_parts(f);
+        restart = 0;
+        for(chunk=0;chunk<f->chunks;chunk++)
+        {
+            restart += f->restart_parts[chunk];
+        }
+        f->momentum = (restart > 0) ? 1 : f->momentum + 1;
+        swap = f->H;
+        f->H = f->new_H;
+        f->new_H = swap;
+    }
+    extrapolate(f->Y, f->H, f->new_H, (f->momentum - 1) / (f->momentum + 2));
+}
+
+/*
+symnmf_solver_t of hierarchical alternating least squares (HALS) on the penalized problem
+min ||W - H*X^T||^2 + alpha*||H - X||^2, which updates H from the copy X and then X from H,
+each by one sweep of exact column updates; H and X meet at a solution of symnmf for an alpha
+of at least the spectral norm of W, which is 1 for a norm matrix
+@param f: the factorization
+@return void
+*/
+static void hals_iteration(factorization_t* f)
+{
+    team_products(f, f->new_H);
+    hals_update(f->H, f->new_H, f->nom_matrix, f->gram, HALS_PENALTY, f->diff_parts, f->trace_parts);
+#pragma omp single
+    sum_parts(f);
+
+    team_products(f, f->H);
+    hals_update(f->new_H, f->H, f->nom_matrix, f->gram, HALS_PENALTY, NULL, NULL);
+}
+
+/*
+the solvers, in the order of the SYMNMF_SOLVER_* constants
+*/
+static const symnmf_solver_t solvers[] = {mu_iteration, accelerated_iteration, hals_iteration};
+
+/*
+calculates the symnmf matrix of a matrix of doubles using norm and H matrices
+iterates params->solver until the squared forbius norm of the change of H in an iteration falls
+below params->eps or until params->max_iter iterations are reached
+all the scratch matrices are allocated once up front, with the workspace of the product
+one team of threads is started for the whole factorization and shares out every step of every
+iteration; the partial sums are added in a fixed order so the iterations do not depend on the
+number of threads
+the objective of every iterate comes out of the W*H and H^T*H products of its update, so
+reporting it costs no extra pass over W
+@param W: the norm matrix, N*N, only ever read through product
+@param product: the W*H product for the storage of W
+@param scratch: the number of doubles of the workspace of product, 0 if it needs none
+@param w_squares: the squared frobenius norm of W, only used by the report
+@param H_init: the initial H matrix, N*k, left unchanged
+@param params: the parameters, NULL for the defaults
+@param report: filled with the iterations run if not NULL, freed with symnmf_report_free
+@return matrix_t*: the symnmf matrix
+*/
+static matrix_t* factorize(const void* W, symnmf_product_t product, size_t scratch, double w_squares,
+                           const matrix_t* H_init, const symnmf_params_t* params, symnmf_report_t* report)
+{
+    int i;
+    int N = H_init->rows;
+    int k = H_init->cols;
+    int iterations = 0, scratch_failed;
+    symnmf_params_t defaults;
+    double start;
+    factorization_t f;
+    symnmf_solver_t iteration;
+
+    if(params == NULL)
+    {
+        symnmf_params_default(&defaults);
+        params = &defaults;
+    }
+    iteration = solvers[params->solver];
+    f.W = W;
+    f.product = product;
+    f.scratch = (scratch > 0) ? malloc(scratch * sizeof(double)) : NULL;
+    f.w_squares = w_squares;
+    f.params = params;
+    f.chunks = (N + REDUCE_ROWS - 1) / REDUCE_ROWS;
+    f.diff = 0;
+    f.momentum = 1;
+    f.H = matrix_create(N, k);
+    f.new_H = matrix_create(N, k);
+    f.Y = (params->solver == SYMNMF_SOLVER_ACCELERATED) ? matrix_create(N, k) : NULL;
+    f.nom_matrix = matrix_create(N, k);
+    f.gram = matrix_create(k, k);
+    f.gram_parts = malloc((size_t)f.chunks * k * k * sizeof(double));
+    f.diff_parts = malloc((size_t)f.chunks * sizeof(double));
+    f.trace_parts = malloc((size_t)f.chunks * sizeof(double));
+    f.restart_parts = malloc((size_t)f.chunks * sizeof(double));
+    if(report != NULL)
+    {
+        report->objectives = malloc(((size_t)params->max_iter + 1) * sizeof(double));
+        report->seconds = malloc(((size_t)params->max_iter + 1) * sizeof(double));
+    }
+    scratch_failed = f.gram_parts == NULL || f.diff_parts == NULL || f.trace_parts == NULL || f.restart_parts == NULL
+                     || (scratch > 0 && f.scratch == NULL)
+                     || (report != NULL && (report->objectives == NULL || report->seconds == NULL));
+    if(scratch_failed || f.H == NULL || f.new_H == NULL || f.nom_matrix == NULL || f.gram == NULL
+       || (params->solver == SYMNMF_SOLVER_ACCELERATED && f.Y == NULL))
+    {
+        /* Memory allocation failed */
+        if(scratch_failed) printf("An Error Has Occured");
+        matrix_destroy(f.H);
+        matrix_destroy(f.new_H);
+        matrix_destroy(f.Y);
+        matrix_destroy(f.nom_matrix);
+        matrix_destroy(f.gram);
+        free(f.gram_parts);
+        free(f.diff_parts);
+        free(f.trace_parts);
+        free(f.restart_parts);
+        free(f.scratch);
+        symnmf_report_free(report);
+        return NULL;
+    }
+    for(i=0;i<N;i++)
+    {
+        /* accelerated starts from Y = H, hals from the copy X = H */
+        memcpy(MATRIX_ROW(f.H, i), MATRIX_ROW(H_init, i), (size_t)k * sizeof(double));
+        memcpy(MATRIX_ROW(f.new_H, i), MATRIX_ROW(H_init, i), (size_t)k * sizeof(double));
+        if(f.Y != NULL) memcpy(MATRIX_ROW(f.Y, i), MATRIX_ROW(H_init, i), (size_t)k * sizeof(double));
+    }
+    if(simd_level < 0) simd_select(-1);
+    start = wall_time();
+
+#pragma omp parallel private(i)
+    for(i=0;i<params->max_iter;i++)
+    {
+        iteration(&f);
+#pragma omp single
+        {
+            if(report != NULL)
+            {
+                report->objectives[i] = f.objective;
+                report->seconds[i] = wall_time() - start;
+                start += report->seconds[i];
+            }
+            iterations = i + 1;
+        }
+        /* every thread sees the same diff after the barrier closing the single block */
+        if(f.diff < params->eps)
+        {
+            break;
+        }
+    }
+
+    if(report != NULL)
+    {
+        report->iterations = iterations;
+        report->converged = (iterations > 0 && f.diff < params->eps);
+        report->delta = f.diff;
+    }
+    matrix_destroy(f.new_H);
+    matrix_destroy(f.Y);
+    matrix_destroy(f.nom_matrix);
+    matrix_destroy(f.gram);
+    free(f.gram_parts);
+    free(f.diff_parts);
+    free(f.trace_parts);
+    free(f.restart_parts);
+    free(f.scratch);
+    return f.H;
+}
+
+/*
+calculates the symnmf matrix of a packed norm matrix, see factorize
+@param W: the norm matrix, N*N
+@param H_init: the initial H matrix, N*k, left unchanged
+@param params: the parameters, NULL for the defaults
+@param report: filled with the iterations run if not NULL, freed with symnmf_report_free
+@return matrix_t*: the symnmf matrix
+*/
+matrix_t* calc_symnmf(const symmatrix_t* W, const matrix_t* H_init, const symnmf_params_t* params, symnmf_report_t* report)
+{
+    return factorize(W, symmatrix_product, 0, report != NULL ? symmatrix_squared_norm(W) : 0, H_init, params, report);
+}
+
+/*
+calculates the symnmf matrix of a sparse norm matrix, see factorize
+@param W: the sparse norm matrix, N*N
+@param H_init: the initial H matrix, N*k, left unchanged
+@param params: the parameters, NULL for the defaults
+@param report: filled with the iterations run if not NULL, freed with symnmf_report_free
+@return matrix_t*: the symnmf matrix
+*/
+matrix_t* calc_symnmf_sparse(const csrmatrix_t* W, const matrix_t* H_init, const symnmf_params_t* params, symnmf_report_t* report)
+{
+    return factorize(W, csrmatrix_product, 0, report != NULL ? csrmatrix_squared_norm(W) : 0, H_init, params, report);
+}
+
+/*
+calculates the symnmf matrix of a packed norm matrix of floats, see factorize
+H and every sum stay in double, only the entries of W are read as floats
+@param W: the norm matrix of floats, N*N
+@param H_init: the initial H matrix, N*k, left unchanged
+@param params: the parameters, NULL for the defaults
+@param report: filled with the iterations run if not NULL, freed with symnmf_report_free
+@return matrix_t*: the symnmf matrix
+*/
+matrix_t* calc_symnmf_f32(const symmatrixf_t* W, const matrix_t* H_init, const symnmf_params_t* params, symnmf_report_t* report)
+{
+    return factorize(W, symmatrixf_product, 0, report != NULL ? symmatrixf_squared_norm(W) : 0, H_init, params, report);
+}
+
+/*
+calculates the symnmf matrix of a packed norm matrix mapped from a file, see factorize
+W is read once per product in storage order by symmatrix_stream_multiplication, so it need not fit in memory
+@param W: the norm matrix viewing a matrix file, N*N, see calc_norm_file
+@param H_init: the initial H matrix, N*k, left unchanged
+@param params: the parameters, NULL for the defaults
+@param report: filled with the iterations run if not NULL, freed with symnmf_report_free
+@return matrix_t*: the symnmf matrix
+*/
+matrix_t* calc_symnmf_stream(const symmatrix_t* W, const matrix_t* H_init, const symnmf_params_t* params, symnmf_report_t* report)
+{
+    return factorize(W, symmatrix_stream_product, symmatrix_stream_scratch(W, H_init->cols), report != NULL ? symmatrix_squared_norm(W) : 0, H_init, params, report);
+}
+
+/*
+calculates the objective ||W - H*H^T||^2 of a factorization without forming H*H^T,
+as ||W||^2 - 2*tr(H^T*W*H) + ||H^T*H||^2
+@param W: the norm matrix, N*N, only ever read through product
+@param product: the W*H product for the storage of W
+@param scratch: the number of doubles of the workspace of product, 0 if it needs none
+@param w_squares: the squared frobenius norm of W
+@param H: the factor, N*k
+@param objective: set to the objective
+@return int: 0 on success, 1 if allocation failed
+*/
+static int factorization_objective(const void* W, symnmf_product_t product, size_t scratch, double w_squares,
+                                   const matrix_t* H, double* objective)
+{
+    int i,j;
+    int k = H->cols;
+    int chunks = (H->rows + REDUCE_ROWS - 1) / REDUCE_ROWS;
+    double trace = 0, gram_squares = 0;
+    matrix_t* WH = matrix_create(H->rows, k);
+    matrix_t* gram = matrix_create(k, k);
+    double* gram_parts = malloc((size_t)chunks * k * k * sizeof(double));
+    double* workspace = (scratch > 0) ? malloc(scratch * sizeof(double)) : NULL;
+
+    if(WH == NULL || gram == NULL || gram_parts == NULL || (scratch > 0 && workspace == NULL))
+    {
+        /* Memory allocation failed */
+        if(gram_parts == NULL || (scratch > 0 && workspace == NULL)) printf("An Error Has Occured");
+        matrix_destroy(WH);
+        matrix_destroy(gram);
+        free(gram_parts);
+        free(workspace);
+        return 1;
+    }
+
+#pragma omp parallel
+    {
+        product(W, H, WH, workspace);
+        gram_partials(H, gram_parts);
+    }
+    gram_reduce(gram_parts, chunks, gram);
+
+    for(i=0;i<H->rows;i++)
+    {
+        for(j=0;j<k;j++)
+        {
+            trace += MATRIX_AT(H, i, j) * MATRIX_AT(WH, i, j);
+        }
+    }
+    gram_squares = matrix_squared_norm(gram);
+
+    matrix_destroy(WH);
+    matrix_destroy(gram);
+    free(gram_parts);
+    free(workspace);
+    *objective = w_squares - 2 * trace + gram_squares;
+    return 0;
+}
+
+/*
+factorizes one norm matrix from several initial H matrices, for several k and several seeds
+W is shared read only by all the runs; the runs are handed out one at a time to an outer team of
+up to one thread per run, and the threads left over are split between the runs as their inner
+teams; every run gives the same H as on its own, whatever the split
+@param W: the norm matrix, N*N, only ever read through product
+@param product: the W*H product for the storage of W
+@param scratch: the number of doubles of the workspace of product, 0 if it needs none
+@param w_squares: the squared frobenius norm of W
+@param H_inits: the initial H matrices, N*k each, left unchanged
+@param runs: the number of runs
+@param params: the parameters shared by all the runs, NULL for the defaults
+@param results: set to the symnmf matrix of every run
+@param objectives: set to ||W - H*H^T||^2 of every run
+@return int: 0 on success, 1 if allocation failed, then no result is kept
+*/
+static int factorize_batch(const void* W, symnmf_product_t product, size_t scratch, double w_squares,
+                           matrix_t* const* H_inits, int runs, const symnmf_params_t* params, matrix_t** results,
+                           double* objectives)
+{
+    int run, failed = 0;
+    int threads = symnmf_get_threads();
+    int outer = (runs < threads) ? runs : threads;
+    int inner = (outer > 0) ? threads / outer : 1;
+#ifdef _OPENMP
+    int levels = omp_get_max_active_levels();
+    if(inner > 1 && levels < 2) omp_set_max_active_levels(2);
+#endif
+
+#pragma omp parallel for schedule(dynamic, 1) num_threads(outer > 0 ? outer : 1) reduction(|:failed)
+    for(run=0;run<runs;run++)
+    {
+        symnmf_set_threads(inner);
+        results[run] = factorize(W, product, scratch, w_squares, H_inits[run], params, NULL);
+        if(results[run] == NULL || factorization_objective(W, product, scratch, w_squares, results[run], &objectives[run]) != 0)
+        {
+            failed = 1;
+        }
+    }
+#ifdef _OPENMP
+    omp_set_max_active_levels(levels);
+#endif
+
+    if(failed)
+    {
+        for(run=0;run<runs;run++)
+        {
+            matrix_destroy(results[run]);
+            results[run] = NULL;
+        }
+    }
+    return failed;
+}
+
+/*
+runs a batch of symnmf factorizations of a packed norm matrix, see factorize_batch
+@param W: the norm matrix, N*N
+@param H_inits: the initial H matrices, N*k each, left unchanged
+@param runs: the number of runs
+@param params: the parameters shared by all the runs, NULL for the defaults
+@param results: set to the symnmf matrix of every run
+@param objectives: set to ||W - H*H^T||^2 of every run
+@return int: 0 on success, 1 if allocation failed
+*/
+int calc_symnmf_batch(const symmatrix_t* W, matrix_t* const* H_inits, int runs, const symnmf_params_t* params,
+                      matrix_t** results, double* objectives)
+{
+    return factorize_batch(W, symmatrix_product, 0, symmatrix_squared_norm(W), H_inits, runs, params, results, objectives);
+}
+
+/*
+runs a batch of symnmf factorizations of a sparse norm matrix, see factorize_batch
+@param W: the sparse norm matrix, N*N
+@param H_inits: the initial H matrices, N*k each, left unchanged
+@param runs: the number of runs
+@param params: the parameters shared by all the runs, NULL for the defaults
+@param results: set to the symnmf matrix of every run
+@param objectives: set to ||W - H*H^T||^2 of every run
+@return int: 0 on success, 1 if allocation failed
+*/
+int calc_symnmf_sparse_batch(const csrmatrix_t* W, matrix_t* const* H_inits, int runs, const symnmf_params_t* params,
+                             matrix_t** results, double* objectives)
+{
+    return factorize_batch(W, csrmatrix_product, 0, csrmatrix_squared_norm(W), H_inits, runs, params, results, objectives);
+}
+
+/*
+Mersenne Twister MT19937 state, the generator behind numpy.random.RandomState
+*/
+typedef struct mt19937_t
+{
+    unsigned long state[MT_STATE];
+    int index;
+} mt19937_t;
+
+/*
+seeds a Mersenne Twister as RandomState(seed) does for a seed below 2^32
+@param mt: the generator
+@param seed: the seed
+@return void
+*/
+static void mt19937_seed(mt19937_t* mt, unsigned long seed)
+{
+    int i;
+    mt->state[0] = seed & 0xffffffffUL;
+    for(i=1;i<MT_STATE;i++)
+    {
+        mt->state[i] = (1812433253UL * (mt->state[i-1] ^ (mt->state[i-1] >> 30)) + (unsigned long)i) & 0xffffffffUL;
+    }
+    mt->index = MT_STATE;
+}
+
+/*
+draws the next 32 bits of a Mersenne Twister, regenerating the whole state every MT_STATE draws
+@param mt: the generator
+@return unsigned long: the 32 random bits
+*/
+static unsigned long mt19937_next(mt19937_t* mt)
+{
+    int i;
+    unsigned long y;
+
+    if(mt->index >= MT_STATE)
+    {
+        for(i=0;i<MT_STATE;i++)
+        {
+            y = (mt->state[i] & 0x80000000UL) | (mt->state[(i + 1) % MT_STATE] & 0x7fffffffUL);
+            mt->state[i] = mt->state[(i + 397) % MT_STATE] ^ (y >> 1) ^ ((y & 1) ? 0x9908b0dfUL : 0);
+        }
+        mt->index = 0;
+    }
+    y = mt->state[mt->index++];
+    y ^= y >> 11;
+    y ^= (y << 7) & 0x9d2c5680UL;
+    y ^= (y << 15) & 0xefc60000UL;
+    y ^= y >> 18;
+    return y & 0xffffffffUL;
+}
+
+/*
+draws a double in [0, 1) from 53 random bits, as RandomState.random_sample does
+@param mt: the generator
+@return double: the random double
+*/
+static double mt19937_double(mt19937_t* mt)
+{
+    unsigned long a = mt19937_next(mt) >> 5;
+    unsigned long b = mt19937_next(mt) >> 6;
+    return (a * 67108864.0 + b) / 9007199254740992.0;
+}
+
+/*
+draws the initial H of symnmf, uniform in [0, 2*sqrt(mean/k)), with the values
+np.random.RandomState(seed).uniform(0, 2*sqrt(mean/k), (N, k)) gives in symnmf.py
+@param N: the number of rows
+@param k: the number of columns
+@param mean: the mean of all the entries of the norm matrix
+@param seed: the seed of the generator, below 2^32
+@return matrix_t*: the initial H matrix, NULL if allocation failed
+*/
+matrix_t* symnmf_random_H(int N, int k, double mean, unsigned long seed)
+{
+    int i,j;
+    double upper_bound = 2 * sqrt(mean / k);
+    mt19937_t mt;
+    matrix_t* H = matrix_create(N, k);
+    if(H == NULL) return NULL; /* Memory allocation failed */
+
+    mt19937_seed(&mt, seed);
+    for(i=0;i<N;i++)
+    {
+        for(j=0;j<k;j++)
+        {
+            MATRIX_AT(H, i, j) = upper_bound * mt19937_double(&mt);
+        }
+    }
+    return H;
+}
+
+/*
+sums the row sums of a norm matrix in row order into the mean of its N*N entries
+@param sums: the N row sums
+@param N: the number of rows
+@return double: the mean
+*/
+static double row_sums_mean(const double* sums, int N)
+{
+    int i;
+    double total = 0;
+
+    for(i=0;i<N;i++)
+    {
+        total += sums[i];
+    }
+    return total / ((double)N * N);
+}
+
+/*
+calculates the symnmf matrix of a packed norm matrix from the seeded random H of symnmf_random_H
+drawn with the mean of W, so neither W nor H has to be built outside
+@param W: the norm matrix, N*N
+@param k: the number of columns of H
+@param seed: the seed of the initial H, below 2^32
+@param params: the parameters, NULL for the defaults
+@param report: filled with the iterations run if not NULL, freed with symnmf_report_free
+@return matrix_t*: the symnmf matrix, NULL if allocation failed
+*/
+matrix_t* calc_symnmf_random(const symmatrix_t* W, int k, unsigned long seed, const symnmf_params_t* params, symnmf_report_t* report)
+{
+    double* sums = malloc((size_t)W->n * sizeof(double));
+    matrix_t* H_init;
+    matrix_t* H = NULL;
+
+    if(sums == NULL) /* Memory allocation failed */
+    {
+        printf("An Error Has Occured");
+        return NULL;
+    }
+    symmatrix_row_sums(W, sums);
+    if((H_init = symnmf_random_H(W->n, k, row_sums_mean(sums, W->n), seed)) != NULL)
+    {
+        H = calc_symnmf(W, H_init, params, report);
+        matrix_destroy(H_init);
+    }
+    free(sums);
+    return H;
+}
+
+/*
+calculates the symnmf matrix of a sparse norm matrix from the seeded random H of symnmf_random_H,
+see calc_symnmf_random; the entries missing from W count as zeros in its mean
+@param W: the sparse norm matrix, N*N
+@param k: the number of columns of H
+@param seed: the seed of the initial H, below 2^32
+@param params: the parameters, NULL for the defaults
+@param report: filled with the iterations run if not NULL, freed with symnmf_report_free
+@return matrix_t*: the symnmf matrix, NULL if allocation failed
+*/
+matrix_t* calc_symnmf_sparse_random(const csrmatrix_t* W, int k, unsigned long seed, const symnmf_params_t* params, symnmf_report_t* report)
+{
+    double* sums = malloc((size_t)W->n * sizeof(double));
+    matrix_t* H_init;
+    matrix_t* H = NULL;
+
+    if(sums == NULL) /* Memory allocation failed */
+    {
+        printf("An Error Has Occured");
+        return NULL;
+    }
+    csrmatrix_row_sums(W, sums);
+    if((H_init = symnmf_random_H(W->n, k, row_sums_mean(sums, W->n), seed)) != NULL)
+    {
+        H = calc_symnmf_sparse(W, H_init, params, report);
+        matrix_destroy(H_init);
+    }
+    free(sums);
+    return H;
+}
+
+/*
+calculates the symnmf matrix of a packed norm matrix of floats from the seeded random H of
+symnmf_random_H, see calc_symnmf_random
+@param W: the norm matrix of floats, N*N
+@param k: the number of columns of H
+@param seed: the seed of the initial H, below 2^32
+@param params: the parameters, NULL for the defaults
+@param report: filled with the iterations run if not NULL, freed with symnmf_report_free
+@return matrix_t*: the symnmf matrix, NULL if allocation failed
+*/
+matrix_t* calc_symnmf_random_f32(const symmatrixf_t* W, int k, unsigned long seed, const symnmf_params_t* params, symnmf_report_t* report)
+{
+    double* sums = malloc((size_t)W->n * sizeof(double));
+    matrix_t* H_init;
+    matrix_t* H = NULL;
+
+    if(sums == NULL) /* Memory allocation failed */
+    {
+        printf("An Error Has Occured");
+        return NULL;
+    }
+    symmatrixf_row_sums(W, sums);
+    if((H_init = symnmf_random_H(W->n, k, row_sums_mean(sums, W->n), seed)) != NULL)
+    {
+        H = calc_symnmf_f32(W, H_init, params, report);
+        matrix_destroy(H_init);
+    }
+    free(sums);
+    return H;
+}
+
+/*
+calculates the symnmf matrix of a packed norm matrix mapped from a file from the seeded random H of
+symnmf_random_H, see calc_symnmf_random; the mean of W is streamed as well
+@param W: the norm matrix viewing a matrix file, N*N, see calc_norm_file
+@param k: the number of columns of H
+@param seed: the seed of the initial H, below 2^32
+@param params: the parameters, NULL for the defaults
+@param report: filled with the iterations run if not NULL, freed with symnmf_report_free
+@return matrix_t*: the symnmf matrix, NULL if allocation failed
+*/
+matrix_t* calc_symnmf_random_stream(const symmatrix_t* W, int k, unsigned long seed, const symnmf_params_t* params, symnmf_report_t* report)
+{
+    double* sums = malloc((size_t)W->n * sizeof(double));
+    matrix_t* H_init;
+    matrix_t* H = NULL;
+
+    if(sums == NULL) /* Memory allocation failed */
+    {
+        printf("An Error Has Occured");
+        return NULL;
+    }
+    if(symmatrix_stream_row_sums(W, sums) == 0 &&
+       (H_init = symnmf_random_H(W->n, k, row_sums_mean(sums, W->n), seed)) != NULL)
+    {
+        H = calc_symnmf_stream(W, H_init, params, report);
+        matrix_destroy(H_init);
+    }
+    free(sums);
+    return H;
+}
+
+/*
+draws m distinct landmark points out of N, by the first m steps of a seeded Fisher-Yates shuffle
+@param N: the number of points
+@param m: the number of landmarks, at most N
+@param seed: the seed of the shuffle, below 2^32
+@return int*: the m landmark indices, NULL if allocation failed
+*/
+static int* sample_landmarks(int N, int m, unsigned long seed)
+{
+    int i,j,swap;
+    mt19937_t mt;
+    int* order = malloc((size_t)N * sizeof(int));
+
+    if(order == NULL) /* Memory allocation failed */
+    {
+        printf("An Error Has Occured");
+        return NULL;
+    }
+    for(i=0;i<N;i++)
+    {
+        order[i] = i;
+    }
+    mt19937_seed(&mt, seed);
+    for(i=0;i<m;i++)
+    {
+        j = i + (int)(mt19937_double(&mt) * (N - i));
+        swap = order[i];
+        order[i] = order[j];
+        order[j] = swap;
+    }
+    return order;
+}
+
+/*
+diagonalizes a symmetric matrix by cyclic Jacobi rotations, A = V*diag(values)*V^T
+@param A: the symmetric m*m matrix, overwritten
+@param V: the m*m matrix of the eigenvectors, one per column
+@param values: the m eigenvalues, in the order of the columns of V
+@return void
+*/
+static void jacobi_eigen(matrix_t* A, matrix_t* V, double* values)
+{
+    int i,p,q,sweep,m = A->rows;
+    double off, total, theta, t, c, s, x, y;
+
+    for(i=0;i<m;i++)
+    {
+        memset(MATRIX_ROW(V, i), 0, (size_t)V->stride * sizeof(double));
+        MATRIX_AT(V, i, i) = 1;
+    }
+    for(sweep=0;sweep<JACOBI_SWEEPS;sweep++)
+    {
+        off = 0;
+        total = 0;
+        for(p=0;p<m;p++)
+        {
+            for(q=0;q<m;q++)
+            {
+                total += MATRIX_AT(A, p, q) * MATRIX_AT(A, p, q);
+                if(p != q) off += MATRIX_AT(A, p, q) * MATRIX_AT(A, p, q);
+            }
+        }
+        if(off <= JACOBI_TOLERANCE * JACOBI_TOLERANCE * total) break;
+
+        for(p=0;p<m-1;p++)
+        {
+            for(q=p+1;q<m;q++)
+            {
+                if(MATRIX_AT(A, p, q) == 0) continue;
+                /* the rotation by t = tan(angle) that zeroes A[p][q], the smaller of the two angles */
+                theta = (MATRIX_AT(A, q, q) - MATRIX_AT(A, p, p)) / (2 * MATRIX_AT(A, p, q));
+                t = ((theta >= 0) ? 1 : -1) / (fabs(theta) + sqrt(theta * theta + 1));
+                c = 1 / sqrt(t * t + 1);
+                s = t * c;
+                for(i=0;i<m;i++)
+                {
+                    x = MATRIX_AT(A, i, p);
+                    y = MATRIX_AT(A, i, q);
+                    MATRIX_AT(A, i, p) = c * x - s * y;
+                    MATRIX_AT(A, i, q) = s * x + c * y;
+                }
+                for(i=0;i<m;i++)
+                {
+                    x = MATRIX_AT(A, p, i);
+                    y = MATRIX_AT(A, q, i);
+                    MATRIX_AT(A, p, i) = c * x - s * y;
+                    MATRIX_AT(A, q, i) = s * x + c * y;
+                }
+                for(i=0;i<m;i++)
+                {
+                    x = MATRIX_AT(V, i, p);
+                    y = MATRIX_AT(V, i, q);
+                    MATRIX_AT(V, i, p) = c * x - s * y;
+                    MATRIX_AT(V, i, q) = s * x + c * y;
+                }
+            }
+        }
+    }
+    for(i=0;i<m;i++)
+    {
+        values[i] = MATRIX_AT(A, i, i);
+    }
+}
+
+/*
+frees a matrix returned by calc_norm_nystrom
+@param mat: the matrix to be freed, may be NULL
+@return void
+*/
+void lowrank_destroy(lowrank_t* mat)
+{
+    if(mat == NULL) return;
+    matrix_destroy(mat->factor);
+    free(mat->shift);
+    free(mat);
+}
+
+/*
+builds the low-rank form of the Nystrom approximation from the N*m affinities to the landmarks
+K ~ C*Kmm^+*C^T is factored as G*G^T with G = C*V*diag(values)^-1/2, the eigenvalues of Kmm below
+NYSTROM_TOLERANCE of the largest dropped; sym has a zero diagonal, so its degrees are G*(G^T*1) - 1
+and the norm matrix is D^-1/2*G*G^T*D^-1/2 - D^-1
+@param C: the affinities of the N points to the m landmarks, with C[landmarks[a]][b] = Kmm[a][b]
+@param landmarks: the m landmark indices
+@return lowrank_t*: the low-rank norm matrix, NULL if allocation failed
+*/
+static lowrank_t* nystrom_factor(const matrix_t* C, const int* landmarks)
+{
+    int i,a,b,rank = 0;
+    int N = C->rows, m = C->cols;
+    double largest = 0, degree;
+    double* values = malloc((size_t)m * sizeof(double));
+    double* column_sums = NULL;
+    matrix_t* K = matrix_create(m, m);
+    matrix_t* V = matrix_create(m, m);
+    matrix_t* B = NULL;
+    lowrank_t* mat = malloc(sizeof(lowrank_t));
+
+    if(mat != NULL)
+    {
+        mat->n = N;
+        mat->factor = NULL;
+        mat->shift = malloc((size_t)N * sizeof(double));
+    }
+    if(values == NULL || K == NULL || V == NULL || mat == NULL || mat->shift == NULL)
+    {
+        printf("An Error Has Occured");
+        free(values);
+        matrix_destroy(K);
+        matrix_destroy(V);
+        lowrank_destroy(mat);
+        return NULL;
+    }
+
+    for(a=0;a<m;a++)
+    {
+        memcpy(MATRIX_ROW(K, a), MATRIX_ROW(C, landmarks[a]), (size_t)m * sizeof(double));
+    }
+    jacobi_eigen(K, V, values);
+    for(a=0;a<m;a++)
+    {
+        if(values[a] > largest) largest = values[a];
+    }
+    for(a=0;a<m;a++)
+    {
+        rank += values[a] > NYSTROM_TOLERANCE * largest;
+    }
+
+    /* B = V*diag(values)^-1/2 over the kept eigenvalues, G = C*B */
+    if(rank > 0 && (B = matrix_create(m, rank)) != NULL && (mat->factor = matrix_create(N, rank)) != NULL &&
+       (column_sums = calloc((size_t)rank, sizeof(double))) != NULL)
+    {
+        for(a=0,rank=0;a<m;a++)
+        {
+            if(!(values[a] > NYSTROM_TOLERANCE * largest)) continue;
+            for(b=0;b<m;b++)
+            {
+                MATRIX_AT(B, b, rank) = MATRIX_AT(V, b, a) / sqrt(values[a]);
+            }
+            rank++;
+        }
+        matrix_multiplication(C, B, mat->factor);
+
+        for(i=0;i<N;i++)
+        {
+            for(a=0;a<rank;a++)
+            {
+                column_sums[a] += MATRIX_AT(mat->factor, i, a);
+            }
+        }
+        for(i=0;i<N;i++)
+        {
+            degree = -1;
+            for(a=0;a<rank;a++)
+            {
+                degree += MATRIX_AT(mat->factor, i, a) * column_sums[a];
+            }
+            /* a point the approximation leaves without neighbours is cut off, as a zero row */
+            mat->shift[i] = (degree > 0) ? 1 / degree : 0;
+            for(a=0;a<rank;a++)
+            {
+                MATRIX_AT(mat->factor, i, a) *= sqrt(mat->shift[i]);
+            }
+        }
+    }
+    else
+    {
+        printf("An Error Has Occured");
+        lowrank_destroy(mat);
+        mat = NULL;
+    }
+
+    free(values);
+    free(column_sums);
+    matrix_destroy(K);
+    matrix_destroy(V);
+    matrix_destroy(B);
+    return mat;
+}
+
+/*
+calculates a low-rank approximation of the norm matrix from m landmark points (Nystrom)
+only the N*m affinities of every point to the landmarks are calculated, with the kernel of sym,
+so the approximation costs O(N*m*d + m^3) time and O(N*m) memory instead of O(N^2)
+@param vectors: the matrix of vectors, one vector per row
+@param landmarks: the number of landmarks m, at most N are used
+@param seed: the seed of the choice of the landmarks, below 2^32
+@return lowrank_t*: the norm matrix as F*F^T - diag(shift), NULL if allocation failed
+*/
+lowrank_t* calc_norm_nystrom(const matrix_t* vectors, int landmarks, unsigned long seed)
+{
+    int i,a,rows;
+    int N = vectors->rows, m = (landmarks < vectors->rows) ? landmarks : vectors->rows;
+    int* order;
+    double* norms;
+    matrix_t* C = NULL;
+    matrix_t* transposed = NULL;
+    lowrank_t* mat = NULL;
+
+    if((order = sample_landmarks(N, m, seed)) == NULL) return NULL; /* Memory allocation failed */
+    if((norms = malloc((size_t)(N + m) * sizeof(double))) == NULL) /* Memory allocation failed */
+    {
+        printf("An Error Has Occured");
+        free(order);
+        return NULL;
+    }
+    /* the squared norms of all the vectors, then of the landmarks gathered into the columns of the gemm */
+    if((transposed = transpose_vectors(vectors, order, m, norms + N)) != NULL && (C = matrix_create(N, m)) != NULL)
+    {
+#pragma omp parallel for schedule(static) private(a)
+        for(i=0;i<N;i++)
+        {
+            norms[i] = 0;
+            for(a=0;a<vectors->cols;a++)
+            {
+                norms[i] += MATRIX_AT(vectors, i, a) * MATRIX_AT(vectors, i, a);
+            }
+        }
+#pragma omp parallel for schedule(dynamic, 1) private(rows)
+        for(i=0;i<N;i+=SYMMATRIX_TILE)
+        {
+            rows = (N - i < SYMMATRIX_TILE) ? N - i : SYMMATRIX_TILE;
+            gaussian_block(vectors, norms + i, i, rows, transposed->data, (size_t)transposed->stride,
+                           norms + N, m, MATRIX_ROW(C, i), (size_t)C->stride);
+        }
+        mat = nystrom_factor(C, order);
+    }
+    matrix_destroy(C);
+    matrix_destroy(transposed);
+    free(norms);
+    free(order);
+    return mat;
+}
+
+/*
+multiplies a low-rank norm matrix by a dense matrix into a preallocated result matrix, as F*(F^T*H) - shift*H
+F^T*H is summed over fixed blocks of REDUCE_ROWS rows added in order, so the result is the same for any
+number of threads; the few entries the approximation makes negative are cut to zero, so the multiplicative
+updates keep H non-negative, the error this hides is measured by lowrank_error
+called by every thread of a team, or by a single thread outside one
+@param W: the low-rank matrix, N*N
+@param H: the dense matrix, N*k
+@param result_matrix: the result matrix, N*k, must not alias H
+@param scratch: the workspace of lowrank_scratch doubles, the first rank*k block holds F^T*H and
+the others the partial sums of the blocks
+@return void
+*/
+void lowrank_multiplication(const lowrank_t* W, const matrix_t* H, matrix_t* result_matrix, double* scratch)
+{
+    int i,j,c,r,rows;
+    int rank = W->factor->cols;
+    int chunks = (W->n + REDUCE_ROWS - 1) / REDUCE_ROWS;
+    size_t e, ldh = (size_t)H->stride, ldf = (size_t)W->factor->stride, ldr = (size_t)result_matrix->stride;
+    size_t part = (size_t)rank * ldh;
+    double value;
+    double* row;
+
+#pragma omp for schedule(static)
+    for(c=0;c<chunks;c++)
+    {
+        rows = (W->n - c*REDUCE_ROWS < REDUCE_ROWS) ? W->n - c*REDUCE_ROWS : REDUCE_ROWS;
+        memset(scratch + (size_t)(c + 1) * part, 0, part * sizeof(double));
+        gemm_accumulate(rank, H->cols, rows, MATRIX_ROW(W->factor, c*REDUCE_ROWS), 1, ldf,
+                        MATRIX_ROW(H, c*REDUCE_ROWS), ldh, scratch + (size_t)(c + 1) * part, ldh);
+    }
+#pragma omp for schedule(static)
+    for(r=0;r<rank;r++)
+    {
+        for(e=(size_t)r*ldh;e<(size_t)(r + 1)*ldh;e++)
+        {
+            value = 0;
+            for(c=0;c<chunks;c++)
+            {
+                value += scratch[(size_t)(c + 1) * part + e];
+            }
+            scratch[e] = value;
+        }
+    }
+#pragma omp for schedule(static)
+    for(c=0;c<chunks;c++)
+    {
+        rows = (W->n - c*REDUCE_ROWS < REDUCE_ROWS) ? W->n - c*REDUCE_ROWS : REDUCE_ROWS;
+        for(i=c*REDUCE_ROWS;i<c*REDUCE_ROWS + rows;i++)
+        {
+            memset(MATRIX_ROW(result_matrix, i), 0, ldr * sizeof(double));
+        }
+        gemm_accumulate(rows, H->cols, rank, MATRIX_ROW(W->factor, c*REDUCE_ROWS), ldf, 1,
+                        scratch, ldh, MATRIX_ROW(result_matrix, c*REDUCE_ROWS), ldr);
+        for(i=c*REDUCE_ROWS;i<c*REDUCE_ROWS + rows;i++)
+        {
+            row = MATRIX_ROW(result_matrix, i);
+            for(j=0;j<H->cols;j++)
+            {
+                row[j] -= W->shift[i] * MATRIX_AT(H, i, j);
+                if(row[j] < 0) row[j] = 0;
+            }
+        }
+    }
+}
+
+/*
+returns the size of the workspace of lowrank_multiplication
+@param W: the low-rank matrix, N*N
+@param k: the number of columns of H
+@return size_t: the number of doubles of the workspace
+*/
+size_t lowrank_scratch(const lowrank_t* W, int k)
+{
+    size_t chunks = (size_t)((W->n + REDUCE_ROWS - 1) / REDUCE_ROWS);
+    return (chunks + 1) * (size_t)W->factor->cols * matrix_stride(k);
+}
+
+/*
+calculates the error of a low-rank approximation of the norm matrix against the exact norm matrix
+the exact entries are calculated on the fly, one row at a time, so it takes O(N^2*d) time but only O(N) memory
+@param vectors: the matrix of vectors the approximation was made from
+@param W: the low-rank norm matrix
+@param max_error: set to the largest absolute difference of an entry
+@return double: the relative error ||W - norm||_F / ||norm||_F, -1 if allocation failed
+*/
+double lowrank_error(const matrix_t* vectors, const lowrank_t* W, double* max_error)
+{
+    int i,j,a;
+    int N = vectors->rows;
+    double exact, approx, d, error = 0, total = 0;
+    double* degrees = malloc((size_t)N * sizeof(double));
+    double* row_errors = malloc((size_t)N * sizeof(double));
+    double* row_totals = malloc((size_t)N * sizeof(double));
+    double* row_max = malloc((size_t)N * sizeof(double));
+
+    *max_error = 0;
+    if(degrees == NULL || row_errors == NULL || row_totals == NULL || row_max == NULL) /* Memory allocation failed */
+    {
+        printf("An Error Has Occured");
+        free(degrees);
+        free(row_errors);
+        free(row_totals);
+        free(row_max);
+        return -1;
+    }
+#pragma omp parallel for schedule(static) private(j, d)
+    for(i=0;i<N;i++)
+    {
+        d = 0;
+        for(j=0;j<N;j++)
+        {
+            if(j != i) d += exp(-euclidean_distance(MATRIX_ROW(vectors, i), MATRIX_ROW(vectors, j), vectors->cols, 1)/2);
+        }
+        degrees[i] = 1 / sqrt(d);
+    }
+#pragma omp parallel for schedule(dynamic, 16) private(j, a, exact, approx, d)
+    for(i=0;i<N;i++)
+    {
+        row_errors[i] = 0;
+        row_totals[i] = 0;
+        row_max[i] = 0;
+        for(j=0;j<N;j++)
+        {
+            exact = (j == i) ? 0 : exp(-euclidean_distance(MATRIX_ROW(vectors, i), MATRIX_ROW(vectors, j), vectors->cols, 1)/2)
+                                   * degrees[i] * degrees[j];
+            approx = (j == i) ? -W->shift[i] : 0;
+            for(a=0;a<W->factor->cols;a++)
+            {
+                approx += MATRIX_AT(W->factor, i, a) * MATRIX_AT(W->factor, j, a);
+            }
+            d = fabs(approx - exact);
+            row_errors[i] += d * d;
+            row_totals[i] += exact * exact;
+            if(d > row_max[i]) row_max[i] = d;
+        }
+    }
+    for(i=0;i<N;i++)
+    {
+        error += row_errors[i];
+        total += row_totals[i];
+        if(row_max[i] > *max_error) *max_error = row_max[i];
+    }
+    free(degrees);
+    free(row_errors);
+    free(row_totals);
+    free(row_max);
+    return (total > 0) ? sqrt(error / total) : sqrt(error);
+}
+
+/*
+calculates the squared frobenius norm of a low-rank matrix, ||F^T*F||^2 - 2*sum(shift*|F|^2) + |shift|^2
+@param W: the low-rank matrix, N*N
+@return double: the sum of the squares of its entries
+*/
+static double lowrank_squared_norm(const lowrank_t* W)
+{
+    int i,a,b;
+    int rank = W->factor->cols;
+    double sum = 0, value, row_squares;
+
+    for(a=0;a<rank;a++)
+    {
+        for(b=0;b<rank;b++)
+        {
+            value = 0;
+            for(i=0;i<W->n;i++)
+            {
+                value += MATRIX_AT(W->factor, i, a) * MATRIX_AT(W->factor, i, b);
+            }
+            sum += value * value;
+        }
+    }
+    for(i=0;i<W->n;i++)
+    {
+        row_squares = 0;
+        for(a=0;a<rank;a++)
+        {
+            row_squares += MATRIX_AT(W->factor, i, a) * MATRIX_AT(W->factor, i, a);
+        }
+        sum += W->shift[i] * W->shift[i] - 2 * W->shift[i] * row_squares;
+    }
+    return sum;
+}
+
+/*
+symnmf_product_t over a low-rank matrix
+*/
+static void lowrank_product(const void* W, const matrix_t* H, matrix_t* result_matrix, double* scratch)
+{
+    lowrank_multiplication((const lowrank_t*)W, H, result_matrix, scratch);
+}
+
+/*
+calculates the symnmf matrix of a low-rank norm matrix, see factorize
+every W*H costs O(N*rank*k) instead of O(N^2*k)
+@param W: the low-rank norm matrix, N*N, see calc_norm_nystrom
+@param H_init: the initial H matrix, N*k, left unchanged
+@param params: the parameters, NULL for the defaults
+@param report: filled with the iterations run if not NULL, freed with symnmf_report_free
+@return matrix_t*: the symnmf matrix
+*/
+matrix_t* calc_symnmf_lowrank(const lowrank_t* W, const matrix_t* H_init, const symnmf_params_t* params, symnmf_report_t* report)
+{
+    return factorize(W, lowrank_product, lowrank_scratch(W, H_init->cols), report != NULL ? lowrank_squared_norm(W) : 0, H_init, params, report);
+}
+
+/*
+calculates the symnmf matrix of a low-rank norm matrix from the seeded random H of symnmf_random_H,
+see calc_symnmf_random; the mean of W is taken from its low-rank form as well, as
+(1^T*F)*(F^T*1) - sum(shift), without the cut at zero of lowrank_multiplication
+@param W: the low-rank norm matrix, N*N, see calc_norm_nystrom
+@param k: the number of columns of H
+@param seed: the seed of the initial H, below 2^32
+@param params: the parameters, NULL for the defaults
+@param report: filled with the iterations run if not NULL, freed with symnmf_report_free
+@return matrix_t*: the symnmf matrix, NULL if allocation failed
+*/
+matrix_t* calc_symnmf_random_lowrank(const lowrank_t* W, int k, unsigned long seed, const symnmf_params_t* params, symnmf_report_t* report)
+{
+    int i,a;
+    int rank = W->factor->cols;
+    double total = 0;
+    double* column_sums = calloc((size_t)(rank > 0 ? rank : 1), sizeof(double));
+    matrix_t* H_init = NULL;
+    matrix_t* H = NULL;
+
+    if(column_sums == NULL) /* Memory allocation failed */
+    {
+        printf("An Error Has Occured");
+        return NULL;
+    }
+    for(i=0;i<W->n;i++)
+    {
+        for(a=0;a<rank;a++)
+        {
+            column_sums[a] += MATRIX_AT(W->factor, i, a);
+        }
+        total -= W->shift[i];
+    }
+    for(a=0;a<rank;a++)
+    {
+        total += column_sums[a] * column_sums[a];
+    }
+    free(column_sums);
+    if((H_init = symnmf_random_H(W->n, k, total / ((double)W->n * W->n), seed)) != NULL)
+    {
+        H = calc_symnmf_lowrank(W, H_init, params, report);
+    }
+    matrix_destroy(H_init);
+    return H;
+}
+
+#ifdef SYMNMF_X86_SIMD
+/*
+AVX2 squared euclidean distance, four lanes of partial sums over the dimensions
+@param vec1: the first vector
+@param vec2: the second vector
+@param d: the number of dimensions
+@return double: the squared distance
+*/
+__attribute__((target("avx2,fma")))
+static double squared_distance_avx2(const double* vec1, const double* vec2, int d)
+{
+    int p;
+    double lanes[4];
+    double sum;
+    __m256d diff, acc = _mm256_setzero_pd();
+
+    for(p=0;p+4<=d;p+=4)
+    {
+        diff = _mm256_sub_pd(_mm256_loadu_pd(vec1 + p), _mm256_loadu_pd(vec2 + p));
+        acc = _mm256_fmadd_pd(diff, diff, acc);
+    }
+    _mm256_storeu_pd(lanes, acc);
+    sum = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+    for(;p<d;p++)
+    {
+        sum += (vec1[p] - vec2[p]) * (vec1[p] - vec2[p]);
+    }
+    return sum;
+}
+
+/*
+AVX-512 squared euclidean distance, eight lanes of partial sums over the dimensions
+@param vec1: the first vector
+@param vec2: the second vector
+@param d: the number of dimensions
+@return double: the squared distance
+*/
+__attribute__((target("avx512f")))
+static double squared_distance_avx512(const double* vec1, const double* vec2, int d)
+{
+    int p;
+    double sum;
+    __m512d diff, acc = _mm512_setzero_pd();
+
+    for(p=0;p+8<=d;p+=8)
+    {
+        diff = _mm512_sub_pd(_mm512_loadu_pd(vec1 + p), _mm512_loadu_pd(vec2 + p));
+        acc = _mm512_fmadd_pd(diff, diff, acc);
+    }
+    sum = _mm512_reduce_add_pd(acc);
+    for(;p<d;p++)
+    {
+        sum += (vec1[p] - vec2[p]) * (vec1[p] - vec2[p]);
+    }
+    return sum;
+}
+#endif
+
+/*
+calculates the squared euclidean distance between two vectors with the widest kernel selected by simd_select
+@param vec1: the first vector
+@param vec2: the second vector
+@param d: the number of dimensions
+@return double: the squared distance
+*/
+static double squared_distance(const double* vec1, const double* vec2, int d)
+{
+    int p;
+    double sum = 0;
+
+#ifdef SYMNMF_X86_SIMD
+    if(simd_level == SIMD_AVX512) return squared_distance_avx512(vec1, vec2, d);
+    if(simd_level == SIMD_AVX2) return squared_distance_avx2(vec1, vec2, d);
+#endif
+    for(p=0;p<d;p++)
+    {
+        sum += (vec1[p] - vec2[p]) * (vec1[p] - vec2[p]);
+    }
+    return sum;
+}
+
+/*
+sets the parameters of kmeans to the defaults of kmeans.py: the first k vectors as the initial
+centroids, at most KMEANS_MAX_ITER iterations and convergence once no centroid moves KMEANS_EPS
+@param params: the parameters to be set
+@return void
+*/
+void kmeans_params_default(kmeans_params_t* params)
+{
+    params->max_iter = KMEANS_MAX_ITER;
+    params->eps = KMEANS_EPS;
+    params->init = KMEANS_INIT_FIRST;
+    params->seed = 1234;
+}
+
+static const char* kmeans_init_names[] = {"first", "kmeans++"};
+
+/*
+finds an initialization of kmeans by its name
+@param name: the name of the initialization: first or kmeans++
+@return int: the KMEANS_INIT_* constant of the initialization, -1 if there is none by that name
+*/
+int kmeans_init_id(const char* name)
+{
+    int init;
+    for(init=0;init<(int)(sizeof(kmeans_init_names)/sizeof(kmeans_init_names[0]));init++)
+    {
+        if(!strcmp(name, kmeans_init_names[init])) return init;
+    }
+    return -1;
+}
+
+/*
+assigns every vector to its closest centroid, the first of the closest ones on a tie as kmeans.py
+the distances are compared after the square root, as np.linalg.norm gives them
+@param vectors: the matrix of vectors, one vector per row
+@param centroids: the k*d matrix of the centroids
+@param labels: the N labels, set to the index of the closest centroid
+@return void
+*/
+static void kmeans_assign(const matrix_t* vectors, const matrix_t* centroids, int* labels)
+{
+    int i,c,best;
+    double distance, closest;
+
+#pragma omp parallel for schedule(static) private(c, best, distance, closest)
+    for(i=0;i<vectors->rows;i++)
+    {
+        best = 0;
+        closest = sqrt(squared_distance(MATRIX_ROW(vectors, i), MATRIX_ROW(centroids, 0), vectors->cols));
+        for(c=1;c<centroids->rows;c++)
+        {
+            distance = sqrt(squared_distance(MATRIX_ROW(vectors, i), MATRIX_ROW(centroids, c), vectors->cols));
+            if(distance < closest)
+            {
+                closest = distance;
+                best = c;
+            }
+        }
+        labels[i] = best;
+    }
+}
+
+/*
+moves every centroid to the mean of the vectors assigned to it, and an empty cluster's centroid to zero
+every centroid is summed by one thread in the order of the vectors, so the result does not depend on the threads
+@param vectors: the matrix of vectors, one vector per row
+@param labels: the N labels
+@param centroids: the k*d matrix of the centroids, updated in place
+@param means: a k*d matrix the new centroids are summed in
+@param eps: the bound on the move of a centroid at convergence
+@return int: 1 if no centroid moved eps or more, 0 otherwise
+*/
+static int kmeans_update(const matrix_t* vectors, const int* labels, matrix_t* centroids, matrix_t* means, double eps)
+{
+    int i,c,p,count,moved = 0;
+    int d = vectors->cols;
+    double move;
+    double* centroid;
+    double* mean;
+
+#pragma omp parallel for schedule(dynamic, 1) private(i, p, count, move, centroid, mean) reduction(|:moved)
+    for(c=0;c<centroids->rows;c++)
+    {
+        centroid = MATRIX_ROW(centroids, c);
+        mean = MATRIX_ROW(means, c);
+        memset(mean, 0, (size_t)d * sizeof(double));
+        count = 0;
+        for(i=0;i<vectors->rows;i++)
+        {
+            if(labels[i] != c) continue;
+            for(p=0;p<d;p++)
+            {
+                mean[p] += MATRIX_AT(vectors, i, p);
+            }
+            count++;
+        }
+        move = 0;
+        for(p=0;p<d;p++)
+        {
+            if(count > 0) mean[p] /= count;
+            move += (mean[p] - centroid[p]) * (mean[p] - centroid[p]);
+            centroid[p] = mean[p];
+        }
+        moved |= sqrt(move) >= eps;
+    }
+    return !moved;
+}
+
+/*
+picks k initial centroids out of the vectors by k-means++ seeding: the first uniformly, every next one
+with a probability proportional to its squared distance to the closest centroid picked so far
+the distances are summed in the order of the vectors, so the choice depends only on the seed
+@param vectors: the matrix of vectors, one vector per row
+@param centroids: the k*d matrix the centroids are copied to
+@param seed: the seed of the choice, below 2^32
+@return int: 0 on success, 1 if allocation failed
+*/
+static int kmeans_plusplus(const matrix_t* vectors, matrix_t* centroids, unsigned long seed)
+{
+    int i,c,pick;
+    int N = vectors->rows;
+    double total, target, distance;
+    double* closest;
+    mt19937_t mt;
+
+    if((closest = malloc((size_t)N * sizeof(double))) == NULL) /* Memory allocation failed */
+    {
+        printf("An Error Has Occured");
+        return 1;
+    }
+    mt19937_seed(&mt, seed);
+    pick = (int)(mt19937_double(&mt) * N);
+    for(c=0;c<centroids->rows;c++)
+    {
+        memcpy(MATRIX_ROW(centroids, c), MATRIX_ROW(vectors, pick), (size_t)vectors->cols * sizeof(double));
+        if(c == centroids->rows - 1) break;
+#pragma omp parallel for schedule(static) private(distance)
+        for(i=0;i<N;i++)
+        {
+            distance = squared_distance(MATRIX_ROW(vectors, i), MATRIX_ROW(centroids, c), vectors->cols);
+            if(c == 0 || distance < closest[i]) closest[i] = distance;
+        }
+        total = 0;
+        for(i=0;i<N;i++)
+        {
+            total += closest[i];
+        }
+        /* the vector the target falls on, the last one with a positive distance if round-off overshoots */
+        target = mt19937_double(&mt) * total;
+        for(i=0;i<N;i++)
+        {
+            if(closest[i] <= 0) continue;
+            pick = i;
+            if((target -= closest[i]) < 0) break;
+        }
+    }
+    free(closest);
+    return 0;
+}
+
+/*
+clusters vectors by k-means, with the semantics of kmeans.py
+every iteration assigns every vector to its closest centroid and moves every centroid to the mean of its
+vectors; it stops after max_iter iterations or once no centroid moved eps; the labels are then those of
+the final centroids, the ones analysis.py used to find in a second pass
+@param vectors: the matrix of vectors, one vector per row
+@param k: the number of clusters, at most N
+@param params: the parameters of kmeans, NULL for kmeans_params_default
+@param labels: the N labels, set to the index of the closest final centroid
+@param iterations: set to the number of iterations run if not NULL
+@return matrix_t*: the k*d matrix of the centroids, NULL if allocation failed
+*/
+matrix_t* calc_kmeans(const matrix_t* vectors, int k, const kmeans_params_t* params, int* labels, int* iterations)
+{
+    int c,iteration,converged = 0;
+    kmeans_params_t defaults;
+    matrix_t* centroids;
+    matrix_t* means;
+
+    if(params == NULL)
+    {
+        kmeans_params_default(&defaults);
+        params = &defaults;
+    }
+    if(simd_level < 0) simd_select(-1); /* before the kernels run in parallel */
+    if((centroids = matrix_create(k, vectors->cols)) == NULL) return NULL; /* Memory allocation failed */
+    if((means = matrix_create(k, vectors->cols)) == NULL ||
+       (params->init == KMEANS_INIT_PLUSPLUS && kmeans_plusplus(vectors, centroids, params->seed) != 0))
+    {
+        matrix_destroy(means);
+        matrix_destroy(centroids);
+        return NULL;
+    }
+    for(c=0;c<k && params->init != KMEANS_INIT_PLUSPLUS;c++)
+    {
+        memcpy(MATRIX_ROW(centroids, c), MATRIX_ROW(vectors, c), (size_t)vectors->cols * sizeof(double));
+    }
+
+    for(iteration=0;iteration<params->max_iter && !converged;iteration++)
+    {
+        kmeans_assign(vectors, centroids, labels);
+        converged = kmeans_update(vectors, labels, centroids, means, params->eps);
+    }
+    kmeans_assign(vectors, centroids, labels);
+    matrix_destroy(means);
+    if(iterations != NULL) *iterations = iteration;
+    return centroids;
+}
+
+/*
+calculates the silhouette of every row of a block of vectors under several labelings from one pass over
+their distances to all the vectors: the distance blocks are summed per cluster of every labeling, then
+s = (b - a)/max(a, b), a being the mean distance to the rest of its own cluster and b the smallest mean
+distance to another cluster; s is 0 in a cluster of one, as in sklearn, and without another cluster
+@param rows: the matrix the vectors of the block are rows of
+@param row_norms: the squared norms of the rows of rows
+@param row_index: the index among all the vectors of every row of rows, NULL if it is the same
+@param first: the first row of the block
+@param count: the number of rows of the block, at most SYMMATRIX_TILE
+@param transposed: all the vectors from transpose_vectors
+@param norms: the squared norms of all the vectors
+@param labels: sets arrays of N labels in [0, clusters)
+@param sizes: sets arrays of the clusters sizes of the labels
+@param sets: the number of labelings
+@param clusters: one more than the largest label
+@param sums: sets*SYMMATRIX_TILE*clusters doubles of scratch
+@param block: SYMMATRIX_TILE*SYMMATRIX_TILE doubles of scratch
+@param values: the silhouettes, sets arrays of one per row of rows
+@return void
+*/
+static void silhouette_rows(const matrix_t* rows, const double* row_norms, const int* row_index, int first, int count,
+                            const matrix_t* transposed, const double* norms, const int* const* labels,
+                            int* const* sizes, int sets, int clusters, double* sums, double* block, double** values)
+{
+    int r,c,J,cols,i,set,own,other;
+    int N = transposed->cols, T = SYMMATRIX_TILE;
+    double distance, a, b, mean;
+    double* row_sums;
+
+    memset(sums, 0, (size_t)sets * (size_t)T * (size_t)clusters * sizeof(double));
+    for(J=0;J<N;J+=T)
+    {
+        cols = (N - J < T) ? N - J : T;
+        distance_block(rows, row_norms + first, first, count, transposed->data + J, (size_t)transposed->stride,
+                       norms + J, cols, block, (size_t)T);
+        for(r=0;r<count;r++)
+        {
+            i = (row_index == NULL) ? first + r : row_index[first + r];
+            for(c=0;c<cols;c++)
+            {
+                distance = (i == J + c) ? 0 : sqrt(block[r*T + c]);
+                for(set=0;set<sets;set++)
+                {
+                    sums[((size_t)set*T + r)*clusters + labels[set][J + c]] += distance;
+                }
+            }
+        }
+    }
+    for(r=0;r<count;r++)
+    {
+        i = (row_index == NULL) ? first + r : row_index[first + r];
+        for(set=0;set<sets;set++)
+        {
+            row_sums = sums + ((size_t)set*T + r)*clusters;
+            own = labels[set][i];
+            if(sizes[set][own] < 2)
+            {
+                values[set][first + r] = 0;
+                continue;
+            }
+            a = row_sums[own] / (sizes[set][own] - 1);
+            b = -1;
+            for(other=0;other<clusters;other++)
+            {
+                if(other == own || sizes[set][other] == 0) continue;
+                mean = row_sums[other] / sizes[set][other];
+                if(b < 0 || mean < b) b = mean;
+            }
+            /* no other cluster in use, or every distance zero */
+            values[set][first + r] = (b >= 0 && (a > b ? a : b) > 0) ? (b - a) / (a > b ? a : b) : 0;
+        }
+    }
+}
+
+/*
+calculates the mean silhouette of several labelings of the same vectors, blocked and threaded
+every block of SYMMATRIX_TILE rows is scored by one thread against all the vectors, one distance_block at a
+time, so the O(N^2) distances are never stored and are shared by all the labelings; with sample the mean is
+estimated from that many rows drawn without replacement, each still scored against all the vectors
+@param vectors: the matrix of vectors, one vector per row
+@param transposed: the vectors from transpose_vectors
+@param norms: the squared norms of the vectors
+@param labels: sets arrays of N labels in [0, clusters), with at least 2 clusters in use
+@param sets: the number of labelings
+@param clusters: one more than the largest label
+@param sample: the number of rows of the estimate, 0 or at least N for the exact score
+@param seed: the seed of the choice of the rows, below 2^32
+@param scores: set to the mean silhouette of every labeling
+@return int: 0 on success, 1 if allocation failed
+*/
+static int silhouette_scores(const matrix_t* vectors, const matrix_t* transposed, const double* norms,
+                             const int* const* labels, int sets, int clusters, int sample, unsigned long seed, double* scores)
+{
+    int i,set,first,failed = 0;
+    int N = vectors->rows, m = (sample > 0 && sample < N) ? sample : N;
+    int* order = NULL;
+    int** sizes;
+    double* sums;
+    double* gathered_norms = NULL;
+    double** values;
+    double block[SYMMATRIX_TILE * SYMMATRIX_TILE];
+    matrix_t* gathered = NULL;
+
+    if((sizes = calloc((size_t)sets, sizeof(int*))) == NULL || (values = calloc((size_t)sets, sizeof(double*))) == NULL)
+    {
+        printf("An Error Has Occured");
+        free(sizes);
+        return 1;
+    }
+    for(set=0;set<sets;set++)
+    {
+        sizes[set] = calloc((size_t)clusters, sizeof(int));
+        values[set] = malloc((size_t)m * sizeof(double));
+        if(sizes[set] == NULL || values[set] == NULL) failed = 1;
+    }
+    /* the sampled rows are gathered so the gemm reads them in order */
+    if(!failed && m < N && ((order = sample_landmarks(N, m, seed)) == NULL ||
+       (gathered = matrix_create(m, vectors->cols)) == NULL || (gathered_norms = malloc((size_t)m * sizeof(double))) == NULL))
+    {
+        failed = 1;
+    }
+    for(i=0;!failed && gathered != NULL && i<m;i++)
+    {
+        memcpy(MATRIX_ROW(gathered, i), MATRIX_ROW(vectors, order[i]), (size_t)vectors->cols * sizeof(double));
+        gathered_norms[i] = norms[order[i]];
+    }
+
+    if(!failed)
+    {
+        for(set=0;set<sets;set++)
+        {
+            for(i=0;i<N;i++)
+            {
+                sizes[set][labels[set][i]]++;
+            }
+        }
+#pragma omp parallel private(sums, block) reduction(|:failed)
+        {
+            sums = malloc((size_t)sets * SYMMATRIX_TILE * (size_t)clusters * sizeof(double));
+            failed = (sums == NULL);
+#pragma omp for schedule(dynamic, 1)
+            for(first=0;first<m;first+=SYMMATRIX_TILE)
+            {
+                if(sums == NULL) continue;
+                silhouette_rows((gathered != NULL) ? gathered : vectors, (gathered != NULL) ? gathered_norms : norms, order,
+                                first, (m - first < SYMMATRIX_TILE) ? m - first : SYMMATRIX_TILE,
+                                transposed, norms, labels, sizes, sets, clusters, sums, block, values);
+            }
+            free(sums);
+        }
+        /* summed in the order of the rows, so the scores do not depend on the threads */
+        for(set=0;set<sets;set++)
+        {
+            scores[set] = 0;
+            for(i=0;i<m;i++)
+            {
+                scores[set] += values[set][i];
+            }
+            scores[set] /= m;
+        }
+    }
+    if(failed) printf("An Error Has Occured"); /* Memory allocation failed */
+
+    for(set=0;set<sets;set++)
+    {
+        free(sizes[set]);
+        free(values[set]);
+    }
+    free(sizes);
+    free(values);
+    free(gathered_norms);
+    matrix_destroy(gathered);
+    free(order);
+    return failed;
+}
+
+/*
+calculates the mean silhouette of several labelings of the same vectors, as sklearn's silhouette_score with
+the euclidean metric, see silhouette_scores
+@param vectors: the matrix of vectors, one vector per row
+@param labels: sets arrays of N labels in [0, clusters), with at least 2 clusters in use
+@param sets: the number of labelings
+@param clusters: one more than the largest label
+@param sample: the number of rows of a sampled estimate, 0 for the exact score
+@param seed: the seed of the choice of the rows, below 2^32
+@param scores: set to the mean silhouette of every labeling
+@return int: 0 on success, 1 if allocation failed
+*/
+int calc_silhouette(const matrix_t* vectors, const int* const* labels, int sets, int clusters, int sample,
+                    unsigned long seed, double* scores)
+{
+    int failed = 1;
+    double* norms;
+    matrix_t* transposed;
+
+    if((norms = malloc((size_t)vectors->rows * sizeof(double))) == NULL) /* Memory allocation failed */
+    {
+        printf("An Error Has Occured");
+        return 1;
+    }
+    if((transposed = transpose_vectors(vectors, NULL, vectors->rows, norms)) != NULL)
+    {
+        failed = silhouette_scores(vectors, transposed, norms, labels, sets, clusters, sample, seed, scores);
+    }
+    matrix_destroy(transposed);
+    free(norms);
+    return failed;
+}
+
+/*
+compares the clusterings of symnmf and k-means of the same vectors by their silhouettes, as analysis.py
+symnmf runs on the dense norm matrix from the H of calc_symnmf_random, its labels being the column of the
+largest entry of every row of H; k-means runs as calc_kmeans from the first k vectors; the transposed
+vectors and squared norms the affinities are built from are kept for the distances of the silhouettes,
+which score both labelings in one pass
+@param vectors: the matrix of vectors, one vector per row
+@param k: the number of clusters, at least 2 and less than N
+@param seed: the seed of the initial H of symnmf and of the sampled rows, below 2^32
+@param params: the parameters of symnmf, NULL for the defaults
+@param sample: the number of rows of a sampled estimate of the silhouettes, 0 for the exact scores
+@param symnmf_labels: set to the N labels of symnmf
+@param kmeans_labels: set to the N labels of k-means
+@param scores: set to the silhouettes of symnmf and of k-means, in that order
+@return int: 0 on success, 1 if allocation failed
+*/
+int calc_analysis(const matrix_t* vectors, int k, unsigned long seed, const symnmf_params_t* params, int sample,
+                  int* symnmf_labels, int* kmeans_labels, double* scores)
+{
+    int i,j,failed = 1;
+    int N = vectors->rows;
+    const int* labels[2];
+    double* norms;
+    double* degrees = NULL;
+    matrix_t* transposed;
+    matrix_t* H = NULL;
+    matrix_t* centroids = NULL;
+    symmatrix_t* W = NULL;
+
+    if((norms = malloc((size_t)N * sizeof(double))) == NULL) /* Memory allocation failed */
+    {
+        printf("An Error Has Occured");
+        return 1;
+    }
+    if((degrees = malloc((size_t)N * sizeof(double))) == NULL) /* Memory allocation failed */
+    {
+        printf("An Error Has Occured");
+        free(norms);
+        return 1;
+    }
+    if((transposed = transpose_vectors(vectors, NULL, N, norms)) != NULL && (W = symmatrix_create(N)) != NULL)
+    {
+        /* the norm matrix as calc_norm builds it */
+        affinity_tiles(W, vectors, transposed, norms, 0, (long)W->tiles * (W->tiles + 1) / 2);
+        symmatrix_row_sums(W, degrees);
+        normalize_affinity(W, degrees);
+        if((H = calc_symnmf_random(W, k, seed, params, NULL)) != NULL)
+        {
+            for(i=0;i<N;i++)
+            {
+                symnmf_labels[i] = 0;
+                for(j=1;j<k;j++)
+                {
+                    if(MATRIX_AT(H, i, j) > MATRIX_AT(H, i, symnmf_labels[i])) symnmf_labels[i] = j;
+                }
+            }
+        }
+        /* W is no longer needed, the silhouettes only need the vectors */
+        symmatrix_destroy(W);
+        W = NULL;
+        if(H != NULL && (centroids = calc_kmeans(vectors, k, NULL, kmeans_labels, NULL)) != NULL)
+        {
+            labels[0] = symnmf_labels;
+            labels[1] = kmeans_labels;
+            failed = silhouette_scores(vectors, transposed, norms, labels, 2, k, sample, seed, scores);
+        }
+    }
+    matrix_destroy(centroids);
+    matrix_destroy(H);
+    symmatrix_destroy(W);
+    free(degrees);
+    matrix_destroy(transposed);
+    free(norms);
+    return failed;
+}
+
+/*
+copies a packed symmetric matrix into a new pointer-of-rows matrix
+@param mat: the packed symmetric matrix
+@return double**: the pointer-of-rows copy, NULL if allocation failed
+*/
+static double** symmatrix_to_rows(const symmatrix_t* mat)
+{
+    int i,j;
+    double** rows = NULL;
+    if((rows = matrix_malloc(rows, mat->n, mat->n)) == NULL) return NULL; /* Memory allocation failed */
+
+    for(i=0;i<mat->n;i++)
+    {
+        for(j=0;j<mat->n;j++)
+        {
+            rows[i][j] = *symmatrix_entry(mat, i, j);
+        }
+    }
+    return rows;
+}
+
+/*
+runs one of the symmetric matrix goals on a pointer-of-rows matrix
+@param goal: calc_sym or calc_norm
+@param vectors: the matrix of vectors
+@param N: the number of rows
+@param vecdim: the number of dimensions
+@return double**: the goal matrix, NULL if allocation failed
+*/
+static double** vectors_goal_adapter(symmatrix_t* (*goal)(const matrix_t*), double** vectors, int N, int vecdim)
+{
+    double** result = NULL;
+    symmatrix_t* goal_matrix;
+    matrix_t* vectors_matrix = matrix_from_rows(vectors, N, vecdim);
+    if(vectors_matrix == NULL) return NULL; /* Memory allocation failed */
+
+    goal_matrix = goal(vectors_matrix);
+    matrix_destroy(vectors_matrix);
+    if(goal_matrix == NULL) return NULL; /* Memory allocation failed */
+
+    result = symmatrix_to_rows(goal_matrix);
+    symmatrix_destroy(goal_matrix);
+    return result;
+}
+
+/*
+calculates the symilarity matrix of a matrix of doubles
+@param vectors: the matrix of vectors
+@param N: the number of rows
+@param vecdim: the number of dimensions
+@return double**: the symilarity matrix
+*/
+double** sym(double** vectors, int N, int vecdim)
+{
+    return vectors_goal_adapter(calc_sym, vectors, N, vecdim);
+}
+
+/*
+calculates the ddg matrix of a matrix of doubles
+@param vectors: the matrix of vectors
+@param N: the number of rows
+@param vecdim: the number of dimensions
+@return double**: the ddg matrix
+*/
+double** ddg(double** vectors, int N, int vecdim)
+{
+    int i,j;
+    double** result = NULL;
+    double* ddg_vector;
+    matrix_t* vectors_matrix = matrix_from_rows(vectors, N, vecdim);
+    if(vectors_matrix == NULL) return NULL; /* Memory allocation failed */
+
+    ddg_vector = calc_ddg(vectors_matrix);
+    matrix_destroy(vectors_matrix);
+    if(ddg_vector == NULL) return NULL; /* Memory allocation failed */
+
+    if((result = matrix_malloc(result, N, N)) != NULL)
+    {
+        for(i=0;i<N;i++)
+        {
+            for(j=0;j<N;j++)
+            {
+                result[i][j] = (i == j) ? ddg_vector[i] : 0;
+            }
+        }
+    }
+    free(ddg_vector);
+    return result;
+}
+
+/*
+calculates the norm matrix of a matrix of doubles
+@param vectors: the matrix of vectors
+@param N: the number of rows
+@param vecdim: the number of dimensions
+@return double**: the norm matrix
+*/
+double** norm(double** vectors, int N, int vecdim)
+{
+    return vectors_goal_adapter(calc_norm, vectors, N, vecdim);
+}
+
+/*
+calculates the symnmf matrix of a matrix of doubles using norm and H matrices
+@param W: the norm matrix
+@param H: the H matrix
+@param N: the number of rows
+@param k: the number of columns
+@return double**: the symnmf matrix
+*/
+double** symnmf(double** W, double** H, int N, int k)
+{
+    int i,j;
+    double** result = NULL;
+    matrix_t* final_H = NULL;
+    symmatrix_t* W_matrix = symmatrix_create(N);
+    matrix_t* H_matrix = matrix_from_rows(H, N, k);
+
+    if(W_matrix != NULL && H_matrix != NULL)
+    {
+        for(i=0;i<N;i++)
+        {
+            for(j=i;j<N;j++)
+            {
+                *symmatrix_entry(W_matrix, i, j) = W[i][j];
+                *symmatrix_entry(W_matrix, j, i) = W[i][j];
+            }
+        }
+        final_H = calc_symnmf(W_matrix, H_matrix, NULL, NULL);
+    }
+    symmatrix_destroy(W_matrix);
+    matrix_destroy(H_matrix);
+    if(final_H == NULL) return NULL; /* Memory allocation failed */
+
+    result = matrix_to_rows(final_H);
+    matrix_destroy(final_H);
+    return result;
+}
+
+/*
+function to duplicate a string
+@param src: the string to be duplicated
+@return char*: the duplicated string
+ */
+char* duplicateString(char* src)
+{
+    char* str;
+    char* p;
+    int len = 0;
+
+    if(src == NULL)
+    {
+        printf("An error has occured");
+        return NULL;
+    }
+
+    while (src[len])
+        len++;
+    str = malloc(len + 1);
+    p = str;
+    while (*src)
+        *p++ = *src++;
+    *p = '\0';
+    return str;
+}
+
+/* exact powers of ten, every one of them is a double without rounding */
+static const double exact_powers_of_ten[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+/*
+parses a decimal floating point number at the start of a bounded, not terminated buffer
+numbers of up to 15 significant digits with a power of ten up to 22 (all of the 4 decimal
+inputs) take Clinger's fast path: the digits and the power of ten are both exact doubles, so
+a single multiplication or division gives the correctly rounded value; anything else is
+handed to strtod, so the result is always the same as strtod's
+@param p: the first character of the number
+@param end: the end of the buffer
+@param value: the parsed number is written here
+@return const char*: the first character after the number, NULL if there is no number at p
+*/
+static const char* parse_double(const char* p, const char* end, double* value)
+{
+    const char* start = p;
+    int negative = 0, digits = 0, any = 0, exact = 1;
+    int exponent = 0, exp_negative = 0, exp_value = 0;
+    double mantissa = 0;
+    char small[64];
+    char* token;
+    size_t length;
+
+    if(p < end && (*p == '-' || *p == '+')) negative = (*p++ == '-');
+    for(;p < end && *p >= '0' && *p <= '9';p++)
+    {
+        any = 1;
+        if(mantissa != 0 || *p != '0')
+        {
+            if(++digits > 15) exact = 0;
+            mantissa = mantissa * 10 + (*p - '0');
+        }
+    }
+    if(p < end && *p == '.')
+    {
+        for(p++;p < end && *p >= '0' && *p <= '9';p++)
+        {
+            any = 1;
+            if(mantissa != 0 || *p != '0')
+            {
+                if(++digits > 15) exact = 0;
+            }
+            mantissa = mantissa * 10 + (*p - '0');
+            exponent--;
+        }
+    }
+    if(!any) return NULL;
+    if(p < end && (*p == 'e' || *p == 'E'))
+    {
+        p++;
+        if(p < end && (*p == '-' || *p == '+')) exp_negative = (*p++ == '-');
+        if(p == end || *p < '0' || *p > '9') return NULL;
+        for(;p < end && *p >= '0' && *p <= '9';p++)
+        {
+            if(exp_value < 10000) exp_value = exp_value * 10 + (*p - '0');
+        }
+        exponent += exp_negative ? -exp_value : exp_value;
+    }
+
+    if(exact && exponent >= -22 && exponent <= 22)
+    {
+        mantissa = (exponent < 0) ? mantissa / exact_powers_of_ten[-exponent] : mantissa * exact_powers_of_ten[exponent];
+        *value = negative ? -mantissa : mantissa;
+        return p;
+    }
+
+    /* slow path, strtod needs a terminated copy of the number */
+    length = (size_t)(p - start);
+    token = (length < sizeof(small)) ? small : malloc(length + 1);
+    if(token == NULL)
+    {
+        printf("An Error Has Occured");
+        return NULL;
+    }
+    memcpy(token, start, length);
+    token[length] = '\0';
+    *value = strtod(token, NULL);
+    if(token != small) free(token);
+    return p;
+}
+
+/*
+maps a whole file into memory for reading, or reads it into a buffer where mapping fails
+the mapping is read only and shared, so it is backed by the file itself and is not charged against
+RAM and swap however large the file is; its contents must never be written to
+@param filename: the name of the file
+@param size: the size of the file is written here
+@param mapped: set to 1 if the contents are mapped, 0 if they were read
+@param fallback: 1 to read the file into a buffer where mapping fails, 0 to fail instead, for files
+that may be larger than memory; files are always read where there is no mmap
+@return char*: the contents of the file, released with unmap_file, NULL if it could not be read
+*/
+static char* map_file(const char* filename, size_t* size, int* mapped, int fallback)
+{
+    char* text = NULL;
+    FILE* file;
+    long length;
+#ifdef SYMNMF_HAVE_MMAP
+    struct stat info;
+    int fd = open(filename, O_RDONLY);
+
+    if(fd >= 0 && fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0)
+    {
+        text = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if(text != MAP_FAILED)
+        {
+            /* the file is read front to back once, let the kernel read ahead */
+            posix_madvise(text, (size_t)info.st_size, POSIX_MADV_SEQUENTIAL);
+            close(fd);
+            *size = (size_t)info.st_size;
+            *mapped = 1;
+            return text;
+        }
+        text = NULL;
+    }
+    if(fd >= 0) close(fd);
+    if(!fallback)
+    {
+        fprintf(stderr, "%s: could not be mapped\n", filename);
+        return NULL;
+    }
+#else
+    (void)fallback;
+#endif
+
+    *mapped = 0;
+    if((file = fopen(filename, "rb")) == NULL)
+    {
+        perror("Error opening file");
+        return NULL;
+    }
+    if(fseek(file, 0, SEEK_END) != 0 || (length = ftell(file)) < 0 || fseek(file, 0, SEEK_SET) != 0)
+    {
+        perror("Error reading file");
+        fclose(file);
+        return NULL;
+    }
+    if((text = malloc((size_t)length + 1)) == NULL)
+    {
+        printf("An Error Has Occured");
+        fclose(file);
+        return NULL;
+    }
+    *size = fread(text, 1, (size_t)length, file);
+    fclose(file);
+    return text;
+}
+
+/*
+releases the contents of a file returned by map_file
+@param text: the contents
+@param size: the size of the contents
+@param mapped: the flag set by map_file
+@return void
+*/
+static void unmap_file(char* text, size_t size, int mapped)
+{
+#ifdef SYMNMF_HAVE_MMAP
+    if(mapped)
+    {
+        munmap(text, size);
+        return;
+    }
+#endif
+    (void)size;
+    (void)mapped;
+    free(text);
+}
+
+/*
+parses CSV text into a matrix of vectors, one vector per line, in a single pass
+the values are appended to a buffer that doubles when full, lines may be of any length;
+blank lines are skipped, spaces around values and \r\n line ends are accepted
+a line with a malformed value or a different number of values than the first line is reported
+on stderr with its line number
+@param text: the CSV text, not terminated
+@param size: the length of the text
+@return matrix_t*: the matrix of vectors, NULL if the text is malformed or allocation failed
+*/
+matrix_t* parse_vectors(const char* text, size_t size)
+{
+    const char* p = text;
+    const char* end = text + size;
+    const char* next;
+    int i,cols = 0,count;
+    size_t rows = 0, used = 0, capacity = 1024, line = 0;
+    double* values = malloc(capacity * sizeof(double));
+    double* grown;
+    matrix_t* matrix;
+
+    if(values == NULL)
+    {
+        printf("An Error Has Occured");
+        return NULL;
+    }
+    while(p < end)
+    {
+        line++;
+        while(p < end && (*p == ' ' || *p == '\t')) p++;
+        if(p < end && (*p == '\n' || *p == '\r'))
+        {
+            /* blank line */
+            if(*p == '\r' && p + 1 < end && p[1] == '\n') p++;
+            p++;
+            continue;
+        }
+        if(p == end) break;
+
+        for(count=0;;)
+        {
+            while(p < end && (*p == ' ' || *p == '\t')) p++;
+            if(used == capacity)
+            {
+                if((grown = realloc(values, 2 * capacity * sizeof(double))) == NULL)
+                {
+                    printf("An Error Has Occured");
+                    free(values);
+                    return NULL;
+                }
+                values = grown;
+                capacity *= 2;
+            }
+            if((next = parse_double(p, end, &values[used])) == NULL)
+            {
+                fprintf(stderr, "line %lu: malformed value %d\n", (unsigned long)line, count + 1);
+                free(values);
+                return NULL;
+            }
+            p = next;
+            used++;
+            count++;
+            while(p < end && (*p == ' ' || *p == '\t')) p++;
+            if(p < end && *p == ',')
+            {
+                p++;
+                continue;
+            }
+            if(p < end && *p == '\r' && p + 1 < end && p[1] == '\n') p++;
+            if(p == end || *p == '\n' || *p == '\r')
+            {
+                if(p < end) p++;
+                break;
+            }
+            fprintf(stderr, "line %lu: malformed value %d\n", (unsigned long)line, count);
+            free(values);
+            return NULL;
+        }
+
+        if(rows == 0) cols = count;
+        if(count != cols)
         {
-            matrix_free(nom_matrix, N);
+            fprintf(stderr, "line %lu: expected %d values, found %d\n", (unsigned long)line, cols, count);
+            free(values);
             return NULL;
         }
+        rows++;
+    }
+
+    if(rows == 0)
+    {
+        fprintf(stderr, "no vectors found\n");
+        free(values);
+        return NULL;
+    }
+    if((matrix = matrix_create((int)rows, cols)) != NULL)
+    {
+        for(i=0;i<(int)rows;i++)
+        {
+            memcpy(MATRIX_ROW(matrix, i), values + (size_t)i * cols, (size_t)cols * sizeof(double));
+        }
+    }
+    free(values);
+    return matrix;
+}
+
+/*
+read vectors from a file and store them in a matrix of doubles
+the file is memory mapped and parsed in a single pass, see parse_vectors
+@param filename: the name of the file
+@return matrix_t*: the matrix of vectors, one vector per row
+*/
+matrix_t* read_vectors_from_file(const char *filename)
+{
+    size_t size = 0;
+    int mapped;
+    char* text;
+    matrix_t* matrix;
+
+    if((text = map_file(filename, &size, &mapped, 1)) == NULL) return NULL;
+    matrix = parse_vectors(text, size);
+    unmap_file(text, size, mapped);
+    return matrix;
+}
+
+/*
+writes a 32 bit unsigned integer in little endian byte order, so headers read the same everywhere
+@param bytes: the 4 bytes to be written
+@param value: the integer
+@return void
+*/
+static void put_u32(unsigned char* bytes, unsigned long value)
+{
+    bytes[0] = (unsigned char)(value & 0xff);
+    bytes[1] = (unsigned char)((value >> 8) & 0xff);
+    bytes[2] = (unsigned char)((value >> 16) & 0xff);
+    bytes[3] = (unsigned char)((value >> 24) & 0xff);
+}
+
+/*
+reads a 32 bit unsigned integer written by put_u32
+@param bytes: the 4 bytes to be read
+@return unsigned long: the integer
+*/
+static unsigned long get_u32(const unsigned char* bytes)
+{
+    return (unsigned long)bytes[0] | ((unsigned long)bytes[1] << 8) |
+           ((unsigned long)bytes[2] << 16) | ((unsigned long)bytes[3] << 24);
+}
+
+/*
+continues a 32 bit FNV-1a checksum over a block of bytes
+@param hash: the checksum so far, BINFILE_CHECKSUM_SEED for the first block
+@param data: the block
+@param size: the length of the block
+@return unsigned long: the checksum including the block
+*/
+static unsigned long checksum_update(unsigned long hash, const void* data, size_t size)
+{
+    const unsigned char* bytes = data;
+    size_t i;
+    for(i=0;i<size;i++)
+    {
+        hash = ((hash ^ bytes[i]) * 16777619UL) & 0xffffffffUL;
+    }
+    return hash;
+}
+
+/*
+fills the BINFILE_HEADER bytes of the header of a matrix file
+@param header: the header
+@param layout: BINFILE_DENSE or BINFILE_PACKED
+@param rows: the number of rows
+@param cols: the number of columns
+@param stride: the row stride of a dense payload, the tile edge of a packed one
+@param checksum: a flag that the payload has a checksum
+@param sum: the checksum of the payload, ignored without the flag
+@return void
+*/
+static void binfile_header(unsigned char* header, int layout, int rows, int cols, int stride, int checksum, unsigned long sum)
+{
+    double byte_order = 1.0;
+
+    memset(header, 0, BINFILE_HEADER);
+    memcpy(header, BINFILE_MAGIC, 4);
+    put_u32(header + 4, BINFILE_VERSION);
+    put_u32(header + 8, BINFILE_FLOAT64);
+    put_u32(header + 12, (unsigned long)layout);
+    put_u32(header + 16, (unsigned long)rows);
+    put_u32(header + 20, (unsigned long)cols);
+    put_u32(header + 24, (unsigned long)stride);
+    put_u32(header + 28, checksum ? 1UL : 0UL);
+    put_u32(header + 32, checksum ? sum : 0UL);
+    /* a native 1.0 marks the byte order of the payload */
+    memcpy(header + BINFILE_HEADER - sizeof(double), &byte_order, sizeof(double));
+}
+
+/*
+writes a matrix file: a BINFILE_HEADER byte header followed by the payload exactly as it is laid
+out in memory, so it can be used in place once mapped
+@param filename: the name of the file
+@param layout: BINFILE_DENSE or BINFILE_PACKED
+@param rows: the number of rows
+@param cols: the number of columns
+@param stride: the row stride of a dense payload, the tile edge of a packed one
+@param data: the payload
+@param count: the number of doubles in the payload
+@param checksum: a flag to store a checksum of the payload
+@return int: 0 on success, 1 if the file could not be written
+*/
+static int binfile_write(const char* filename, int layout, int rows, int cols, int stride,
+                         const double* data, size_t count, int checksum)
+{
+    unsigned char header[BINFILE_HEADER];
+    FILE* file;
+    int failed;
+
+    binfile_header(header, layout, rows, cols, stride, checksum,
+                   checksum ? checksum_update(BINFILE_CHECKSUM_SEED, data, count * sizeof(double)) : 0UL);
+
+    if((file = fopen(filename, "wb")) == NULL)
+    {
+        perror("Error opening file");
+        return 1;
+    }
+    failed = fwrite(header, 1, sizeof(header), file) != sizeof(header) ||
+             fwrite(data, sizeof(double), count, file) != count;
+    if(fclose(file) != 0 || failed)
+    {
+        perror("Error writing file");
+        return 1;
+    }
+    return 0;
+}
+
+/*
+saves a dense matrix to a matrix file, its rows keep their padding
+@param filename: the name of the file
+@param mat: the matrix
+@param checksum: a flag to store a checksum of the payload
+@return int: 0 on success, 1 if the file could not be written
+*/
+int matrix_save(const char* filename, const matrix_t* mat, int checksum)
+{
+    int i, failed;
+    matrix_t* copy;
+
+    /* borrowed matrices may be laid out differently, write a padded copy of them */
+    if(mat->stride % (MATRIX_ALIGNMENT / (int)sizeof(double)) != 0)
+    {
+        if((copy = matrix_create(mat->rows, mat->cols)) == NULL) return 1;
+        for(i=0;i<mat->rows;i++)
+        {
+            memcpy(MATRIX_ROW(copy, i), MATRIX_ROW(mat, i), (size_t)mat->cols * sizeof(double));
+        }
+        failed = matrix_save(filename, copy, checksum);
+        matrix_destroy(copy);
+        return failed;
+    }
+    return binfile_write(filename, BINFILE_DENSE, mat->rows, mat->cols, mat->stride,
+                         mat->data, (size_t)mat->rows * (size_t)mat->stride, checksum);
+}
+
+/*
+saves a packed symmetric matrix to a matrix file, only its stored tiles are written
+@param filename: the name of the file
+@param mat: the matrix
+@param checksum: a flag to store a checksum of the payload
+@return int: 0 on success, 1 if the file could not be written
+*/
+int symmatrix_save(const char* filename, const symmatrix_t* mat, int checksum)
+{
+    size_t count = (size_t)mat->tiles * (size_t)(mat->tiles + 1) / 2 * (size_t)mat->tile * (size_t)mat->tile;
+    return binfile_write(filename, BINFILE_PACKED, mat->n, mat->n, mat->tile, mat->data, count, checksum);
+}
+
+/*
+maps a matrix file into memory and checks its header
+the payload is not copied and the mapping is read only, so a file larger than memory can be opened;
+the views of it must not be written to
+@param filename: the name of the file
+@param verify: a flag to check the checksum of the payload, if the file has one
+@return binfile_t*: the mapped file, NULL if it could not be read or is not a valid matrix file
+*/
+binfile_t* binfile_open(const char* filename, int verify)
+{
+    binfile_t* file;
+    const unsigned char* header;
+    double byte_order = 1.0;
+    size_t count, tiles, capacity;
+    int fits;
+
+    if((file = malloc(sizeof(binfile_t))) == NULL)
+    {
+        printf("An Error Has Occured");
+        return NULL;
+    }
+    if((file->base = map_file(filename, &file->size, &file->mapped, 0)) == NULL)
+    {
+        free(file);
+        return NULL;
+    }
+    header = (const unsigned char*)file->base;
+    if(file->size < BINFILE_HEADER || memcmp(header, BINFILE_MAGIC, 4) != 0 || get_u32(header + 4) != BINFILE_VERSION)
+    {
+        fprintf(stderr, "%s: not a matrix file\n", filename);
+        binfile_close(file);
+        return NULL;
+    }
+    file->layout = (int)get_u32(header + 12);
+    file->rows = (int)get_u32(header + 16);
+    file->cols = (int)get_u32(header + 20);
+    file->stride = (int)get_u32(header + 24);
+    if(get_u32(header + 8) != BINFILE_FLOAT64 || memcmp(header + BINFILE_HEADER - sizeof(double), &byte_order, sizeof(double)) != 0)
+    {
+        fprintf(stderr, "%s: unsupported element type or byte order\n", filename);
+        binfile_close(file);
+        return NULL;
+    }
+
+    /* the sizes are checked by division against what the file holds, so a forged header cannot wrap them */
+    capacity = (file->size - BINFILE_HEADER) / sizeof(double);
+    if(file->layout == BINFILE_DENSE && file->rows >= 0 && file->cols >= 0 && file->stride >= file->cols)
+    {
+        fits = file->stride == 0 || (size_t)file->rows <= capacity / (size_t)file->stride;
+        count = fits ? (size_t)file->rows * (size_t)file->stride : 0;
+    }
+    else if(file->layout == BINFILE_PACKED && file->rows >= 0 && file->rows == file->cols && file->stride > 0 &&
+            file->stride <= SYMMATRIX_TILE)
+    {
+        /* the tile edge bounds the stack buffers of the tiled kernels */
+        tiles = (size_t)((file->rows + file->stride - 1) / file->stride);
+        count = (tiles % 2 == 0) ? tiles / 2 * (tiles + 1) : (tiles + 1) / 2 * tiles;
+        fits = count <= capacity / ((size_t)file->stride * (size_t)file->stride);
+        count = fits ? count * (size_t)file->stride * (size_t)file->stride : 0;
+    }
+    else
+    {
+        fprintf(stderr, "%s: unsupported layout\n", filename);
+        binfile_close(file);
+        return NULL;
+    }
+    if(!fits)
+    {
+        fprintf(stderr, "%s: truncated payload\n", filename);
+        binfile_close(file);
+        return NULL;
+    }
+    file->data = (double*)(file->base + BINFILE_HEADER);
+    if(verify && (get_u32(header + 28) & 1UL) &&
+       checksum_update(BINFILE_CHECKSUM_SEED, file->data, count * sizeof(double)) != get_u32(header + 32))
+    {
+        fprintf(stderr, "%s: checksum mismatch\n", filename);
+        binfile_close(file);
+        return NULL;
+    }
+    return file;
+}
+
+/*
+unmaps a matrix file, the views of it must not be used any more
+@param file: the file, may be NULL
+@return void
+*/
+void binfile_close(binfile_t* file)
+{
+    if(file == NULL) return;
+    unmap_file(file->base, file->size, file->mapped);
+    free(file);
+}
+
+/*
+checks if a file starts like a matrix file
+@param filename: the name of the file
+@return int: 1 if it does, 0 otherwise
+*/
+int binfile_detect(const char* filename)
+{
+    char magic[4];
+    FILE* file = fopen(filename, "rb");
+    int found;
+    if(file == NULL) return 0;
+    found = fread(magic, 1, 4, file) == 4 && memcmp(magic, BINFILE_MAGIC, 4) == 0;
+    fclose(file);
+    return found;
+}
+
+/*
+views the payload of a dense matrix file as a matrix without copying it
+@param file: the mapped file
+@return matrix_t*: the borrowing matrix, freed with matrix_destroy before binfile_close, NULL if
+the file does not hold a dense matrix or allocation failed
+*/
+matrix_t* binfile_matrix(const binfile_t* file)
+{
+    if(file->layout != BINFILE_DENSE) return NULL;
+    return matrix_borrow(file->data, file->rows, file->cols, file->stride);
+}
+
+/*
+views the payload of a packed symmetric matrix file as a packed symmetric matrix without copying it
+@param file: the mapped file
+@return symmatrix_t*: the borrowing matrix, freed with symmatrix_destroy before binfile_close, NULL
+if the file does not hold a packed symmetric matrix or allocation failed
+*/
+symmatrix_t* binfile_symmatrix(const binfile_t* file)
+{
+    symmatrix_t* mat;
+    if(file->layout != BINFILE_PACKED) return NULL;
+    if((mat = malloc(sizeof(symmatrix_t))) == NULL)
+    {
+        printf("An Error Has Occured");
+        return NULL;
+    }
+    mat->data = file->data;
+    mat->n = file->rows;
+    mat->tile = file->stride;
+    mat->tiles = (file->rows + file->stride - 1) / file->stride;
+    mat->block = NULL;
+    return mat;
+}
+
+/*
+builds the path of the cached norm matrix of a matrix of vectors
+the name holds the dimensions and two independent 32 bit hashes (FNV-1a and djb2) of the vectors,
+together with the version of the similarity kernel, so a changed input or kernel never matches
+@param vectors: the matrix of vectors, one vector per row
+@param cache_dir: the cache directory
+@return char*: the path, NULL if allocation failed
+*/
+static char* norm_cache_path(const matrix_t* vectors, const char* cache_dir)
+{
+    int i;
+    size_t b, length = (size_t)vectors->cols * sizeof(double);
+    unsigned long fnv = BINFILE_CHECKSUM_SEED, djb = 5381;
+    const unsigned char* row;
+    char* path;
 
-        denom_matrix = matrix_multiplication(helper_matrix, H, N, N, k);
-        matrix_free(helper_matrix, N);
-        if(denom_matrix == NULL) /* Memory allocation failed */
+    for(i=0;i<vectors->rows;i++)
+    {
+        row = (const unsigned char*)MATRIX_ROW(vectors, i);
+        fnv = checksum_update(fnv, row, length);
+        for(b=0;b<length;b++)
         {
-            matrix_free(nom_matrix, N);
-            return NULL;
+            djb = ((djb * 33) ^ row[b]) & 0xffffffffUL;
         }
+    }
+    if((path = malloc(strlen(cache_dir) + 80)) == NULL)
+    {
+        printf("An Error Has Occured");
+        return NULL;
+    }
+    sprintf(path, "%s/norm-%s-%dx%d-%08lx%08lx.snmf", cache_dir, NORM_CACHE_KERNEL, vectors->rows, vectors->cols, fnv, djb);
+    return path;
+}
+
+/*
+calculates the norm matrix of a matrix of doubles, reusing the copy saved in a cache directory
+on a hit the matrix file is mapped, its checksum verified and its payload used in place; on a miss the matrix is
+calculated and saved, through a temporary file renamed into place so a reader never sees
+a partly written file; an entry whose tiles are not the ones symmatrix_create would choose is recalculated
+@param vectors: the matrix of vectors, one vector per row
+@param cache_dir: the cache directory, NULL to calculate the matrix without caching
+@param file: set to the mapped matrix file on a hit, to be closed after the matrix is destroyed,
+and to NULL otherwise
+@return symmatrix_t*: the norm matrix, NULL if allocation failed
+*/
+symmatrix_t* calc_norm_cached(const matrix_t* vectors, const char* cache_dir, binfile_t** file)
+{
+    char* path;
+    char* temp_path;
+    symmatrix_t* norm_matrix = NULL;
 
-        /* update the new_H matrix */
-        update_new_H(new_H, H, nom_matrix, denom_matrix, N, k);
+    *file = NULL;
+    if(cache_dir == NULL || *cache_dir == '\0') return calc_norm(vectors);
+    if((path = norm_cache_path(vectors, cache_dir)) == NULL) return NULL;
 
-        /* free allocated memory for next iteration */
-        matrix_free(nom_matrix, N);
-        matrix_free(denom_matrix, N);
+    if(binfile_detect(path) && (*file = binfile_open(path, 1)) != NULL)
+    {
+        if((*file)->layout == BINFILE_PACKED && (*file)->rows == vectors->rows &&
+           (*file)->stride == symmatrix_tile_size(vectors->rows))
+        {
+            norm_matrix = binfile_symmatrix(*file);
+        }
+        if(norm_matrix == NULL)
+        {
+            binfile_close(*file);
+            *file = NULL;
+        }
+    }
+    if(norm_matrix != NULL)
+    {
+        free(path);
+        return norm_matrix;
+    }
 
-        if(matrix_convergence(new_H, H, N, k) < eps)
+    if((norm_matrix = calc_norm(vectors)) != NULL && (temp_path = malloc(strlen(path) + 64)) != NULL)
+    {
+        /* unique per process and per live matrix, concurrent writers of the same entry do not collide */
+#ifdef SYMNMF_HAVE_MMAP
+        sprintf(temp_path, "%s.%ld.%p.tmp", path, (long)getpid(), (void*)norm_matrix);
+#else
+        sprintf(temp_path, "%s.%p.tmp", path, (void*)norm_matrix);
+#endif
+        if(symmatrix_save(temp_path, norm_matrix, 1) == 0)
         {
-            return new_H;
+            if(rename(temp_path, path) != 0) remove(temp_path);
         }
         else
         {
-            advance_H(H, new_H, N, k);
+            remove(temp_path);
         }
+        free(temp_path);
     }
-    return new_H;
+    free(path);
+    return norm_matrix;
 }
 
+#ifdef SYMNMF_HAVE_MMAP
 /*
-function to duplicate a string
-@param src: the string to be duplicated
-@return char*: the duplicated string
- */
-char* duplicateString(char* src)
+writes back the tiles first to last-1, in storage order, of a packed matrix in a shared mapping, without
+waiting, so they can leave memory before the rest of the matrix is done
+@param mat: the matrix
+@param first: the index of the first tile
+@param last: one past the index of the last tile
+@return void
+*/
+static void sync_tiles(const symmatrix_t* mat, long first, long last)
 {
-    char* str;
-    char* p;
-    int len = 0;
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t tile_size = (size_t)mat->tile * (size_t)mat->tile;
+    char* start = (char*)(mat->data + (size_t)first * tile_size);
+    char* end = (char*)(mat->data + (size_t)last * tile_size);
+    start -= (size_t)start % page;
+    msync(start, (size_t)(end - start), MS_ASYNC);
+}
+#endif
 
-    if(src == NULL)
+/*
+calculates the norm matrix of a matrix of doubles into a matrix file, for a W larger than memory
+the file is mapped shared and the similarity tiles are written into it one tile row at a time, each
+written back as soon as it is done; the degrees are then streamed from it by symmatrix_stream_multiplication
+and the tiles scaled in place the same way, so besides the file only O(N) doubles are allocated
+the file has no checksum; without mmap the matrix is calculated in memory and saved
+@param vectors: the matrix of vectors, one vector per row
+@param filename: the name of the matrix file, replaced if it exists
+@param file: set to the matrix file mapped again for reading, to be closed after the matrix is destroyed
+@return symmatrix_t*: the norm matrix viewing the file, NULL if the file could not be written or allocation failed
+*/
+symmatrix_t* calc_norm_file(const matrix_t* vectors, const char* filename, binfile_t** file)
+{
+    int I, N = vectors->rows, failed = 1;
+    long first;
+    double* degrees;
+    matrix_t* transposed;
+    symmatrix_t view;
+    symmatrix_t* norm_matrix = NULL;
+#ifdef SYMNMF_HAVE_MMAP
+    int fd;
+    size_t size;
+    char* base;
+#endif
+
+    *file = NULL;
+    view.n = N;
+    view.tile = symmatrix_tile_size(N);
+    view.tiles = (N + view.tile - 1) / view.tile;
+    view.block = NULL;
+    if((degrees = malloc((size_t)N * sizeof(double))) == NULL) /* Memory allocation failed */
     {
-        printf("An error has occured");
+        printf("An Error Has Occured");
         return NULL;
     }
-    
-    while (src[len])
-        len++;
-    str = malloc(len + 1);
-    p = str;
-    while (*src)
-        *p++ = *src++;
-    *p = '\0';
-    return str;
+
+#ifdef SYMNMF_HAVE_MMAP
+    /* degrees holds the squared norms of the vectors until the affinities are done */
+    if((transposed = transpose_vectors(vectors, NULL, N, degrees)) == NULL) /* Memory allocation failed */
+    {
+        free(degrees);
+        return NULL;
+    }
+    size = BINFILE_HEADER + (size_t)view.tiles * (size_t)(view.tiles + 1) / 2 * (size_t)view.tile * (size_t)view.tile * sizeof(double);
+    /* a new file reads as zeros, the diagonal and the padding of the tiles need no writing */
+    if((fd = open(filename, O_RDWR | O_CREAT | O_TRUNC, 0644)) < 0 || ftruncate(fd, (off_t)size) != 0 ||
+       (base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED)
+    {
+        perror("Error writing file");
+        if(fd >= 0) close(fd);
+        matrix_destroy(transposed);
+        free(degrees);
+        return NULL;
+    }
+    close(fd);
+    binfile_header((unsigned char*)base, BINFILE_PACKED, N, N, view.tile, 0, 0UL);
+    view.data = (double*)(base + BINFILE_HEADER);
+
+    for(I=0,first=0;I<view.tiles;first+=view.tiles-I,I++)
+    {
+        affinity_tiles(&view, vectors, transposed, degrees, first, first + view.tiles - I);
+        sync_tiles(&view, first, first + view.tiles - I);
+    }
+    if(symmatrix_stream_row_sums(&view, degrees) == 0)
+    {
+        for(I=0;I<N;I++)
+        {
+            degrees[I] = 1 / sqrt(degrees[I]);
+        }
+        for(I=0,first=0;I<view.tiles;first+=view.tiles-I,I++)
+        {
+            scale_tiles(&view, degrees, first, first + view.tiles - I);
+            sync_tiles(&view, first, first + view.tiles - I);
+        }
+        failed = msync(base, size, MS_SYNC) != 0;
+    }
+    munmap(base, size);
+    matrix_destroy(transposed);
+#else
+    (void)I;
+    (void)first;
+    (void)transposed;
+    if((norm_matrix = calc_norm(vectors)) != NULL)
+    {
+        failed = symmatrix_save(filename, norm_matrix, 0);
+        symmatrix_destroy(norm_matrix);
+        norm_matrix = NULL;
+    }
+#endif
+    free(degrees);
+    if(failed) return NULL;
+
+    if((*file = binfile_open(filename, 0)) != NULL && (norm_matrix = binfile_symmatrix(*file)) == NULL)
+    {
+        binfile_close(*file);
+        *file = NULL;
+    }
+    return norm_matrix;
 }
 
+#ifndef SYMNMF_NO_MAIN
+/* the options of main that choose W and run the symnmf and labels goals */
+typedef struct goal_options_t
+{
+    int k;
+    unsigned long seed;
+    int knn;
+    double epsilon;
+    const char* cache_dir;
+    const char* w_file;
+    int landmarks;
+    int single;
+    int report;
+    symnmf_params_t params;
+} goal_options_t;
+
 /*
-read vectors from a file and store them in a matrix of doubles
-@param filename: the name of the file
-@return double**: the matrix of vectors
+parses the integer value of an option, the whole value must be a number in the range of an int
+@param option: the name of the option, for the error message
+@param text: the value
+@param value: set to the number
+@return int: 1 on success, 0 with an error printed to stderr otherwise
 */
-double** read_vectors_from_file(const char *filename)
+static int parse_int_option(const char* option, const char* text, int* value)
 {
-    char line[MAX_LINE_LENGTH];
-    char* token;
-    int i,j;
-    int row_count = 0;
-    int col_count = 0;
-    double** matrix = NULL;
-
-    FILE *file = fopen(filename, "r");
-    if (file == NULL) {
-        perror("Error opening file");
-        return NULL;
+    char* end;
+    long number = strtol(text, &end, 10);
+    if(end == text || *end != '\0' || number < -2147483647L || number > 2147483647L)
+    {
+        fprintf(stderr, "%s expects an integer, got '%s'\n", option, text);
+        return 0;
     }
+    *value = (int)number;
+    return 1;
+}
 
-    /* First pass to determine the number of rows and columns */
-    while (fgets(line, sizeof(line), file)) {
-        row_count++;
+/*
+parses the floating point value of an option, the whole value must be a number
+@param option: the name of the option, for the error message
+@param text: the value
+@param value: set to the number
+@return int: 1 on success, 0 with an error printed to stderr otherwise
+*/
+static int parse_double_option(const char* option, const char* text, double* value)
+{
+    char* end;
+    double number = strtod(text, &end);
+    if(end == text || *end != '\0')
+    {
+        fprintf(stderr, "%s expects a number, got '%s'\n", option, text);
+        return 0;
+    }
+    *value = number;
+    return 1;
+}
 
-        /* Count columns in the first row */
-        if (row_count == 1) {
-            char* temp = duplicateString(line);  /* Duplicate line for counting columns */
-            char* token = strtok(temp, ",");
-            while (token != NULL) {
-                col_count++;
-                token = strtok(NULL, ",");
-            }
-            free(temp);
-        }
+/*
+checks the options of main as check_params of the python interface does
+@param options: the options
+@return int: 1 if max_iter >= 0, eps >= 0, 0 < beta <= 1, the solver exists and knn, epsilon and landmarks
+are not negative, 0 with an error printed to stderr otherwise
+*/
+static int check_goal_options(const goal_options_t* options)
+{
+    const symnmf_params_t* params = &options->params;
+    if(params->max_iter < 0 || !(params->eps >= 0) || !(params->beta > 0 && params->beta <= 1))
+    {
+        fprintf(stderr, "--max-iter and --eps must be >= 0 and --beta in (0, 1]\n");
+        return 0;
+    }
+    if(params->solver < 0)
+    {
+        fprintf(stderr, "--solver must be mu, accelerated or hals\n");
+        return 0;
     }
-    N_c = row_count;
-    vecdim_c = col_count;
+    if(options->knn < 0 || !(options->epsilon >= 0) || options->landmarks < 0)
+    {
+        fprintf(stderr, "--knn, --epsilon and --landmarks must be >= 0\n");
+        return 0;
+    }
+    return 1;
+}
 
-    /* Allocate memory for the 2D matrix */
-    matrix = matrix_malloc(matrix, N_c, vecdim_c);
+/*
+runs the symnmf and labels goals: builds the W the options ask for and factorizes it from the seeded
+initial H of symnmf_random_H, the H symnmf.py draws for the same seed
+with the report option, the iterations run are printed to stderr as symnmf.py --report does
+@param vectors: the matrix of vectors, one vector per row
+@param options: k, the seed, the storage of W and the parameters of symnmf
+@return matrix_t*: the symnmf matrix, NULL if the options are invalid or allocation failed
+*/
+static matrix_t* symnmf_goal(const matrix_t* vectors, const goal_options_t* options)
+{
+    int i;
+    double seconds = 0;
+    matrix_t* H = NULL;
+    symmatrix_t* W = NULL;
+    symmatrixf_t* W_single = NULL;
+    csrmatrix_t* W_sparse = NULL;
+    lowrank_t* W_lowrank = NULL;
+    binfile_t* file = NULL;
+    symnmf_report_t report;
+    symnmf_report_t* wanted = options->report ? &report : NULL;
 
-    /* Reset file pointer to beginning and read values into matrix */
-    rewind(file);
-    i = 0;
-    while (fgets(line, sizeof(line), file)) {
-        j = 0;
-        token = strtok(line, ",");
-        while (token != NULL) {
-            matrix[i][j++] = atof(token);  /* Convert token to double and store in matrix */
-            token = strtok(NULL, ",");
+    if(options->k < 1 || options->k >= vectors->rows)
+    {
+        fprintf(stderr, "--k must be at least 1 and less than the number of vectors\n");
+        return NULL;
+    }
+    if(options->knn > 0 || options->epsilon > 0)
+    {
+        if((W_sparse = calc_sparse_norm(vectors, options->knn, options->epsilon)) != NULL)
+        {
+            H = calc_symnmf_sparse_random(W_sparse, options->k, options->seed, &options->params, wanted);
+        }
+    }
+    else if(options->landmarks > 0)
+    {
+        if((W_lowrank = calc_norm_nystrom(vectors, options->landmarks, options->seed)) != NULL)
+        {
+            H = calc_symnmf_random_lowrank(W_lowrank, options->k, options->seed, &options->params, wanted);
         }
-        i++;
+    }
+    else if(options->w_file != NULL)
+    {
+        if((W = calc_norm_file(vectors, options->w_file, &file)) != NULL)
+        {
+            H = calc_symnmf_random_stream(W, options->k, options->seed, &options->params, wanted);
+        }
+    }
+    else if(options->single)
+    {
+        if((W_single = calc_norm_f32(vectors)) != NULL)
+        {
+            H = calc_symnmf_random_f32(W_single, options->k, options->seed, &options->params, wanted);
+        }
+    }
+    else if((W = calc_norm_cached(vectors, options->cache_dir, &file)) != NULL)
+    {
+        H = calc_symnmf_random(W, options->k, options->seed, &options->params, wanted);
     }
 
-    fclose(file);
-   
-    return matrix;
+    if(H != NULL && wanted != NULL)
+    {
+        /* the report goes to stderr, so the matrix printed stays the same */
+        for(i=0;i<report.iterations;i++)
+        {
+            seconds += report.seconds[i];
+        }
+        fprintf(stderr, "iterations=%d converged=%s delta=%.6g objective=%.6g seconds=%.6f\n", report.iterations,
+                report.converged ? "True" : "False", report.delta,
+                report.iterations > 0 ? report.objectives[report.iterations-1] : 0.0, seconds);
+        symnmf_report_free(&report);
+    }
+    symmatrix_destroy(W);
+    binfile_close(file);
+    symmatrixf_destroy(W_single);
+    csrmatrix_destroy(W_sparse);
+    lowrank_destroy(W_lowrank);
+    return H;
 }
 
 int main(int argc, char* argv[])
 {
-    double** vectors;
-    double** goal_matrix = NULL;
+    int i, threads;
+    int failed = 0;
+    int valid = 1;
+    int positional = 0;
+    char* args[2] = {NULL, NULL};
+    char* out = NULL;
+    goal_options_t options;
+    binfile_t* vectors_file = NULL;
+    binfile_t* cache_file = NULL;
+    matrix_t* vectors;
+    matrix_t* ddg_row;
+    matrix_t* H = NULL;
+    matrix_t* labels = NULL;
+    symmatrix_t* goal_matrix = NULL;
+    csrmatrix_t* sparse_matrix = NULL;
+    double* ddg_vector = NULL;
+    char* goal;
+    char* filename;
+    char* end;
 
-    char* goal = duplicateString(argv[1]);
-    char* filename = duplicateString(argv[2]);
+    memset(&options, 0, sizeof(options));
+    options.seed = 1234;
+    options.cache_dir = getenv("SYMNMF_CACHE_DIR");
+    symnmf_params_default(&options.params);
 
-    (void)argc;
+    /* the goal and the file name are positional, options may appear anywhere */
+    for(i=1;i<argc;i++)
+    {
+        if(!strncmp(argv[i], "--threads=", 10))
+        {
+            if((valid = parse_int_option("--threads", argv[i] + 10, &threads) && valid)) symnmf_set_threads(threads);
+        }
+        else if(!strncmp(argv[i], "--knn=", 6))
+        {
+            valid = parse_int_option("--knn", argv[i] + 6, &options.knn) && valid;
+        }
+        else if(!strncmp(argv[i], "--epsilon=", 10))
+        {
+            valid = parse_double_option("--epsilon", argv[i] + 10, &options.epsilon) && valid;
+        }
+        else if(!strncmp(argv[i], "--cache-dir=", 12))
+        {
+            options.cache_dir = argv[i] + 12;
+        }
+        else if(!strncmp(argv[i], "--out=", 6))
+        {
+            out = argv[i] + 6;
+        }
+        else if(!strncmp(argv[i], "--k=", 4))
+        {
+            valid = parse_int_option("--k", argv[i] + 4, &options.k) && valid;
+        }
+        else if(!strncmp(argv[i], "--seed=", 7))
+        {
+            options.seed = strtoul(argv[i] + 7, &end, 10);
+            if(end == argv[i] + 7 || *end != '\0' || argv[i][7] == '-' || options.seed > 0xffffffffUL)
+            {
+                fprintf(stderr, "--seed expects an integer in [0, 2^32), got '%s'\n", argv[i] + 7);
+                valid = 0;
+            }
+        }
+        else if(!strncmp(argv[i], "--solver=", 9))
+        {
+            options.params.solver = symnmf_solver_id(argv[i] + 9);
+        }
+        else if(!strncmp(argv[i], "--max-iter=", 11))
+        {
+            valid = parse_int_option("--max-iter", argv[i] + 11, &options.params.max_iter) && valid;
+        }
+        else if(!strncmp(argv[i], "--eps=", 6))
+        {
+            valid = parse_double_option("--eps", argv[i] + 6, &options.params.eps) && valid;
+        }
+        else if(!strncmp(argv[i], "--beta=", 7))
+        {
+            valid = parse_double_option("--beta", argv[i] + 7, &options.params.beta) && valid;
+        }
+        else if(!strncmp(argv[i], "--landmarks=", 12))
+        {
+            valid = parse_int_option("--landmarks", argv[i] + 12, &options.landmarks) && valid;
+        }
+        else if(!strncmp(argv[i], "--w-file=", 9))
+        {
+            options.w_file = argv[i] + 9;
+        }
+        else if(!strcmp(argv[i], "--float32"))
+        {
+            options.single = 1;
+        }
+        else if(!strcmp(argv[i], "--report"))
+        {
+            options.report = 1;
+        }
+        else if(!strncmp(argv[i], "--", 2))
+        {
+            fprintf(stderr, "unknown option %s\n", argv[i]);
+            valid = 0;
+        }
+        else if(positional < 2)
+        {
+            args[positional++] = argv[i];
+        }
+        else
+        {
+            fprintf(stderr, "unexpected argument %s\n", argv[i]);
+            valid = 0;
+        }
+    }
+    if(!valid || !check_goal_options(&options)) return 1;
+    if(args[0] != NULL && strcmp(args[0], "sym") && strcmp(args[0], "ddg") && strcmp(args[0], "norm") &&
+       strcmp(args[0], "symnmf") && strcmp(args[0], "labels"))
+    {
+        fprintf(stderr, "unknown goal %s, expected sym, ddg, norm, symnmf or labels\n", args[0]);
+        return 1;
+    }
+    goal = duplicateString(args[0]);
+    filename = duplicateString(args[1]);
+    if(goal == NULL || filename == NULL)
+    {
+        free(goal);
+        free(filename);
+        return 1;
+    }
 
-    vectors = read_vectors_from_file(filename);
-    if(vectors == NULL) 
+    /* matrix files are used in place, CSV files are parsed */
+    if(binfile_detect(filename))
+    {
+        vectors_file = binfile_open(filename, 1);
+        vectors = (vectors_file != NULL) ? binfile_matrix(vectors_file) : NULL;
+        if(vectors_file != NULL && vectors_file->layout != BINFILE_DENSE)
+        {
+            fprintf(stderr, "%s: expected a dense matrix of vectors\n", filename);
+        }
+    }
+    else
+    {
+        vectors = read_vectors_from_file(filename);
+    }
+    if(vectors == NULL)
     {
+        binfile_close(vectors_file);
         free(goal);
         free(filename);
         return 1;
     }
-    
-    if(!strcmp(goal,"sym"))
+
+    if(!strcmp(goal,"symnmf") || !strcmp(goal,"labels"))
+    {
+        /* factorization goals, on any storage of W */
+        if((H = symnmf_goal(vectors, &options)) == NULL)
+        {
+            failed = 1;
+        }
+        else if(!strcmp(goal,"labels") && out != NULL && (labels = matrix_create(H->rows, 1)) != NULL)
+        {
+            print_labels(H, labels);
+        }
+    }
+    else if(options.knn > 0 || options.epsilon > 0)
+    {
+        /* sparse affinity graph */
+        if(!strcmp(goal,"sym"))
+        {
+            sparse_matrix = calc_sparse_sym(vectors, options.knn, options.epsilon);
+        }
+        else if(!strcmp(goal,"ddg"))
+        {
+            ddg_vector = calc_sparse_ddg(vectors, options.knn, options.epsilon);
+        }
+        else if(!strcmp(goal,"norm"))
+        {
+            sparse_matrix = calc_sparse_norm(vectors, options.knn, options.epsilon);
+        }
+    }
+    else if(!strcmp(goal,"sym"))
     {
-        goal_matrix = sym(vectors, N_c, vecdim_c);
+        goal_matrix = calc_sym(vectors);
     }
     else if(!strcmp(goal,"ddg"))
     {
-        goal_matrix = ddg(vectors, N_c, vecdim_c);
+        ddg_vector = calc_ddg(vectors);
     }
     else if(!strcmp(goal,"norm"))
     {
-        goal_matrix = norm(vectors, N_c, vecdim_c);
+        goal_matrix = calc_norm_cached(vectors, options.cache_dir, &cache_file);
+    }
+    if(H == NULL && goal_matrix == NULL && sparse_matrix == NULL && ddg_vector == NULL)
+    {
+        /* Memory allocation failed or the options are invalid, nothing to print */
+        failed = 1;
+    }
+    if(out != NULL)
+    {
+        /* save the result as a matrix file, the degrees as a single row and the labels as a single column */
+        if(H != NULL)
+        {
+            failed = (labels != NULL) ? matrix_save(out, labels, 1) : (strcmp(goal,"labels") != 0) ? matrix_save(out, H, 1) : 1;
+        }
+        if(goal_matrix != NULL)
+        {
+            failed = symmatrix_save(out, goal_matrix, 1);
+        }
+        if(sparse_matrix != NULL)
+        {
+            fprintf(stderr, "sparse matrices can not be saved to a matrix file\n");
+            failed = 1;
+        }
+        if(ddg_vector != NULL)
+        {
+            ddg_row = matrix_borrow(ddg_vector, 1, vectors->rows, vectors->rows);
+            failed = (ddg_row == NULL) || matrix_save(out, ddg_row, 1);
+            matrix_destroy(ddg_row);
+        }
+    }
+    else
+    {
+        if(goal_matrix != NULL)
+        {
+            print_symmatrix(goal_matrix);
+        }
+        if(sparse_matrix != NULL)
+        {
+            print_csrmatrix(sparse_matrix);
+        }
+        if(ddg_vector != NULL)
+        {
+            print_diagonal(ddg_vector, vectors->rows);
+        }
+        if(H != NULL && !strcmp(goal,"labels"))
+        {
+            print_labels(H, NULL);
+        }
+        else if(H != NULL)
+        {
+            print_matrix(H);
+        }
     }
-    print_matrix(goal_matrix, N_c, N_c);
-    matrix_free(goal_matrix, N_c);
-    matrix_free(vectors, N_c);
+    matrix_destroy(H);
+    matrix_destroy(labels);
+    symmatrix_destroy(goal_matrix);
+    binfile_close(cache_file);
+    csrmatrix_destroy(sparse_matrix);
+    free(ddg_vector);
+    matrix_destroy(vectors);
+    binfile_close(vectors_file);
     free(goal);
     free(filename);
-    
-    return 0;
+
+    return failed;
 }
+#endif
@@ -2,6 +2,265 @@
 #ifndef SYMNMF_H
 #define SYMNMF_H
 
+#include <stddef.h>
+
+#define MATRIX_ALIGNMENT 64 /* byte alignment of every matrix buffer (one cache line) */
+
+/*
+dense row-major matrix of doubles held in a single aligned allocation
+row i starts at data + i*stride, stride is cols rounded up to a whole cache line
+block is the raw allocation behind data, or NULL if the data is borrowed
+*/
+typedef struct matrix_t
+{
+    double* data;
+    int rows;
+    int cols;
+    int stride;
+    void* block;
+} matrix_t;
+
+/* instruction sets of the matrix kernels, see simd_select */
+#define SIMD_SCALAR 0
+#define SIMD_AVX2 1
+#define SIMD_AVX512 2
+
+#define SYMMATRIX_TILE 64 /* edge of the square tiles of a packed symmetric matrix */
+
+/*
+symmetric n*n matrix of doubles keeping only the upper triangle of its tiles
+the matrix is cut into tile*tile blocks, block (I,J) with I<=J is stored row-major at
+symmatrix_tile(mat, I, J); diagonal blocks are stored whole, the part of a block hanging
+over the edge of the matrix is zero
+*/
+typedef struct symmatrix_t
+{
+    double* data;
+    int n;
+    int tile;
+    int tiles;
+    void* block;
+} symmatrix_t;
+
+/*
+symmetric n*n matrix of floats with the tiles of a symmatrix_t of the same order, the float32
+storage of a norm matrix; its products and sums are accumulated in double
+*/
+typedef struct symmatrixf_t
+{
+    float* data;
+    int n;
+    int tile;
+    int tiles;
+    void* block;
+} symmatrixf_t;
+
+/*
+sparse n*n matrix of doubles in compressed sparse row (CSR) format
+the entries of row i are values[row_ptr[i]] to values[row_ptr[i+1]-1], their columns are
+col_idx[row_ptr[i]] to col_idx[row_ptr[i+1]-1] in ascending order
+*/
+typedef struct csrmatrix_t
+{
+    int n;
+    size_t* row_ptr;
+    int* col_idx;
+    double* values;
+} csrmatrix_t;
+
+/*
+low-rank n*n matrix F*F^T - diag(shift), the Nystrom approximation of a norm matrix
+F is n*rank, shift holds the n entries taken off the diagonal
+*/
+typedef struct lowrank_t
+{
+    int n;
+    matrix_t* factor;
+    double* shift;
+} lowrank_t;
+
+/*
+product W*H of the symnmf iterations, called by every thread of the team with its W,
+so any storage of the norm matrix can be factorized by the same update loop
+scratch is the workspace of the product, allocated once with the rest of the factorization
+*/
+typedef void (*symnmf_product_t)(const void* W, const matrix_t* H, matrix_t* result_matrix, double* scratch);
+
+#define SYMNMF_MAX_ITER 300 /* default cap on the iterations of symnmf */
+#define SYMNMF_EPS 0.0001   /* default bound on the squared norm of an update of H at convergence */
+#define SYMNMF_BETA 0.5     /* default step of the damped multiplicative update */
+
+/* solvers of symnmf, see symnmf_solver_id */
+#define SYMNMF_SOLVER_MU 0          /* damped multiplicative update, the default */
+#define SYMNMF_SOLVER_ACCELERATED 1 /* multiplicative update with Nesterov momentum and adaptive restart */
+#define SYMNMF_SOLVER_HALS 2        /* alternating column updates of a penalized problem */
+
+/* parameters of symnmf, see symnmf_params_default; beta is the step of mu and accelerated */
+typedef struct symnmf_params_t
+{
+    int max_iter;
+    double eps;
+    double beta;
+    int solver;
+} symnmf_params_t;
+
+/*
+what a symnmf run did: the iterations it ran, whether it stopped below eps rather than at
+max_iter, the squared norm of its last update of H, and for every iteration the objective
+||W - H*H^T||^2 of the H it started from and its wall time in seconds
+*/
+typedef struct symnmf_report_t
+{
+    int iterations;
+    int converged;
+    double delta;
+    double* objectives;
+    double* seconds;
+} symnmf_report_t;
+
+#define KMEANS_MAX_ITER 300 /* default cap on the iterations of kmeans, as kmeans.py */
+#define KMEANS_EPS 0.0001   /* default bound on the move of every centroid at convergence, as kmeans.py */
+
+/* initial centroids of kmeans, see kmeans_init_id */
+#define KMEANS_INIT_FIRST 0    /* the first k vectors, as kmeans.py */
+#define KMEANS_INIT_PLUSPLUS 1 /* k-means++ seeding */
+
+/* parameters of kmeans, see kmeans_params_default; seed is only drawn from by k-means++ */
+typedef struct kmeans_params_t
+{
+    int max_iter;
+    double eps;
+    int init;
+    unsigned long seed;
+} kmeans_params_t;
+
+#define BINFILE_MAGIC "SNMF" /* first bytes of a matrix file */
+#define BINFILE_VERSION 1
+#define BINFILE_HEADER 64 /* header bytes, the payload after it keeps the cache line alignment of a mapping */
+#define BINFILE_FLOAT64 1 /* element type of the payload */
+#define BINFILE_DENSE 0   /* payload of a matrix_t, rows*stride doubles */
+#define BINFILE_PACKED 1  /* payload of a symmatrix_t, its stored tiles of stride*stride doubles */
+#define BINFILE_CHECKSUM_SEED 2166136261UL
+
+/*
+matrix file mapped into memory by binfile_open
+the header holds the magic, version, element type, layout, rows, cols, stride, an optional
+FNV-1a checksum of the payload and the byte order; data points at the payload in the mapping
+*/
+typedef struct binfile_t
+{
+    char* base;
+    size_t size;
+    int mapped;
+    int layout;
+    int rows;
+    int cols;
+    int stride;
+    double* data;
+} binfile_t;
+
+#define NORM_CACHE_KERNEL "gauss1" /* similarity kernel of the cached norm matrices, change it with the kernel */
+
+#define MATRIX_ROW(mat, i) ((mat)->data + (size_t)(i) * (size_t)(mat)->stride)
+#define MATRIX_AT(mat, i, j) (MATRIX_ROW(mat, i)[j])
+
+matrix_t* matrix_create(int n, int m);
+matrix_t* matrix_borrow(double* data, int n, int m, int stride);
+void matrix_destroy(matrix_t* mat);
+matrix_t* matrix_from_rows(double** rows, int n, int m);
+double** matrix_to_rows(const matrix_t* mat);
+int simd_select(int requested);
+void symnmf_set_threads(int threads);
+int symnmf_get_threads(void);
+void matrix_multiplication(const matrix_t* matrix1, const matrix_t* matrix2, matrix_t* result_matrix);
+void exp_batch(double* values, int n);
+
+symmatrix_t* symmatrix_create(int n);
+void symmatrix_destroy(symmatrix_t* mat);
+double* symmatrix_tile(const symmatrix_t* mat, int I, int J);
+double* symmatrix_entry(const symmatrix_t* mat, int i, int j);
+void symmatrix_multiplication(const symmatrix_t* W, const matrix_t* H, matrix_t* result_matrix);
+void symmatrix_tile_coords(const symmatrix_t* mat, size_t t, int* I, int* J);
+void symmatrix_row_sums(const symmatrix_t* W, double* sums);
+void symmatrix_stream_multiplication(const symmatrix_t* W, const matrix_t* H, matrix_t* result_matrix, double* partials);
+size_t symmatrix_stream_scratch(const symmatrix_t* W, int k);
+
+symmatrixf_t* symmatrixf_create(int n);
+void symmatrixf_destroy(symmatrixf_t* mat);
+float* symmatrixf_tile(const symmatrixf_t* mat, int I, int J);
+symmatrixf_t* symmatrixf_from_symmatrix(const symmatrix_t* mat);
+void symmatrixf_multiplication(const symmatrixf_t* W, const matrix_t* H, matrix_t* result_matrix);
+void symmatrixf_row_sums(const symmatrixf_t* W, double* sums);
+
+csrmatrix_t* csrmatrix_create(int n, size_t nnz);
+void csrmatrix_destroy(csrmatrix_t* mat);
+void csrmatrix_multiplication(const csrmatrix_t* W, const matrix_t* H, matrix_t* result_matrix);
+void csrmatrix_row_sums(const csrmatrix_t* W, double* sums);
+
+symmatrix_t* calc_sym(const matrix_t* vectors);
+double* calc_ddg(const matrix_t* vectors);
+symmatrix_t* calc_norm(const matrix_t* vectors);
+void symnmf_params_default(symnmf_params_t* params);
+int symnmf_solver_id(const char* name);
+void symnmf_report_free(symnmf_report_t* report);
+matrix_t* calc_symnmf(const symmatrix_t* W, const matrix_t* H_init, const symnmf_params_t* params, symnmf_report_t* report);
+
+/* float32 storage of the norm matrix, H and every sum stay in double */
+symmatrixf_t* calc_norm_f32(const matrix_t* vectors);
+matrix_t* calc_symnmf_f32(const symmatrixf_t* W, const matrix_t* H_init, const symnmf_params_t* params, symnmf_report_t* report);
+matrix_t* calc_symnmf_random_f32(const symmatrixf_t* W, int k, unsigned long seed, const symnmf_params_t* params, symnmf_report_t* report);
+
+/* sparse affinity goals, knn > 0 keeps the knn nearest neighbours, otherwise affinities >= epsilon */
+csrmatrix_t* calc_sparse_sym(const matrix_t* vectors, int knn, double epsilon);
+double* calc_sparse_ddg(const matrix_t* vectors, int knn, double epsilon);
+csrmatrix_t* calc_sparse_norm(const matrix_t* vectors, int knn, double epsilon);
+matrix_t* calc_symnmf_sparse(const csrmatrix_t* W, const matrix_t* H_init, const symnmf_params_t* params, symnmf_report_t* report);
+int calc_symnmf_batch(const symmatrix_t* W, matrix_t* const* H_inits, int runs, const symnmf_params_t* params,
+                      matrix_t** results, double* objectives);
+int calc_symnmf_sparse_batch(const csrmatrix_t* W, matrix_t* const* H_inits, int runs, const symnmf_params_t* params,
+                             matrix_t** results, double* objectives);
+matrix_t* symnmf_random_H(int N, int k, double mean, unsigned long seed);
+matrix_t* calc_symnmf_random(const symmatrix_t* W, int k, unsigned long seed, const symnmf_params_t* params, symnmf_report_t* report);
+matrix_t* calc_symnmf_sparse_random(const csrmatrix_t* W, int k, unsigned long seed, const symnmf_params_t* params, symnmf_report_t* report);
+
+matrix_t* parse_vectors(const char* text, size_t size);
+matrix_t* read_vectors_from_file(const char* filename);
+
+int matrix_save(const char* filename, const matrix_t* mat, int checksum);
+int symmatrix_save(const char* filename, const symmatrix_t* mat, int checksum);
+binfile_t* binfile_open(const char* filename, int verify);
+void binfile_close(binfile_t* file);
+int binfile_detect(const char* filename);
+matrix_t* binfile_matrix(const binfile_t* file);
+symmatrix_t* binfile_symmatrix(const binfile_t* file);
+symmatrix_t* calc_norm_cached(const matrix_t* vectors, const char* cache_dir, binfile_t** file);
+
+/* out-of-core symnmf: W is built into a matrix file and streamed from it tile row by tile row */
+symmatrix_t* calc_norm_file(const matrix_t* vectors, const char* filename, binfile_t** file);
+matrix_t* calc_symnmf_stream(const symmatrix_t* W, const matrix_t* H_init, const symnmf_params_t* params, symnmf_report_t* report);
+matrix_t* calc_symnmf_random_stream(const symmatrix_t* W, int k, unsigned long seed, const symnmf_params_t* params, symnmf_report_t* report);
+
+/* Nystrom approximation of the norm matrix from landmark points, with its error against the exact one */
+lowrank_t* calc_norm_nystrom(const matrix_t* vectors, int landmarks, unsigned long seed);
+void lowrank_destroy(lowrank_t* mat);
+void lowrank_multiplication(const lowrank_t* W, const matrix_t* H, matrix_t* result_matrix, double* scratch);
+size_t lowrank_scratch(const lowrank_t* W, int k);
+double lowrank_error(const matrix_t* vectors, const lowrank_t* W, double* max_error);
+matrix_t* calc_symnmf_lowrank(const lowrank_t* W, const matrix_t* H_init, const symnmf_params_t* params, symnmf_report_t* report);
+matrix_t* calc_symnmf_random_lowrank(const lowrank_t* W, int k, unsigned long seed, const symnmf_params_t* params, symnmf_report_t* report);
+
+/* k-means, the clustering analysis.py compares symnmf with */
+void kmeans_params_default(kmeans_params_t* params);
+int kmeans_init_id(const char* name);
+matrix_t* calc_kmeans(const matrix_t* vectors, int k, const kmeans_params_t* params, int* labels, int* iterations);
+
+/* silhouette scores of labelings, and the comparison of symnmf and k-means analysis.py prints */
+int calc_silhouette(const matrix_t* vectors, const int* const* labels, int sets, int clusters, int sample,
+                    unsigned long seed, double* scores);
+int calc_analysis(const matrix_t* vectors, int k, unsigned long seed, const symnmf_params_t* params, int sample,
+                  int* symnmf_labels, int* kmeans_labels, double* scores);
+
+/* double** adapters over the matrix_t functions above */
 void matrix_free(double **p, int n);
 double** matrix_malloc(double** new_matrix, int n, int m);
 double** sym(double** vectors, int N, int vecdim);
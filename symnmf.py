@@ -13,61 +13,192 @@ This function initializes the matrix H with random values from the interval [0,
 where m is the mean of the entries in the input matrix w_mat and k is the number of centroids.
 
 Parameters:
-w_mat (list): A list of list of float representing the normalized similarity matrix.
+w_mat (np.ndarray or tuple): The normalized similarity matrix, dense or as sparse (indptr, indices, data).
 N (int): The number of vectors (rows in the matrix H).
 k (int): The number of centroids (columns in the matrix H).
+rng (np.random.RandomState): The generator of the random values, the seeded global one by default.
 
 Returns:
-list: A list of list of float of shape (N, k) representing a matrix initialized with random values.
+np.ndarray: A float64 array of shape (N, k) representing a matrix initialized with random values.
 """
-def initializeH(w_mat, N, k):
-    m = np.mean(w_mat) # Calculate the average of all entries in w_mat
+def initializeH(w_mat, N, k, rng=np.random):
+    if isinstance(w_mat, tuple):
+        m = np.sum(w_mat[2]) / (N * N) # A sparse (indptr, indices, data) matrix, its missing entries are zeros
+    else:
+        m = np.mean(w_mat) # Calculate the average of all entries in w_mat
     upper_bound = 2 * np.sqrt(m / k) # Calculate the upper bound for the random values
-    H = np.random.uniform(low=0, high=upper_bound, size=(N, k)) # Initialize H with random values from the interval [0, upper_bound]
-    return H.tolist()
+    H = rng.uniform(low=0, high=upper_bound, size=(N, k)) # Initialize H with random values from the interval [0, upper_bound]
+    return H
 
 """
 Perform Symmetric Non-negative Matrix Factorization (SymNMF) on the given vectors.
 
-This function normalizes the input vectors to calculate the W matrix (normalized similarity matrix),
-initializes the H matrix (decomposition matrix),
-and then performs SymNMF to calculate the resulting matrix.
+This function calculates the W matrix (normalized similarity matrix), initializes the H matrix
+(decomposition matrix) and performs SymNMF in a single call to C, so W never comes back to Python.
+H starts from the values initializeH draws from np.random.RandomState(seed).
 
 Parameters:
-vectors (list of list of float): A list of lists representing the input vectors.
+vectors (np.ndarray): A float64 array representing the input vectors, one per row.
 k (int): The number of clusters to form.
+sparse (dict): knn or epsilon of a sparse similarity graph, empty for the dense one.
+params (dict): solver, max_iter, eps, beta, report, dtype, w_file or landmarks of mysymnmfsp.fit, empty for the defaults.
+seed (int): The seed of the initial H.
 
 Returns:
-list: A list of list of float representing the resulting matrix after performing SymNMF.
+np.ndarray: A float64 array representing the resulting matrix after performing SymNMF,
+or (H, report) if params holds report=True.
 """
-def doSymnmf(vectors, k):
-    w_mat = SymNMF.norm(vectors) # Calling norm function in C to calculate W matrix
-    h_mat = initializeH(w_mat, len(vectors), k) # Initialize H matrix
-    matrix_goal = SymNMF.symnmf(w_mat, h_mat, k) # Calling symnmf function in C to calculate the matrix
-    return matrix_goal
+def doSymnmf(vectors, k, sparse={}, params={}, seed=1234):
+    return SymNMF.fit(vectors, k, seed=seed, **sparse, **params) # Calling fit function in C to calculate W and the matrix
+
+"""
+Perform a batch of SymNMF factorizations for several k and several restart seeds.
+
+W is calculated once and shared by all the runs, which run concurrently in C.
+The run of k and seed starts from the H initializeH draws from np.random.RandomState(seed),
+so the run of k and 1234 gives the same H as doSymnmf.
+
+Parameters:
+vectors (np.ndarray): A float64 array representing the input vectors, one per row.
+ks (list of int): The numbers of clusters to try.
+seeds (list of int): The restart seeds to try for every k.
+sparse (dict): knn or epsilon of a sparse similarity graph, empty for the dense one.
+params (dict): solver, max_iter, eps or beta shared by all the runs, empty for the defaults.
+
+Returns:
+list of tuple: A (k, seed, H, objective) tuple for every k and seed, objective being ||W - HH^T||^2.
+"""
+def doSymnmfBatch(vectors, ks, seeds, sparse={}, params={}):
+    if sparse:
+        w_mat = SymNMF.sparse_norm(vectors, **sparse)
+    else:
+        w_mat = SymNMF.norm(vectors)
+    runs = [(k, seed) for k in ks for seed in seeds]
+    h_inits = [initializeH(w_mat, len(vectors), k, np.random.RandomState(seed)) for k, seed in runs]
+    results = SymNMF.symnmf_batch(w_mat, h_inits, **params)
+    return [(k, seed, H, objective) for (k, seed), (H, objective) in zip(runs, results)]
+
+"""
+Read the input vectors from a CSV file or from a binary matrix file written by mysymnmfsp.save.
+
+Parameters:
+input_file (str): The path of the file.
+
+Returns:
+np.ndarray: A float64 array of the vectors, one per row, mapped from the file if it is a matrix file.
+"""
+def readVectors(input_file):
+    with open(input_file, "rb") as f:
+        is_matrix_file = f.read(4) == b"SNMF"
+    if is_matrix_file:
+        return SymNMF.load(input_file)
+    vectors = pd.read_csv(input_file, header=None)
+    # Hand the vectors to C as a C-contiguous float64 array, which is read in place
+    return np.ascontiguousarray(vectors.values, dtype=np.float64)
+
+"""
+Expand a low-rank (F, shift) matrix from mysymnmfsp.nystrom_norm to a dense array, F*F^T - diag(shift).
+"""
+def lowRankToRows(lowrank):
+    factor, shift = lowrank
+    return factor @ factor.T - np.diag(shift)
+
+"""
+Expand a sparse (indptr, indices, data) matrix to a list of list of float for printing.
+"""
+def sparseToRows(csr, N):
+    indptr, indices, data = csr
+    rows = [[0.0] * N for _ in range(N)]
+    for i in range(N):
+        for p in range(indptr[i], indptr[i + 1]):
+            rows[i][indices[p]] = data[p]
+    return rows
 
 def main():
     try:
         # Get data from console
         input_data = sys.argv
-        k, goal, input_file = int(input_data[1]), input_data[2], input_data[3]
-
-        # Create Vectors dataframe from csv file
-        vectors = pd.read_csv(input_file, header=None)
-        # Convert vectors to python list of lists
-        vectors = vectors.values.tolist()
+        goal, input_file = input_data[2], input_data[3]
+        # The batch goal takes a comma separated list of k
+        ks = [int(k) for k in input_data[1].split(",")] if goal == "batch" else [int(input_data[1])]
+        k = ks[0]
+
+        # Optional sparse similarity graph: --knn=K or --epsilon=E, the restart seeds of batch: --seeds=S1,S2,...
+        # the solver and convergence controls of symnmf: --solver=S, --max-iter=N, --eps=E, --beta=B and --report,
+        # --float32 to keep the dense W of symnmf in single precision, and --w-file=PATH to build it into a matrix file
+        # and stream it from there instead of keeping it in memory, or --landmarks=M for the Nystrom approximation of
+        # norm, ddg and symnmf from M landmarks
+        sparse = {}
+        landmarks = 0
+        seeds = [1234]
+        params = {}
+        for option in input_data[4:]:
+            if option.startswith("--solver="):
+                params["solver"] = option[len("--solver="):]
+            elif option.startswith("--max-iter="):
+                params["max_iter"] = int(option[len("--max-iter="):])
+            elif option.startswith("--eps="):
+                params["eps"] = float(option[len("--eps="):])
+            elif option.startswith("--beta="):
+                params["beta"] = float(option[len("--beta="):])
+            elif option == "--report" and goal == "symnmf":
+                params["report"] = True
+            elif option == "--float32" and goal == "symnmf":
+                params["dtype"] = "float32"
+            elif option.startswith("--w-file=") and goal == "symnmf":
+                params["w_file"] = option[len("--w-file="):]
+            elif option.startswith("--landmarks=") and goal in ("norm", "ddg", "symnmf"):
+                landmarks = int(option[len("--landmarks="):])
+                params["landmarks"] = landmarks
+            elif option.startswith("--seeds="):
+                seeds = [int(seed) for seed in option[len("--seeds="):].split(",")]
+            elif option.startswith("--knn="):
+                sparse["knn"] = int(option[len("--knn="):])
+            elif option.startswith("--epsilon="):
+                sparse["epsilon"] = float(option[len("--epsilon="):])
+            else:
+                print("An Error Has Occurred")
+                return
+
+        vectors = readVectors(input_file)
         
         matrix_goal = None # The matrix to calculate and return
 
         # Choose which matrix to calculate and return
-        if goal == "sym":
+        if landmarks and goal == "norm":
+            matrix_goal = lowRankToRows(SymNMF.nystrom_norm(vectors, landmarks))
+        elif landmarks and goal == "ddg":
+            # The approximate degrees are the inverses of the shift of the diagonal
+            degrees = [1 / shift if shift > 0 else 0.0 for shift in SymNMF.nystrom_norm(vectors, landmarks)[1]]
+            matrix_goal = np.diag(degrees)
+        elif sparse and goal == "sym":
+            matrix_goal = sparseToRows(SymNMF.sparse_sym(vectors, **sparse), len(vectors))
+        elif sparse and goal == "ddg":
+            degrees = SymNMF.sparse_ddg(vectors, **sparse)
+            matrix_goal = [[degrees[i] if i == j else 0.0 for j in range(len(degrees))] for i in range(len(degrees))]
+        elif sparse and goal == "norm":
+            matrix_goal = sparseToRows(SymNMF.sparse_norm(vectors, **sparse), len(vectors))
+        elif goal == "sym":
             matrix_goal = SymNMF.sym(vectors) # Calling sym function in C to calculate the matrix
         elif goal == "ddg":
             matrix_goal = SymNMF.ddg(vectors) # Calling ddg function in C to calculate the matrix
         elif goal == "norm":
             matrix_goal = SymNMF.norm(vectors) # Calling norm function in C to calculate the matrix  
         elif goal == "symnmf":
-            matrix_goal = doSymnmf(vectors, k)
+            matrix_goal = doSymnmf(vectors, k, sparse, params)
+            if params.get("report"):
+                # The report goes to stderr, so the matrix printed stays the same
+                matrix_goal, report = matrix_goal
+                print("iterations=%d converged=%s delta=%.6g objective=%.6g seconds=%.6f" % (
+                    report["iterations"], report["converged"], report["delta"],
+                    report["objectives"][-1] if report["objectives"] else float("nan"), sum(report["seconds"])),
+                    file=sys.stderr)
+        elif goal == "batch":
+            # One k,seed,objective line per run
+            matrix_goal = [(k, seed, objective) for k, seed, _, objective in doSymnmfBatch(vectors, ks, seeds, sparse, params)]
+            for k, seed, objective in matrix_goal:
+                print("%d,%d,%.4f" % (k, seed, objective))
+            return
         else:
             print("An Error Has Occurred")
             return
@@ -2,55 +2,72 @@
 # include <Python.h>
 # include <stdio.h>
 # include <math.h>
+# include <string.h>
 # include "symnmf.h"
 
-static int N, vecdim, k;
+/**
+ * Per-module state, one per interpreter that imports the module.
+ *
+ * Every call keeps its dimensions in locals, so concurrent calls from several threads
+ * (which run with the GIL released) share nothing but this state.
+ */
+typedef struct {
+    PyObject* matrix_type; /* the mysymnmfsp.Matrix heap type */
+} module_state;
+
+/**
+ * Get the state of the module.
+ *
+ * @param module A PyObject representing the module.
+ * @return A module_state pointer representing the state.
+ */
+static module_state* get_module_state(PyObject* module)
+{
+    return (module_state*)PyModule_GetState(module);
+}
 
 /**
- * Convert a Python list of lists to a C array.
+ * Convert a Python list of lists to a C matrix.
  *
- * This function takes a Python list of lists (obj) and converts it into a C array (arr).
- * The dimensions of the array are specified by n (number of rows) and m (number of columns).
+ * This function takes a Python list of lists (obj) and converts it into a C matrix (arr).
+ * The dimensions are taken from arr, which must already be allocated with the shape of obj.
  * Each element in the Python list is converted to a double and stored in the corresponding
- * position in the C array.
+ * position in the C matrix.
  *
  * @param obj A PyObject representing a Python list of lists.
- * @param arr A double pointer representing the C array to be filled.
- * @param n An integer representing the number of rows in the array.
- * @param m An integer representing the number of columns in the array.
- * @return A double pointer representing the filled C array.
+ * @param arr A matrix_t pointer representing the C matrix to be filled.
+ * @return A matrix_t pointer representing the filled C matrix.
  */
-double** convert_pylist2carray(PyObject* obj, double** arr, int n, int m)
+matrix_t* convert_pylist2carray(PyObject* obj, matrix_t* arr)
 {
     int i,j;
     PyObject* row;
-    for (i=0;i<n;i++)
+    for (i=0;i<arr->rows;i++)
     {
         row = PyList_GetItem(obj, i);
-        for (j=0;j<m;j++)
+        for (j=0;j<arr->cols;j++)
         {
-            arr[i][j] = PyFloat_AsDouble(PyList_GetItem(row, j));
+            MATRIX_AT(arr, i, j) = PyFloat_AsDouble(PyList_GetItem(row, j));
         }
     }
     return arr;
 }
 
 /**
- * Convert a C array to a Python list of lists.
+ * Convert a C matrix to a Python list of lists.
  *
- * This function takes a C array (received_matrix) and converts it into a Python list of lists.
- * The dimensions of the array are specified by n (number of rows) and m (number of columns).
- * Each element in the C array is converted to a Python float and stored in the corresponding
+ * This function takes a C matrix (received_matrix) and converts it into a Python list of lists.
+ * Each element in the C matrix is converted to a Python float and stored in the corresponding
  * position in the Python list.
  *
- * @param received_matrix A double pointer representing the C array to be converted.
- * @param n An integer representing the number of rows in the array.
- * @param m An integer representing the number of columns in the array.
+ * @param received_matrix A matrix_t pointer representing the C matrix to be converted.
  * @return A PyObject representing the Python list of lists.
  */
-PyObject* convert_carray2pylist(double** received_matrix, int n, int m)
+PyObject* convert_carray2pylist(const matrix_t* received_matrix)
 {
     int i,j;
+    int n = received_matrix->rows;
+    int m = received_matrix->cols;
     PyObject* final_matrix = PyList_New(n);
     PyObject* final_row;
     for (i=0;i<n;i++)
@@ -58,7 +75,82 @@ PyObject* convert_carray2pylist(double** received_matrix, int n, int m)
         final_row = PyList_New(m);
         for (j=0;j<m;j++)
         {
-            PyList_SetItem(final_row, j, PyFloat_FromDouble(received_matrix[i][j]));
+            PyList_SetItem(final_row, j, PyFloat_FromDouble(MATRIX_AT(received_matrix, i, j)));
+        }
+        PyList_SetItem(final_matrix, i, final_row);
+    }
+
+    return final_matrix;
+}
+
+/**
+ * Convert a Python list of lists holding a symmetric matrix to a packed C matrix.
+ *
+ * Only the entries the packed matrix stores are read: the upper triangle of tiles,
+ * including every entry of the diagonal tiles.
+ *
+ * @param obj A PyObject representing a Python list of lists.
+ * @param arr A symmatrix_t pointer representing the packed C matrix to be filled.
+ * @return A symmatrix_t pointer representing the filled C matrix.
+ */
+symmatrix_t* convert_pylist2symmatrix(PyObject* obj, symmatrix_t* arr)
+{
+    int i,j;
+    PyObject* row;
+    for (i=0;i<arr->n;i++)
+    {
+        row = PyList_GetItem(obj, i);
+        for (j=i/arr->tile*arr->tile;j<arr->n;j++)
+        {
+            *symmatrix_entry(arr, i, j) = PyFloat_AsDouble(PyList_GetItem(row, j));
+        }
+    }
+    return arr;
+}
+
+/**
+ * Convert a packed symmetric C matrix to a Python list of lists.
+ *
+ * @param received_matrix A symmatrix_t pointer representing the C matrix to be converted.
+ * @return A PyObject representing the full Python list of lists.
+ */
+PyObject* convert_symmatrix2pylist(const symmatrix_t* received_matrix)
+{
+    int i,j;
+    int n = received_matrix->n;
+    PyObject* final_matrix = PyList_New(n);
+    PyObject* final_row;
+    for (i=0;i<n;i++)
+    {
+        final_row = PyList_New(n);
+        for (j=0;j<n;j++)
+        {
+            PyList_SetItem(final_row, j, PyFloat_FromDouble(*symmatrix_entry(received_matrix, i, j)));
+        }
+        PyList_SetItem(final_matrix, i, final_row);
+    }
+
+    return final_matrix;
+}
+
+/**
+ * Convert the diagonal of a C diagonal matrix to a Python list of lists.
+ *
+ * @param diagonal A double pointer representing the n entries on the diagonal.
+ * @param n An integer representing the order of the matrix.
+ * @return A PyObject representing the full n*n Python list of lists.
+ */
+PyObject* convert_diagonal2pylist(const double* diagonal, int n)
+{
+    int i,j;
+    PyObject* final_matrix = PyList_New(n);
+    PyObject* final_row;
+    for (i=0;i<n;i++)
+    {
+        final_row = PyList_New(n);
+        for (j=0;j<n;j++)
+        {
+            PyList_SetItem(final_row, j, PyFloat_FromDouble((i == j) ? diagonal[i] : 0));
         }
         PyList_SetItem(final_matrix, i, final_row);
     }
@@ -67,215 +159,1699 @@ PyObject* convert_carray2pylist(double** received_matrix, int n, int m)
 }
 
 /**
- * Convert a Python list of vectors to a C array.
+ * A dense C matrix exported to Python through the buffer protocol.
+ *
+ * NumPy arrays made from it view the C buffer directly, the matrix (and the matrix file
+ * it may view) is freed when the last array or memoryview viewing it is gone.
+ */
+typedef struct {
+    PyObject_HEAD
+    matrix_t* matrix;
+    binfile_t* file; /* the mapped matrix file the matrix views, or NULL */
+    Py_ssize_t shape[2];
+    Py_ssize_t strides[2];
+} MatrixObject;
+
+/**
+ * Fill a buffer view of a MatrixObject.
+ *
+ * The rows of the matrix are padded, so the view is strided and only C-contiguous when
+ * the number of columns is a whole cache line. A matrix viewing a mapped matrix file is
+ * read only, as the mapping is.
+ *
+ * @param self A PyObject representing the MatrixObject.
+ * @param view A Py_buffer pointer to be filled.
+ * @param flags An integer representing the kind of view requested.
+ * @return 0 on success, -1 if an error occurs.
+ */
+static int matrix_getbuffer(PyObject* self, Py_buffer* view, int flags)
+{
+    MatrixObject* obj = (MatrixObject*)self;
+    if((flags & PyBUF_ND) != PyBUF_ND || ((flags & PyBUF_STRIDES) != PyBUF_STRIDES && obj->matrix->stride != obj->matrix->cols))
+    {
+        PyErr_SetString(PyExc_BufferError, "the rows of the matrix are padded, a strided view is needed");
+        return -1;
+    }
+    int readonly = obj->file != NULL && obj->file->mapped;
+    if(readonly && (flags & PyBUF_WRITABLE) == PyBUF_WRITABLE)
+    {
+        PyErr_SetString(PyExc_BufferError, "the matrix views a read only matrix file");
+        return -1;
+    }
+    view->buf = obj->matrix->data;
+    view->obj = Py_NewRef(self);
+    view->len = obj->shape[0] * obj->shape[1] * (Py_ssize_t)sizeof(double);
+    view->readonly = readonly;
+    view->itemsize = sizeof(double);
+    view->format = (flags & PyBUF_FORMAT) ? "d" : NULL;
+    view->ndim = 2;
+    view->shape = obj->shape;
+    view->strides = (flags & PyBUF_STRIDES) == PyBUF_STRIDES ? obj->strides : NULL;
+    view->suboffsets = NULL;
+    view->internal = NULL;
+    return 0;
+}
+
+/**
+ * Free a MatrixObject and its C matrix.
+ *
+ * @param self A PyObject representing the MatrixObject.
+ */
+static void matrix_dealloc(PyObject* self)
+{
+    PyTypeObject* type = Py_TYPE(self);
+    matrix_destroy(((MatrixObject*)self)->matrix);
+    binfile_close(((MatrixObject*)self)->file);
+    type->tp_free(self);
+    Py_DECREF(type); /* instances of heap types own a reference to their type */
+}
+
+static PyType_Slot matrix_slots[] = {
+    {Py_tp_doc, (void*)PyDoc_STR("Dense float64 matrix owned by C, viewed through the buffer protocol")},
+    {Py_tp_dealloc, (void*)matrix_dealloc},
+    {Py_bf_getbuffer, (void*)matrix_getbuffer}, /* no bf_releasebuffer, the matrix lives as long as the object */
+    {0, NULL}
+};
+
+static PyType_Spec matrix_spec = {
+    "mysymnmfsp.Matrix",
+    sizeof(MatrixObject),
+    0,
+    Py_TPFLAGS_DEFAULT | Py_TPFLAGS_IMMUTABLETYPE | Py_TPFLAGS_DISALLOW_INSTANTIATION,
+    matrix_slots
+};
+
+/**
+ * Convert a C matrix to a NumPy array without copying it.
+ *
+ * The matrix is handed over to a MatrixObject which the returned array views. If NumPy
+ * can not be imported the MatrixObject itself is returned, it still supports memoryview.
+ *
+ * @param module A PyObject representing the module.
+ * @param received_matrix A matrix_t pointer representing the C matrix, owned by the result from now on.
+ * @param file A binfile_t pointer representing the matrix file received_matrix views, owned by the result from now on, or NULL.
+ * @return A PyObject representing the NumPy array, or NULL if an error occurs.
+ */
+PyObject* wrap_carray(PyObject* module, matrix_t* received_matrix, binfile_t* file)
+{
+    PyObject *numpy, *array;
+    MatrixObject* obj = PyObject_New(MatrixObject, (PyTypeObject*)get_module_state(module)->matrix_type);
+    if(obj == NULL)
+    {
+        matrix_destroy(received_matrix);
+        binfile_close(file);
+        return NULL;
+    }
+    obj->matrix = received_matrix;
+    obj->file = file;
+    obj->shape[0] = received_matrix->rows;
+    obj->shape[1] = received_matrix->cols;
+    obj->strides[0] = (Py_ssize_t)received_matrix->stride * (Py_ssize_t)sizeof(double);
+    obj->strides[1] = sizeof(double);
+
+    if((numpy = PyImport_ImportModule("numpy")) == NULL)
+    {
+        PyErr_Clear();
+        return (PyObject*)obj;
+    }
+    array = PyObject_CallMethod(numpy, "asarray", "O", (PyObject*)obj);
+    Py_DECREF(numpy);
+    Py_DECREF(obj);
+    return array;
+}
+
+/**
+ * Convert a C matrix to a NumPy array without copying it, see wrap_carray.
+ *
+ * @param module A PyObject representing the module.
+ * @param received_matrix A matrix_t pointer representing the C matrix, owned by the result from now on.
+ * @return A PyObject representing the NumPy array, or NULL if an error occurs.
+ */
+PyObject* convert_carray2pyarray(PyObject* module, matrix_t* received_matrix)
+{
+    return wrap_carray(module, received_matrix, NULL);
+}
+
+/**
+ * Convert a Python matrix to a C matrix.
+ *
+ * Any object exporting a two dimensional float64 buffer with contiguous rows (a C-contiguous
+ * NumPy array, or one returned by this module) is borrowed without copying, view then holds the buffer. Otherwise obj must be a
+ * list of lists which is copied into a new C matrix, and view->obj is set to NULL.
+ * The result is freed with release_carray.
+ *
+ * @param obj A PyObject representing the matrix.
+ * @param view A Py_buffer pointer representing the buffer of obj, if it has one.
+ * @return A matrix_t pointer representing the C matrix, or NULL if an error occurs.
+ */
+matrix_t* convert_pyobject2carray(PyObject* obj, Py_buffer* view)
+{
+    const char* format;
+    matrix_t* arr;
+
+    view->obj = NULL;
+    if(!PyObject_CheckBuffer(obj))
+    {
+        if(!PyList_Check(obj) || PyList_Size(obj) == 0 || !PyList_Check(PyList_GetItem(obj, 0)))
+        {
+            PyErr_SetString(PyExc_TypeError, "expected a non-empty list of lists or a float64 buffer");
+            return NULL;
+        }
+        if((arr = matrix_create(PyList_Size(obj), PyList_Size(PyList_GetItem(obj, 0)))) == NULL) /* Memory allocation failed */
+        {
+            PyErr_NoMemory();
+            return NULL;
+        }
+        return convert_pylist2carray(obj, arr);
+    }
+
+    if(PyObject_GetBuffer(obj, view, PyBUF_STRIDES | PyBUF_FORMAT) < 0) return NULL;
+    format = view->format;
+    if(*format == '@' || *format == '=' || *format == '<') format++;
+    if(view->ndim != 2 || view->itemsize != sizeof(double) || strcmp(format, "d") != 0)
+    {
+        PyBuffer_Release(view);
+        PyErr_SetString(PyExc_TypeError, "expected a two dimensional float64 buffer");
+        return NULL;
+    }
+    /* the rows may be padded but each row must be contiguous */
+    if(view->strides[1] != sizeof(double) || view->strides[0] % sizeof(double) != 0 || view->strides[0] < view->shape[1] * (Py_ssize_t)sizeof(double))
+    {
+        PyBuffer_Release(view);
+        PyErr_SetString(PyExc_ValueError, "expected a float64 buffer with contiguous rows, use numpy.ascontiguousarray");
+        return NULL;
+    }
+    if((arr = matrix_borrow(view->buf, (int)view->shape[0], (int)view->shape[1], (int)(view->strides[0] / (Py_ssize_t)sizeof(double)))) == NULL)
+    {
+        PyBuffer_Release(view);
+        PyErr_NoMemory();
+        return NULL;
+    }
+    return arr;
+}
+
+/**
+ * Free a C matrix made by convert_pyobject2carray and release the buffer it borrows.
+ *
+ * @param arr A matrix_t pointer representing the C matrix, may be NULL.
+ * @param view A Py_buffer pointer representing the borrowed buffer, if any.
+ */
+void release_carray(matrix_t* arr, Py_buffer* view)
+{
+    matrix_destroy(arr);
+    PyBuffer_Release(view);
+}
+
+
+/**
+ * Convert a packed symmetric C matrix to a full NumPy array.
+ *
+ * Every stored tile is written to the dense matrix once as is and once transposed.
+ *
+ * @param module A PyObject representing the module.
+ * @param received_matrix A symmatrix_t pointer representing the C matrix to be converted.
+ * @return A PyObject representing the n*n NumPy array, or NULL if an error occurs.
+ */
+PyObject* convert_symmatrix2pyarray(PyObject* module, const symmatrix_t* received_matrix)
+{
+    int I,J,r,c,rows,cols;
+    int T = received_matrix->tile;
+    int n = received_matrix->n;
+    const double* tile;
+    matrix_t* dense = matrix_create(n, n);
+    if(dense == NULL) return PyErr_NoMemory(); /* Memory allocation failed */
+
+    for (I=0;I<received_matrix->tiles;I++)
+    {
+        rows = (n - I*T < T) ? n - I*T : T;
+        for (J=I;J<received_matrix->tiles;J++)
+        {
+            cols = (n - J*T < T) ? n - J*T : T;
+            tile = symmatrix_tile(received_matrix, I, J);
+            for (r=0;r<rows;r++)
+            {
+                for (c=0;c<cols;c++)
+                {
+                    MATRIX_AT(dense, I*T + r, J*T + c) = tile[r*T + c];
+                    MATRIX_AT(dense, J*T + c, I*T + r) = tile[r*T + c];
+                }
+            }
+        }
+    }
+    return convert_carray2pyarray(module, dense);
+}
+
+/**
+ * Convert the diagonal of a C diagonal matrix to a full NumPy array.
+ *
+ * @param module A PyObject representing the module.
+ * @param diagonal A double pointer representing the n entries on the diagonal.
+ * @param n An integer representing the order of the matrix.
+ * @return A PyObject representing the n*n NumPy array, or NULL if an error occurs.
+ */
+PyObject* convert_diagonal2pyarray(PyObject* module, const double* diagonal, int n)
+{
+    int i;
+    matrix_t* dense = matrix_create(n, n);
+    if(dense == NULL) return PyErr_NoMemory(); /* Memory allocation failed */
+
+    for (i=0;i<n;i++)
+    {
+        memset(MATRIX_ROW(dense, i), 0, (size_t)dense->stride * sizeof(double));
+        MATRIX_AT(dense, i, i) = diagonal[i];
+    }
+    return convert_carray2pyarray(module, dense);
+}
+
+/**
+ * Convert a Python matrix of vectors to a C array.
  *
- * This function takes a Python list of vectors (vec_arr_obj) and converts it into a C array (vec_arr).
- * It first parses the Python argument to get the list of vectors, then determines the dimensions
- * of the array (N and vecdim). It allocates memory for the C array and converts the Python list
- * into the C array.
+ * This function parses the Python argument to get the vectors and converts them
+ * with convert_pyobject2carray.
  *
  * @param self A PyObject representing the module or class (not used).
  * @param args A PyObject representing the arguments passed to the function.
- * @return A double pointer representing the C array of vectors, or NULL if an error occurs.
+ * @param view A Py_buffer pointer representing the buffer of the vectors, if they have one.
+ * @return A matrix_t pointer representing the C matrix of vectors, or NULL if an error occurs.
  */
-double** convert_vectors(PyObject* self, PyObject* args)
+matrix_t* convert_vectors(PyObject* self, PyObject* args, Py_buffer* view)
 {
     PyObject* vec_arr_obj;
-    double** vec_arr = NULL;
     
     /* Parse Python argument: */
     if(!PyArg_ParseTuple(args, "O", &vec_arr_obj)) return NULL; /* In the CPython API, a NULL value is never valid for a
                                                                     PyObject* so it is used to signal that an error has occurred. */
 
-    /* Get N and vecdim from the python object */
-    N = PyList_Size(vec_arr_obj);
-    vecdim = PyList_Size(PyList_GetItem(vec_arr_obj, 0));
+    return convert_pyobject2carray(vec_arr_obj, view);
+}
+
+/**
+ * Convert a Python matrix of vectors and the parameters of a sparse affinity graph to C.
+ *
+ * Exactly one of the keyword arguments knn and epsilon must be positive.
+ *
+ * @param args A PyObject representing the arguments passed to the function.
+ * @param kwargs A PyObject holding the keyword arguments knn and epsilon.
+ * @param knn An integer pointer the number of nearest neighbours is written to.
+ * @param epsilon A double pointer the smallest kept affinity is written to.
+ * @param view A Py_buffer pointer representing the buffer of the vectors, if they have one.
+ * @return A matrix_t pointer representing the C matrix of vectors, or NULL if an error occurs.
+ */
+matrix_t* convert_sparse_vectors(PyObject* args, PyObject* kwargs, int* knn, double* epsilon, Py_buffer* view)
+{
+    static char* kwlist[] = {"vectors", "knn", "epsilon", NULL};
+    PyObject* vec_arr_obj;
+
+    *knn = 0;
+    *epsilon = 0;
+    if(!PyArg_ParseTupleAndKeywords(args, kwargs, "O|id", kwlist, &vec_arr_obj, knn, epsilon)) return NULL;
+    if((*knn > 0) == (*epsilon > 0))
+    {
+        PyErr_SetString(PyExc_ValueError, "exactly one of knn and epsilon must be positive");
+        return NULL;
+    }
+
+    return convert_pyobject2carray(vec_arr_obj, view);
+}
+
+/**
+ * Convert a sparse C matrix to a Python tuple of CSR lists.
+ *
+ * The tuple is (indptr, indices, data), the layout scipy.sparse.csr_matrix((data, indices, indptr))
+ * expects, and is accepted back as W by symnmf.
+ *
+ * @param received_matrix A csrmatrix_t pointer representing the C matrix to be converted.
+ * @return A PyObject representing the Python tuple of lists.
+ */
+PyObject* convert_csrmatrix2pytuple(const csrmatrix_t* received_matrix)
+{
+    int i;
+    size_t p;
+    size_t nnz = received_matrix->row_ptr[received_matrix->n];
+    PyObject* indptr = PyList_New(received_matrix->n + 1);
+    PyObject* indices = PyList_New(nnz);
+    PyObject* data = PyList_New(nnz);
+    for (i=0;i<=received_matrix->n;i++)
+    {
+        PyList_SetItem(indptr, i, PyLong_FromSize_t(received_matrix->row_ptr[i]));
+    }
+    for (p=0;p<nnz;p++)
+    {
+        PyList_SetItem(indices, p, PyLong_FromLong(received_matrix->col_idx[p]));
+        PyList_SetItem(data, p, PyFloat_FromDouble(received_matrix->values[p]));
+    }
+
+    return Py_BuildValue("(NNN)", indptr, indices, data);
+}
 
-    /* Allocate memory for C array */
-    if((vec_arr = matrix_malloc(vec_arr, N, vecdim)) == NULL) return NULL; /* Memory allocation failed */
+/**
+ * Convert a Python tuple of CSR lists to a sparse C matrix.
+ *
+ * indptr must start at 0, never decrease and end at the number of entries, and every index must name a column
+ * of the n x n matrix, since the sparse products index with them unchecked.
+ *
+ * @param obj A PyObject representing a Python tuple (indptr, indices, data).
+ * @return A csrmatrix_t pointer representing the C matrix, or NULL if an error occurs.
+ */
+csrmatrix_t* convert_pytuple2csrmatrix(PyObject* obj)
+{
+    int i, n, valid = 1;
+    size_t p, nnz;
+    PyObject *indptr, *indices, *data;
+    csrmatrix_t* mat;
 
-    /* Convert python list into C array */
-    vec_arr = convert_pylist2carray(vec_arr_obj, vec_arr, N, vecdim);
-    return vec_arr;
+    if(!PyArg_ParseTuple(obj, "OOO", &indptr, &indices, &data)) return NULL;
+    n = PyList_Size(indptr) - 1;
+    nnz = PyList_Size(data);
+    if(n < 0 || PyList_Size(indices) != (Py_ssize_t)nnz)
+    {
+        PyErr_SetString(PyExc_ValueError, "W must be a tuple of CSR lists (indptr, indices, data)");
+        return NULL;
+    }
+    if((mat = csrmatrix_create(n, nnz)) == NULL) /* Memory allocation failed */
+    {
+        PyErr_NoMemory();
+        return NULL;
+    }
+    for (i=0;i<=n;i++)
+    {
+        Py_ssize_t start = PyLong_AsSsize_t(PyList_GetItem(indptr, i));
+        /* The products trust the rows to be in order and within the entries */
+        if(start < 0 || (size_t)start > nnz || (i > 0 && (size_t)start < mat->row_ptr[i-1])) valid = 0;
+        mat->row_ptr[i] = start < 0 ? 0 : (size_t)start;
+    }
+    for (p=0;p<nnz;p++)
+    {
+        long col = PyLong_AsLong(PyList_GetItem(indices, p));
+        if(col < 0 || col >= n) valid = 0;
+        mat->col_idx[p] = (int)col;
+        mat->values[p] = PyFloat_AsDouble(PyList_GetItem(data, p));
+    }
+    if(PyErr_Occurred() || !valid || mat->row_ptr[0] != 0 || mat->row_ptr[n] != nnz)
+    {
+        csrmatrix_destroy(mat);
+        if(!PyErr_Occurred()) PyErr_SetString(PyExc_ValueError, "W must be a tuple of CSR lists (indptr, indices, data)");
+        return NULL;
+    }
+    return mat;
 }
 
 /**
  * Perform Symmetric Non-negative Matrix Factorization (SymNMF) on the given vectors.
  *
- * This function takes a Python list of vectors, converts it to a C array, performs SymNMF,
- * and returns the resulting matrix as a Python list of lists. It handles memory allocation
- * and deallocation for the C arrays.
+ * This function takes a Python list of vectors or a float64 array, converts it to a C array, performs SymNMF,
+ * and returns the resulting matrix as a Python list of lists, or as a NumPy array if it was given an array.
+ * It handles memory allocation and deallocation for the C arrays.
  *
  * @param self A PyObject representing the module or class (not used).
  * @param args A PyObject representing the arguments passed to the function.
- * @return A PyObject representing the resulting matrix as a Python list of lists, or NULL if an error occurs.
+ * @return A PyObject representing the resulting matrix, or NULL if an error occurs.
  */
 static PyObject* symmodule(PyObject* self, PyObject* args)
 {
-    double** vectors_matrix = convert_vectors(self, args);
+    Py_buffer view;
+    symmatrix_t* sym_matrix;
+    matrix_t* vectors_matrix = convert_vectors(self, args, &view);
     if(vectors_matrix == NULL) return NULL; /* Failure occured */
-    
-    double** sym_matrix = sym(vectors_matrix, N, vecdim);
+    int as_array = (view.obj != NULL);
+
+    /* The C code touches no Python object, other threads run meanwhile */
+    Py_BEGIN_ALLOW_THREADS
+    sym_matrix = calc_sym(vectors_matrix);
+    Py_END_ALLOW_THREADS
+    release_carray(vectors_matrix, &view);
     if(sym_matrix == NULL) /* Memory allocation failed */
     {
-        matrix_free(vectors_matrix, N);
-        return NULL;
+        return PyErr_NoMemory();
     }
 
-    /* Convert our C double** to a python list of lists */
-    PyObject* final_sym = convert_carray2pylist(sym_matrix, N, N);
+    /* Convert our packed C matrix to a python list of lists or a NumPy array */
+    PyObject* final_sym = as_array ? convert_symmatrix2pyarray(self, sym_matrix) : convert_symmatrix2pylist(sym_matrix);
 
     /* Free all allocated memory */
-    matrix_free(vectors_matrix, N);
-    matrix_free(sym_matrix, N);
+    symmatrix_destroy(sym_matrix);
 
-    return Py_BuildValue("O", final_sym);
+    return final_sym;
 }
 
 /**
  * Perform Degree Diagonal Matrix (DDG) calculation on the given vectors.
  *
- * This function takes a Python list of vectors, converts it to a C array, performs the DDG calculation,
- * and returns the resulting matrix as a Python list of lists. It handles memory allocation
- * and deallocation for the C arrays.
+ * This function takes a Python list of vectors or a float64 array, converts it to a C array, performs the DDG calculation,
+ * and returns the resulting matrix as a Python list of lists, or as a NumPy array if it was given an array.
+ * It handles memory allocation and deallocation for the C arrays.
  *
  * @param self A PyObject representing the module or class (not used).
  * @param args A PyObject representing the arguments passed to the function.
- * @return A PyObject representing the resulting matrix as a Python list of lists, or NULL if an error occurs.
+ * @return A PyObject representing the resulting matrix, or NULL if an error occurs.
  */
 static PyObject* ddgmodule(PyObject* self, PyObject* args)
 {
-    double** vectors_matrix = convert_vectors(self, args);
+    Py_buffer view;
+    double* ddg_vector;
+    matrix_t* vectors_matrix = convert_vectors(self, args, &view);
     if(vectors_matrix == NULL) return NULL; /* Failure occured */
+    int as_array = (view.obj != NULL);
+    int n = vectors_matrix->rows;
 
-    double** ddg_matrix = ddg(vectors_matrix, N, vecdim);
-    if(ddg_matrix == NULL) /* Memory allocation failed */
+    Py_BEGIN_ALLOW_THREADS
+    ddg_vector = calc_ddg(vectors_matrix);
+    Py_END_ALLOW_THREADS
+    release_carray(vectors_matrix, &view);
+    if(ddg_vector == NULL) /* Memory allocation failed */
     {
-        matrix_free(vectors_matrix, N);
-        return NULL;
+        return PyErr_NoMemory();
     }
 
-    /* Convert our C double** to a python list of lists */
-    PyObject* final_ddg = convert_carray2pylist(ddg_matrix, N, N);
+    /* Convert the diagonal of our C matrix to a python list of lists or a NumPy array */
+    PyObject* final_ddg = as_array ? convert_diagonal2pyarray(self, ddg_vector, n) : convert_diagonal2pylist(ddg_vector, n);
 
     /* Free all allocated memory */
-    matrix_free(vectors_matrix, N);
-    matrix_free(ddg_matrix, N);
+    free(ddg_vector);
 
-    return Py_BuildValue("O", final_ddg);
+    return final_ddg;
 }
 
 /**
  * Perform Normalization on the given vectors.
  *
- * This function takes a Python list of vectors, converts it to a C array, performs normalization,
- * and returns the resulting matrix as a Python list of lists. It handles memory allocation
- * and deallocation for the C arrays.
+ * This function takes a Python list of vectors or a float64 array, converts it to a C array, performs normalization,
+ * and returns the resulting matrix as a Python list of lists, or as a NumPy array if it was given an array.
+ * It handles memory allocation and deallocation for the C arrays.
  *
  * @param self A PyObject representing the module or class (not used).
- * @param args A PyObject representing the arguments passed to the function.
- * @return A PyObject representing the resulting matrix as a Python list of lists, or NULL if an error occurs.
+ * @param args A PyObject holding the list or float64 array of vectors.
+ * @param kwargs A PyObject holding cache_dir, the directory of the cached norm matrices, by default $SYMNMF_CACHE_DIR;
+ *               a cached matrix of the same vectors is reused and a calculated one is saved there.
+ * @return A PyObject representing the resulting matrix, or NULL if an error occurs.
  */
-static PyObject* normmodule(PyObject* self, PyObject* args)
+static PyObject* normmodule(PyObject* self, PyObject* args, PyObject* kwargs)
 {
-    double** vectors_matrix = convert_vectors(self, args);
+    static char* kwlist[] = {"vectors", "cache_dir", NULL};
+    PyObject* vec_arr_obj;
+    const char* cache_dir = getenv("SYMNMF_CACHE_DIR");
+    if(!PyArg_ParseTupleAndKeywords(args, kwargs, "O|z", kwlist, &vec_arr_obj, &cache_dir)) return NULL;
+
+    Py_buffer view;
+    symmatrix_t* norm_matrix;
+    binfile_t* cache_file;
+    matrix_t* vectors_matrix = convert_pyobject2carray(vec_arr_obj, &view);
     if(vectors_matrix == NULL) return NULL; /* Failure occured */
+    int as_array = (view.obj != NULL);
 
-    double** norm_matrix = norm(vectors_matrix, N, vecdim);
+    /* The C code touches no Python object, other threads run meanwhile */
+    Py_BEGIN_ALLOW_THREADS
+    norm_matrix = calc_norm_cached(vectors_matrix, cache_dir, &cache_file);
+    Py_END_ALLOW_THREADS
+    release_carray(vectors_matrix, &view);
     if(norm_matrix == NULL) /* Memory allocation failed */
     {
-        matrix_free(vectors_matrix, N);
-        return NULL;
+        return PyErr_NoMemory();
     }
 
-    /* Convert our C double** to a python list of lists */
-    PyObject* final_norm = convert_carray2pylist(norm_matrix, N, N);
+    /* Convert our packed C matrix to a python list of lists or a NumPy array, both copy the cached file */
+    PyObject* final_norm = as_array ? convert_symmatrix2pyarray(self, norm_matrix) : convert_symmatrix2pylist(norm_matrix);
 
     /* Free all allocated memory */
-    matrix_free(vectors_matrix, N);
-    matrix_free(norm_matrix, N);
+    symmatrix_destroy(norm_matrix);
+    binfile_close(cache_file);
 
-    return Py_BuildValue("O", final_norm);
+    return final_norm;
 }
 
 /**
- * Perform Symmetric Non-negative Matrix Factorization (SymNMF) on the given vectors.
- *
- * This function takes a Python list of vectors, converts it to a C array, performs SymNMF,
- * and returns the resulting matrix as a Python list of lists. It handles memory allocation
- * and deallocation for the C arrays.
+ * Calculate the sparse similarity matrix of the given vectors.
  *
  * @param self A PyObject representing the module or class (not used).
- * @param args A PyObject representing the arguments passed to the function.
- * @return A double pointer representing the resulting matrix as a C array, or NULL if an error occurs.
+ * @param args A PyObject holding the list or float64 array of vectors.
+ * @param kwargs A PyObject holding either knn, the number of nearest neighbours kept, or epsilon, the smallest affinity kept.
+ * @return A PyObject representing the matrix as a tuple of CSR lists, or NULL if an error occurs.
  */
-double** convert_symnmf(PyObject* self, PyObject* args)
+static PyObject* sparsesymmodule(PyObject* self, PyObject* args, PyObject* kwargs)
 {
-    PyObject* w_mat_obj;
-    PyObject* h_mat_obj;
-    double** w_mat = NULL;
-    double** h_mat = NULL;
-    
-    /* Parse Python arguments: */
-    if(!PyArg_ParseTuple(args, "OOi", &w_mat_obj, &h_mat_obj, &k)) return NULL; /* In the CPython API, a NULL value is never valid for a
-                                                                                                    PyObject* so it is used to signal that an error has occurred. */
-    
-    /* Get N and vecdim from the python object */
-    N = PyList_Size(w_mat_obj);
+    int knn;
+    double epsilon;
+    Py_buffer view;
+    csrmatrix_t* sym_matrix;
+    matrix_t* vectors_matrix = convert_sparse_vectors(args, kwargs, &knn, &epsilon, &view);
+    if(vectors_matrix == NULL) return NULL; /* Failure occured */
 
-    /* Allocate memory for C arrays and check if allocation failed */
-    if((w_mat = matrix_malloc(w_mat, N, N)) == NULL) return NULL; /* Memory allocation failed */
-    if((h_mat = matrix_malloc(h_mat, N, k)) == NULL) /* Memory allocation failed */
+    Py_BEGIN_ALLOW_THREADS
+    sym_matrix = calc_sparse_sym(vectors_matrix, knn, epsilon);
+    Py_END_ALLOW_THREADS
+    release_carray(vectors_matrix, &view);
+    if(sym_matrix == NULL) /* Memory allocation failed */
     {
-        matrix_free(w_mat, N);
-        return NULL;
+        return PyErr_NoMemory();
     }
 
-    /* Convert python lists into C arrays */
-    w_mat = convert_pylist2carray(w_mat_obj, w_mat, N, N);
-    h_mat = convert_pylist2carray(h_mat_obj, h_mat, N, k);
+    PyObject* final_sym = convert_csrmatrix2pytuple(sym_matrix);
+    csrmatrix_destroy(sym_matrix);
 
-    /* Call the symnmf function */
-    double** final_h = symnmf(w_mat, h_mat, N, k);
-    if(final_h == NULL) /* Memory allocation failed*/
+    return final_sym;
+}
+
+/**
+ * Calculate the degrees of the sparse similarity matrix of the given vectors.
+ *
+ * @param self A PyObject representing the module or class (not used).
+ * @param args A PyObject holding the list or float64 array of vectors.
+ * @param kwargs A PyObject holding either knn, the number of nearest neighbours kept, or epsilon, the smallest affinity kept.
+ * @return A PyObject representing the N degrees as a Python list, or NULL if an error occurs.
+ */
+static PyObject* sparseddgmodule(PyObject* self, PyObject* args, PyObject* kwargs)
+{
+    int i, knn;
+    double epsilon;
+    Py_buffer view;
+    double* ddg_vector;
+    matrix_t* vectors_matrix = convert_sparse_vectors(args, kwargs, &knn, &epsilon, &view);
+    if(vectors_matrix == NULL) return NULL; /* Failure occured */
+    int n = vectors_matrix->rows;
+
+    Py_BEGIN_ALLOW_THREADS
+    ddg_vector = calc_sparse_ddg(vectors_matrix, knn, epsilon);
+    Py_END_ALLOW_THREADS
+    release_carray(vectors_matrix, &view);
+    if(ddg_vector == NULL) /* Memory allocation failed */
     {
-        matrix_free(w_mat, N);
-        matrix_free(h_mat, N);
-        return NULL;
+        return PyErr_NoMemory();
     }
 
-    /* Free all allocated memory */
-    matrix_free(w_mat, N);
-    matrix_free(h_mat, N);
+    /* Only the diagonal is returned, the dense N*N matrix is what the sparse mode avoids */
+    PyObject* final_ddg = PyList_New(n);
+    for (i=0;i<n;i++)
+    {
+        PyList_SetItem(final_ddg, i, PyFloat_FromDouble(ddg_vector[i]));
+    }
+    free(ddg_vector);
 
-    return final_h;
+    return final_ddg;
 }
 
 /**
- * Perform Symmetric Non-negative Matrix Factorization (SymNMF) on the given vectors.
- *
- * This function takes a Python list of vectors, converts it to a C array, performs SymNMF,
- * and returns the resulting H matrix as a Python list of lists. It handles memory allocation
- * and deallocation for the C arrays.
+ * Calculate the sparse normalized similarity matrix of the given vectors.
  *
  * @param self A PyObject representing the module or class (not used).
- * @param args A PyObject representing the arguments passed to the function.
- * @return A PyObject representing the resulting H matrix as a Python list of lists, or NULL if an error occurs.
+ * @param args A PyObject holding the list or float64 array of vectors.
+ * @param kwargs A PyObject holding either knn, the number of nearest neighbours kept, or epsilon, the smallest affinity kept.
+ * @return A PyObject representing the matrix as a tuple of CSR lists, or NULL if an error occurs.
  */
-static PyObject* symnmfmodule(PyObject* self, PyObject* args)
-{    
-    double** h_matrix = convert_symnmf(self, args);
-    if(h_matrix == NULL) return NULL; /* Failure occured */
+static PyObject* sparsenormmodule(PyObject* self, PyObject* args, PyObject* kwargs)
+{
+    int knn;
+    double epsilon;
+    Py_buffer view;
+    csrmatrix_t* norm_matrix;
+    matrix_t* vectors_matrix = convert_sparse_vectors(args, kwargs, &knn, &epsilon, &view);
+    if(vectors_matrix == NULL) return NULL; /* Failure occured */
 
-    PyObject* final_h = convert_carray2pylist(h_matrix, N, k);
+    Py_BEGIN_ALLOW_THREADS
+    norm_matrix = calc_sparse_norm(vectors_matrix, knn, epsilon);
+    Py_END_ALLOW_THREADS
+    release_carray(vectors_matrix, &view);
+    if(norm_matrix == NULL) /* Memory allocation failed */
+    {
+        return PyErr_NoMemory();
+    }
+
+    PyObject* final_norm = convert_csrmatrix2pytuple(norm_matrix);
+    csrmatrix_destroy(norm_matrix);
 
-    return Py_BuildValue("O", final_h);;
+    return final_norm;
 }
 
-static PyMethodDef symnmfMethods[] = {
-    {"sym",                   /* the Python method name that will be used */
-      (PyCFunction) symmodule, /* the C-function that implements the Python function and returns static PyObject*  */
-      METH_VARARGS,           /* flags indicating parameters accepted for this function */
+/**
+ * Convert a low-rank C matrix to a Python tuple (F, shift).
+ *
+ * @param module A PyObject representing the module.
+ * @param received_matrix A lowrank_t pointer representing the C matrix, an array takes its factor over.
+ * @param as_array An integer, 1 to return F as a NumPy array, 0 as a list of lists.
+ * @return A PyObject representing the tuple of F and the list of shift, or NULL if an error occurs.
+ */
+PyObject* convert_lowrank2pytuple(PyObject* module, lowrank_t* received_matrix, int as_array)
+{
+    PyObject* final_factor;
+    PyObject* final_shift = PyList_New(received_matrix->n);
+    if(final_shift == NULL) return NULL;
+    for (int i=0;i<received_matrix->n;i++)
+    {
+        PyList_SetItem(final_shift, i, PyFloat_FromDouble(received_matrix->shift[i]));
+    }
+    if(as_array)
+    {
+        final_factor = convert_carray2pyarray(module, received_matrix->factor); /* The array owns the factor from now on */
+        received_matrix->factor = NULL;
+    }
+    else
+    {
+        final_factor = convert_carray2pylist(received_matrix->factor);
+    }
+    if(final_factor == NULL)
+    {
+        Py_DECREF(final_shift);
+        return NULL;
+    }
+    return Py_BuildValue("(NN)", final_factor, final_shift);
+}
+
+/**
+ * Calculate the Nystrom approximation of the norm matrix of the given vectors from landmark points.
+ *
+ * Only the affinities of every vector to the landmarks are calculated, and W is returned in its
+ * low-rank form W ~ F*F^T - diag(shift), so nothing of size N*N is made.
+ *
+ * @param self A PyObject representing the module.
+ * @param args A PyObject holding the list or float64 array of vectors and the number of landmarks.
+ * @param kwargs A PyObject holding the optional seed of the choice of the landmarks (default 1234).
+ * @return A PyObject representing the tuple (F, shift), F as a NumPy array if the vectors were an array or a
+ *         list of lists otherwise and shift as a list, or NULL if an error occurs.
+ */
+static PyObject* nystromnormmodule(PyObject* self, PyObject* args, PyObject* kwargs)
+{
+    static char* kwlist[] = {"vectors", "landmarks", "seed", NULL};
+    PyObject* vec_arr_obj;
+    int landmarks;
+    unsigned long long seed = 1234;
+    if(!PyArg_ParseTupleAndKeywords(args, kwargs, "Oi|$K", kwlist, &vec_arr_obj, &landmarks, &seed)) return NULL;
+    if(landmarks < 1 || seed > 0xffffffffULL)
+    {
+        PyErr_SetString(PyExc_ValueError, "landmarks must be at least 1 and seed below 2**32");
+        return NULL;
+    }
+
+    Py_buffer view;
+    matrix_t* vectors_matrix = convert_pyobject2carray(vec_arr_obj, &view);
+    if(vectors_matrix == NULL) return NULL; /* Failure occured */
+    int as_array = (view.obj != NULL);
+    lowrank_t* norm_matrix;
+
+    Py_BEGIN_ALLOW_THREADS
+    norm_matrix = calc_norm_nystrom(vectors_matrix, landmarks, (unsigned long)seed);
+    Py_END_ALLOW_THREADS
+    release_carray(vectors_matrix, &view);
+    if(norm_matrix == NULL) /* Memory allocation failed */
+    {
+        return PyErr_NoMemory();
+    }
+
+    PyObject* final_norm = convert_lowrank2pytuple(self, norm_matrix, as_array);
+    lowrank_destroy(norm_matrix);
+
+    return final_norm;
+}
+
+/**
+ * Convert a Python norm matrix W to a packed or a sparse C matrix.
+ *
+ * W is a list of lists, a float64 array or a tuple of CSR lists from sparse_norm;
+ * only the upper triangle of tiles of a dense W is read.
+ *
+ * @param w_mat_obj A PyObject representing W.
+ * @param w_mat A symmatrix_t pointer pointer set to the packed W, or to NULL if W is sparse.
+ * @param w_sparse A csrmatrix_t pointer pointer set to the sparse W, or to NULL if W is dense.
+ * @return The size N of W, or -1 if an error occurs.
+ */
+int convert_pyobject2norm(PyObject* w_mat_obj, symmatrix_t** w_mat, csrmatrix_t** w_sparse)
+{
+    int i,j,n;
+    Py_buffer w_view;
+    matrix_t* w_dense;
+
+    *w_mat = NULL;
+    *w_sparse = NULL;
+    if(PyTuple_Check(w_mat_obj))
+    {
+        if((*w_sparse = convert_pytuple2csrmatrix(w_mat_obj)) == NULL) return -1;
+        return (*w_sparse)->n;
+    }
+    if(PyObject_CheckBuffer(w_mat_obj))
+    {
+        if((w_dense = convert_pyobject2carray(w_mat_obj, &w_view)) == NULL) return -1;
+        n = w_dense->rows;
+        if(w_dense->cols != n)
+        {
+            release_carray(w_dense, &w_view);
+            PyErr_SetString(PyExc_ValueError, "W must be a square matrix");
+            return -1;
+        }
+        if((*w_mat = symmatrix_create(n)) != NULL)
+        {
+            /* Only the packed upper triangle of tiles is read, as by convert_pylist2symmatrix */
+            for (i=0;i<n;i++)
+            {
+                for (j=i/(*w_mat)->tile*(*w_mat)->tile;j<n;j++)
+                {
+                    *symmatrix_entry(*w_mat, i, j) = MATRIX_AT(w_dense, i, j);
+                }
+            }
+        }
+        release_carray(w_dense, &w_view);
+        if(*w_mat == NULL) /* Memory allocation failed */
+        {
+            PyErr_NoMemory();
+            return -1;
+        }
+        return n;
+    }
+
+    /* Get N from the python object */
+    n = PyList_Size(w_mat_obj);
+
+    /* Allocate memory for C arrays and check if allocation failed */
+    if((*w_mat = symmatrix_create(n)) == NULL) /* Memory allocation failed */
+    {
+        PyErr_NoMemory();
+        return -1;
+    }
+    *w_mat = convert_pylist2symmatrix(w_mat_obj, *w_mat);
+    return n;
+}
+
+/**
+ * Check the parameters of symnmf given from Python and set the solver by its name.
+ *
+ * @param params A symnmf_params_t pointer holding the parameters.
+ * @param solver The name of the solver, or NULL for the default.
+ * @return 1 if max_iter >= 0, eps >= 0, 0 < beta <= 1 and the solver exists, otherwise 0 with a ValueError set.
+ */
+int check_params(symnmf_params_t* params, const char* solver)
+{
+    if(params->max_iter < 0 || !(params->eps >= 0) || !(params->beta > 0 && params->beta <= 1))
+    {
+        PyErr_SetString(PyExc_ValueError, "max_iter and eps must be >= 0 and beta in (0, 1]");
+        return 0;
+    }
+    if(solver != NULL && (params->solver = symnmf_solver_id(solver)) < 0)
+    {
+        PyErr_Format(PyExc_ValueError, "unknown solver '%s', expected mu, accelerated or hals", solver);
+        return 0;
+    }
+    return 1;
+}
+
+/**
+ * Check the storage type of W given from Python.
+ *
+ * @param dtype The name of the type, "float64" or "float32", or NULL for float64.
+ * @param single An integer pointer set to 1 for float32, 0 for float64.
+ * @return 1 if the type exists, otherwise 0 with a ValueError set.
+ */
+int check_dtype(const char* dtype, int* single)
+{
+    *single = (dtype != NULL && !strcmp(dtype, "float32"));
+    if(dtype != NULL && !*single && strcmp(dtype, "float64"))
+    {
+        PyErr_Format(PyExc_ValueError, "unknown dtype '%s', expected float64 or float32", dtype);
+        return 0;
+    }
+    return 1;
+}
+
+/**
+ * Widen a packed W of floats back to doubles, to hand it to Python.
+ *
+ * @param w_single A symmatrixf_t pointer representing the W of floats.
+ * @return A symmatrix_t pointer representing the same W in doubles, or NULL if allocation failed.
+ */
+symmatrix_t* convert_symmatrixf2symmatrix(const symmatrixf_t* w_single)
+{
+    symmatrix_t* w_mat = symmatrix_create(w_single->n);
+    if(w_mat == NULL) return NULL;
+    size_t count = (size_t)w_single->tiles * (size_t)(w_single->tiles + 1) / 2 * (size_t)w_single->tile * (size_t)w_single->tile;
+    for(size_t e=0;e<count;e++)
+    {
+        w_mat->data[e] = w_single->data[e];
+    }
+    return w_mat;
+}
+
+/**
+ * Convert a symnmf report to a Python dict.
+ *
+ * @param report A symnmf_report_t pointer representing the report.
+ * @return A PyObject representing the dict of iterations, converged, delta, objectives and seconds, or NULL if an error occurs.
+ */
+PyObject* convert_report2pydict(const symnmf_report_t* report)
+{
+    int i;
+    PyObject* objectives = PyList_New(report->iterations);
+    PyObject* seconds = PyList_New(report->iterations);
+    if(objectives == NULL || seconds == NULL)
+    {
+        Py_XDECREF(objectives);
+        Py_XDECREF(seconds);
+        return NULL;
+    }
+    for (i=0;i<report->iterations;i++)
+    {
+        PyList_SetItem(objectives, i, PyFloat_FromDouble(report->objectives[i]));
+        PyList_SetItem(seconds, i, PyFloat_FromDouble(report->seconds[i]));
+    }
+    return Py_BuildValue("{s:i,s:O,s:d,s:N,s:N}", "iterations", report->iterations,
+                         "converged", report->converged ? Py_True : Py_False, "delta", report->delta,
+                         "objectives", objectives, "seconds", seconds);
+}
+
+/**
+ * Perform Symmetric Non-negative Matrix Factorization (SymNMF) on the given vectors.
+ *
+ * This function takes the W and H matrices, converts them to C arrays, performs SymNMF,
+ * and returns the resulting matrix as a C matrix. W is a list of lists, a float64 array
+ * or a tuple of CSR lists from sparse_norm, H is a list of lists or a float64 array.
+ * It handles memory allocation and deallocation for the C arrays.
+ *
+ * @param self A PyObject representing the module or class (not used).
+ * @param args A PyObject representing the arguments passed to the function.
+ * @param kwargs A PyObject holding the optional max_iter, eps, beta and solver of symnmf_params_t, report and
+ *               dtype, "float32" to factorize a dense W rounded to floats.
+ * @param as_array An integer pointer set to 1 if H was given as an array, 0 otherwise.
+ * @param report A symnmf_report_t pointer filled with the iterations run if report=True was given, its iterations are set to -1 otherwise.
+ * @return A matrix_t pointer representing the resulting matrix as a C matrix, or NULL if an error occurs.
+ */
+matrix_t* convert_symnmf(PyObject* self, PyObject* args, PyObject* kwargs, int* as_array, symnmf_report_t* report)
+{
+    static char* kwlist[] = {"W", "H", "k", "max_iter", "eps", "beta", "solver", "report", "dtype", NULL};
+    int n,k,want_report = 0,single;
+    const char* solver = NULL;
+    const char* dtype = NULL;
+    PyObject* w_mat_obj;
+    PyObject* h_mat_obj;
+    Py_buffer h_view;
+    symmatrix_t* w_mat;
+    csrmatrix_t* w_sparse;
+    symmatrixf_t* w_single = NULL;
+    matrix_t* h_mat = NULL;
+    matrix_t* final_h;
+    symnmf_params_t params;
+
+    symnmf_params_default(&params);
+    report->iterations = -1;
+    
+    /* Parse Python arguments: */
+    if(!PyArg_ParseTupleAndKeywords(args, kwargs, "OOi|$iddzpz", kwlist, &w_mat_obj, &h_mat_obj, &k,
+                                    &params.max_iter, &params.eps, &params.beta, &solver, &want_report, &dtype)) return NULL; /* In the CPython API, a NULL value is never valid for a
+                                                                                                    PyObject* so it is used to signal that an error has occurred. */
+    if(!check_params(&params, solver) || !check_dtype(dtype, &single)) return NULL;
+    
+    /* W is a list of lists, a float64 buffer or a tuple of CSR lists from sparse_norm */
+    if((n = convert_pyobject2norm(w_mat_obj, &w_mat, &w_sparse)) < 0) return NULL;
+    if(single && w_sparse != NULL)
+    {
+        csrmatrix_destroy(w_sparse);
+        PyErr_SetString(PyExc_ValueError, "dtype float32 needs a dense W");
+        return NULL;
+    }
+    if(single)
+    {
+        /* Only the floats are kept for the iterations */
+        w_single = symmatrixf_from_symmatrix(w_mat);
+        symmatrix_destroy(w_mat);
+        w_mat = NULL;
+        if(w_single == NULL) /* Memory allocation failed */
+        {
+            PyErr_NoMemory();
+            return NULL;
+        }
+    }
+
+    /* Convert H, an array is borrowed without copying */
+    if((h_mat = convert_pyobject2carray(h_mat_obj, &h_view)) == NULL)
+    {
+        symmatrix_destroy(w_mat);
+        symmatrixf_destroy(w_single);
+        csrmatrix_destroy(w_sparse);
+        return NULL;
+    }
+    *as_array = (h_view.obj != NULL);
+    if(h_mat->rows != n || h_mat->cols != k)
+    {
+        symmatrix_destroy(w_mat);
+        symmatrixf_destroy(w_single);
+        csrmatrix_destroy(w_sparse);
+        release_carray(h_mat, &h_view);
+        PyErr_SetString(PyExc_ValueError, "H must be N*k");
+        return NULL;
+    }
+
+    /* Call the symnmf function, other threads run meanwhile */
+    Py_BEGIN_ALLOW_THREADS
+    if(w_sparse != NULL) final_h = calc_symnmf_sparse(w_sparse, h_mat, &params, want_report ? report : NULL);
+    else if(w_single != NULL) final_h = calc_symnmf_f32(w_single, h_mat, &params, want_report ? report : NULL);
+    else final_h = calc_symnmf(w_mat, h_mat, &params, want_report ? report : NULL);
+    Py_END_ALLOW_THREADS
+
+    /* Free all allocated memory */
+    symmatrix_destroy(w_mat);
+    symmatrixf_destroy(w_single);
+    csrmatrix_destroy(w_sparse);
+    release_carray(h_mat, &h_view);
+    if(final_h == NULL) /* Memory allocation failed*/
+    {
+        PyErr_NoMemory();
+        return NULL;
+    }
+
+    return final_h;
+}
+
+/**
+ * Perform Symmetric Non-negative Matrix Factorization (SymNMF) on the given vectors.
+ *
+ * This function takes the W and H matrices, converts them to C arrays, performs SymNMF,
+ * and returns the resulting H matrix as a Python list of lists, or as a NumPy array viewing
+ * the C result if H was given as an array. It handles memory allocation and deallocation for the C arrays.
+ * With report=True it returns (H, report), the report being a dict of the iterations run, whether
+ * the updates converged below eps, the final delta, and the objective and seconds of every iteration.
+ *
+ * @param self A PyObject representing the module or class (not used).
+ * @param args A PyObject representing the arguments passed to the function.
+ * @param kwargs A PyObject holding the optional max_iter, eps, beta, solver, report and dtype.
+ * @return A PyObject representing the resulting H matrix, or NULL if an error occurs.
+ */
+static PyObject* symnmfmodule(PyObject* self, PyObject* args, PyObject* kwargs)
+{    
+    int as_array;
+    symnmf_report_t report = {0};
+    PyObject* final_h;
+    matrix_t* h_matrix = convert_symnmf(self, args, kwargs, &as_array, &report);
+    if(h_matrix == NULL) return NULL; /* Failure occured */
+
+    if(as_array)
+    {
+        final_h = convert_carray2pyarray(self, h_matrix); /* The array owns h_matrix from now on */
+    }
+    else
+    {
+        final_h = convert_carray2pylist(h_matrix);
+        matrix_destroy(h_matrix);
+    }
+    if(report.iterations < 0 || final_h == NULL) return final_h;
+
+    PyObject* report_dict = convert_report2pydict(&report);
+    symnmf_report_free(&report);
+    if(report_dict == NULL)
+    {
+        Py_DECREF(final_h);
+        return NULL;
+    }
+    return Py_BuildValue("(NN)", final_h, report_dict);
+}
+
+/**
+ * Calculate W and run SymNMF from a seeded random H in one call.
+ *
+ * The norm matrix, dense or sparse, its mean and the initial H, uniform in [0, 2*sqrt(mean/k)) as drawn by
+ * np.random.RandomState(seed).uniform in symnmf.py, are all made in C with the GIL released, so W never crosses
+ * into Python unless return_W is given. The dense W is reused from, and saved to, cache_dir as by norm.
+ * With dtype="float32" the dense W is stored as floats, built straight into floats when there is no cache,
+ * while H and every sum stay in double; a returned W is widened back to float64.
+ * With w_file the dense W is built into that matrix file instead of memory and streamed from it by every
+ * product, for a W larger than memory; the file is left in place for load or a later run.
+ * With landmarks the dense W is replaced by its Nystrom approximation from that many landmark points, chosen
+ * by the same seed, and every product costs O(N*landmarks*k); a returned W is then the tuple of nystrom_norm.
+ *
+ * @param self A PyObject representing the module.
+ * @param args A PyObject holding the list or float64 array of vectors and k.
+ * @param kwargs A PyObject holding the optional seed (default 1234), knn or epsilon of a sparse W, cache_dir,
+ *               solver, max_iter, eps and beta of symnmf, report, return_W, dtype, w_file and landmarks.
+ * @return A PyObject representing H, as a NumPy array if the vectors were an array or a list of lists otherwise,
+ *         followed in a tuple by W if return_W and by the report dict if report, or NULL if an error occurs.
+ */
+static PyObject* fitmodule(PyObject* self, PyObject* args, PyObject* kwargs)
+{
+    static char* kwlist[] = {"vectors", "k", "seed", "knn", "epsilon", "cache_dir", "solver",
+                             "max_iter", "eps", "beta", "report", "return_W", "dtype", "w_file", "landmarks", NULL};
+    PyObject* vec_arr_obj;
+    int k, knn = 0, want_report = 0, want_W = 0, single, landmarks = 0;
+    unsigned long long seed = 1234;
+    double epsilon = 0;
+    const char* cache_dir = getenv("SYMNMF_CACHE_DIR");
+    const char* solver = NULL;
+    const char* dtype = NULL;
+    const char* w_file = NULL;
+    symnmf_params_t params;
+    symnmf_report_t report = {0};
+
+    symnmf_params_default(&params);
+    if(!PyArg_ParseTupleAndKeywords(args, kwargs, "Oi|$Kidzziddppzzi", kwlist, &vec_arr_obj, &k, &seed, &knn, &epsilon,
+                                    &cache_dir, &solver, &params.max_iter, &params.eps, &params.beta,
+                                    &want_report, &want_W, &dtype, &w_file, &landmarks)) return NULL;
+    if(!check_params(&params, solver) || !check_dtype(dtype, &single)) return NULL;
+    if(seed > 0xffffffffULL || knn < 0 || epsilon < 0 || (knn > 0 && epsilon > 0))
+    {
+        PyErr_SetString(PyExc_ValueError, "seed must be below 2**32, and at most one of knn and epsilon positive");
+        return NULL;
+    }
+    if(single && (knn > 0 || epsilon > 0))
+    {
+        PyErr_SetString(PyExc_ValueError, "dtype float32 needs a dense W, without knn or epsilon");
+        return NULL;
+    }
+    if(w_file != NULL && (single || knn > 0 || epsilon > 0))
+    {
+        PyErr_SetString(PyExc_ValueError, "w_file needs a dense float64 W, without knn, epsilon or dtype float32");
+        return NULL;
+    }
+    if(landmarks < 0 || (landmarks > 0 && (single || w_file != NULL || knn > 0 || epsilon > 0)))
+    {
+        PyErr_SetString(PyExc_ValueError, "landmarks must be positive, without knn, epsilon, dtype float32 or w_file");
+        return NULL;
+    }
+
+    Py_buffer view;
+    matrix_t* vectors_matrix = convert_pyobject2carray(vec_arr_obj, &view);
+    if(vectors_matrix == NULL) return NULL; /* Failure occured */
+    int as_array = (view.obj != NULL);
+    if(k < 1 || k >= vectors_matrix->rows)
+    {
+        release_carray(vectors_matrix, &view);
+        PyErr_SetString(PyExc_ValueError, "k must be at least 1 and less than the number of vectors");
+        return NULL;
+    }
+
+    symmatrix_t* w_mat = NULL;
+    symmatrixf_t* w_single = NULL;
+    csrmatrix_t* w_sparse = NULL;
+    lowrank_t* w_lowrank = NULL;
+    binfile_t* cache_file = NULL;
+    matrix_t* h_matrix = NULL;
+    Py_BEGIN_ALLOW_THREADS
+    if(knn > 0 || epsilon > 0)
+    {
+        if((w_sparse = calc_sparse_norm(vectors_matrix, knn, epsilon)) != NULL)
+        {
+            h_matrix = calc_symnmf_sparse_random(w_sparse, k, (unsigned long)seed, &params, want_report ? &report : NULL);
+        }
+    }
+    else if(landmarks > 0)
+    {
+        if((w_lowrank = calc_norm_nystrom(vectors_matrix, landmarks, (unsigned long)seed)) != NULL)
+        {
+            h_matrix = calc_symnmf_random_lowrank(w_lowrank, k, (unsigned long)seed, &params, want_report ? &report : NULL);
+        }
+    }
+    else if(w_file != NULL)
+    {
+        if((w_mat = calc_norm_file(vectors_matrix, w_file, &cache_file)) != NULL)
+        {
+            h_matrix = calc_symnmf_random_stream(w_mat, k, (unsigned long)seed, &params, want_report ? &report : NULL);
+        }
+    }
+    else if(single)
+    {
+        /* A cached W is rounded from its mapping, otherwise W is built straight into floats */
+        if(cache_dir != NULL && (w_mat = calc_norm_cached(vectors_matrix, cache_dir, &cache_file)) != NULL)
+        {
+            w_single = symmatrixf_from_symmatrix(w_mat);
+            symmatrix_destroy(w_mat);
+            binfile_close(cache_file);
+            w_mat = NULL;
+            cache_file = NULL;
+        }
+        else if(cache_dir == NULL)
+        {
+            w_single = calc_norm_f32(vectors_matrix);
+        }
+        if(w_single != NULL)
+        {
+            h_matrix = calc_symnmf_random_f32(w_single, k, (unsigned long)seed, &params, want_report ? &report : NULL);
+        }
+    }
+    else if((w_mat = calc_norm_cached(vectors_matrix, cache_dir, &cache_file)) != NULL)
+    {
+        h_matrix = calc_symnmf_random(w_mat, k, (unsigned long)seed, &params, want_report ? &report : NULL);
+    }
+    Py_END_ALLOW_THREADS
+    release_carray(vectors_matrix, &view);
+
+    PyObject* final_h = NULL;
+    PyObject* final_w = NULL;
+    PyObject* report_dict = NULL;
+    if(h_matrix == NULL) /* Memory allocation failed */
+    {
+        PyErr_NoMemory();
+    }
+    else
+    {
+        if(as_array)
+        {
+            final_h = convert_carray2pyarray(self, h_matrix); /* The array owns h_matrix from now on */
+        }
+        else
+        {
+            final_h = convert_carray2pylist(h_matrix);
+            matrix_destroy(h_matrix);
+        }
+        if(final_h != NULL && want_W && w_single != NULL && (w_mat = convert_symmatrixf2symmatrix(w_single)) == NULL)
+        {
+            Py_CLEAR(final_h);
+            PyErr_NoMemory();
+        }
+        if(final_h != NULL && want_W)
+        {
+            if(w_sparse != NULL) final_w = convert_csrmatrix2pytuple(w_sparse);
+            else if(w_lowrank != NULL) final_w = convert_lowrank2pytuple(self, w_lowrank, as_array);
+            else final_w = as_array ? convert_symmatrix2pyarray(self, w_mat) : convert_symmatrix2pylist(w_mat);
+        }
+        if(final_h != NULL && want_report) report_dict = convert_report2pydict(&report);
+    }
+    symnmf_report_free(&report);
+    symmatrix_destroy(w_mat);
+    symmatrixf_destroy(w_single);
+    csrmatrix_destroy(w_sparse);
+    lowrank_destroy(w_lowrank);
+    binfile_close(cache_file);
+
+    if(final_h == NULL || (want_W && final_w == NULL) || (want_report && report_dict == NULL))
+    {
+        Py_XDECREF(final_h);
+        Py_XDECREF(final_w);
+        Py_XDECREF(report_dict);
+        return NULL;
+    }
+    if(want_W && want_report) return Py_BuildValue("(NNN)", final_h, final_w, report_dict);
+    if(want_W) return Py_BuildValue("(NN)", final_h, final_w);
+    if(want_report) return Py_BuildValue("(NN)", final_h, report_dict);
+    return final_h;
+}
+
+/**
+ * Perform a batch of SymNMF factorizations of one W, for several k and several initial H.
+ *
+ * W is converted once and shared read only by all the runs, which run concurrently in C with the GIL released.
+ * Every H is returned as a NumPy array if it was given as an array, or as a list of lists otherwise.
+ *
+ * @param self A PyObject representing the module.
+ * @param args A PyObject holding W, as accepted by symnmf, and a sequence of the initial N*k matrices H, k may differ between them.
+ * @param kwargs A PyObject holding the optional max_iter, eps, beta and solver shared by all the runs.
+ * @return A PyObject representing a list of (H, objective) tuples in the order of the initial matrices,
+ *         objective being ||W - H*H^T||^2, or NULL if an error occurs.
+ */
+static PyObject* symnmfbatchmodule(PyObject* self, PyObject* args, PyObject* kwargs)
+{
+    static char* kwlist[] = {"W", "Hs", "max_iter", "eps", "beta", "solver", NULL};
+    int n, run, runs, failed;
+    const char* solver = NULL;
+    symnmf_params_t params;
+    PyObject* w_mat_obj;
+    PyObject* h_seq_obj;
+    symmatrix_t* w_mat;
+    csrmatrix_t* w_sparse;
+    PyObject* result = NULL;
+
+    symnmf_params_default(&params);
+    if(!PyArg_ParseTupleAndKeywords(args, kwargs, "OO|$iddz", kwlist, &w_mat_obj, &h_seq_obj,
+                                    &params.max_iter, &params.eps, &params.beta, &solver)) return NULL;
+    if(!check_params(&params, solver)) return NULL;
+    PyObject* h_seq = PySequence_Fast(h_seq_obj, "the initial H matrices must be a sequence");
+    if(h_seq == NULL) return NULL;
+    runs = (int) PySequence_Fast_GET_SIZE(h_seq);
+
+    Py_buffer* views = PyMem_Calloc(runs > 0 ? runs : 1, sizeof(Py_buffer));
+    matrix_t** h_inits = PyMem_Calloc(runs > 0 ? runs : 1, sizeof(matrix_t*));
+    matrix_t** results = PyMem_Calloc(runs > 0 ? runs : 1, sizeof(matrix_t*));
+    double* objectives = PyMem_Calloc(runs > 0 ? runs : 1, sizeof(double));
+    if(views == NULL || h_inits == NULL || results == NULL || objectives == NULL)
+    {
+        PyErr_NoMemory();
+    }
+    else if((n = convert_pyobject2norm(w_mat_obj, &w_mat, &w_sparse)) >= 0)
+    {
+        /* Convert every H, arrays are borrowed without copying */
+        for (run=0;run<runs;run++)
+        {
+            if((h_inits[run] = convert_pyobject2carray(PySequence_Fast_GET_ITEM(h_seq, run), &views[run])) == NULL) break;
+            if(h_inits[run]->rows != n || h_inits[run]->cols < 1)
+            {
+                PyErr_SetString(PyExc_ValueError, "every H must be N*k");
+                release_carray(h_inits[run], &views[run]);
+                h_inits[run] = NULL;
+                break;
+            }
+        }
+        if(run == runs)
+        {
+            /* Run the batch, other threads run meanwhile */
+            Py_BEGIN_ALLOW_THREADS
+            failed = (w_sparse != NULL) ? calc_symnmf_sparse_batch(w_sparse, h_inits, runs, &params, results, objectives)
+                                        : calc_symnmf_batch(w_mat, h_inits, runs, &params, results, objectives);
+            Py_END_ALLOW_THREADS
+            if(failed) PyErr_NoMemory();
+        }
+        symmatrix_destroy(w_mat);
+        csrmatrix_destroy(w_sparse);
+
+        /* Pair every H with its objective, an array H owns its C result from now on */
+        if(!PyErr_Occurred() && (result = PyList_New(runs)) != NULL)
+        {
+            for (run=0;run<runs;run++)
+            {
+                PyObject* h_obj;
+                if(views[run].obj != NULL)
+                {
+                    h_obj = convert_carray2pyarray(self, results[run]);
+                }
+                else
+                {
+                    h_obj = convert_carray2pylist(results[run]);
+                    matrix_destroy(results[run]);
+                }
+                results[run] = NULL;
+                PyObject* pair = (h_obj != NULL) ? Py_BuildValue("(Nd)", h_obj, objectives[run]) : NULL;
+                if(pair == NULL)
+                {
+                    Py_CLEAR(result);
+                    break;
+                }
+                PyList_SET_ITEM(result, run, pair);
+            }
+        }
+
+        for (run=0;run<runs;run++)
+        {
+            if(h_inits[run] != NULL) release_carray(h_inits[run], &views[run]);
+            matrix_destroy(results[run]);
+        }
+    }
+
+    PyMem_Free(views);
+    PyMem_Free(h_inits);
+    PyMem_Free(results);
+    PyMem_Free(objectives);
+    Py_DECREF(h_seq);
+    return result;
+}
+
+/**
+ * Convert C cluster labels to a Python list of ints.
+ *
+ * @param labels An int pointer representing the n labels.
+ * @param n An integer representing the number of labels.
+ * @return A PyObject representing the list, or NULL if an error occurs.
+ */
+PyObject* convert_labels2pylist(const int* labels, int n)
+{
+    PyObject* final_labels = PyList_New(n);
+    for (int i=0;final_labels != NULL && i<n;i++)
+    {
+        PyList_SetItem(final_labels, i, PyLong_FromLong(labels[i]));
+    }
+    return final_labels;
+}
+
+/**
+ * Convert Python cluster labels to C.
+ *
+ * The labels are a sequence of n ints in [0, n) with at least 2 and at most n-1 of them in use, as sklearn's
+ * silhouette_score requires of its labels.
+ *
+ * @param obj A PyObject representing the sequence of labels, a list or a NumPy array.
+ * @param n An integer representing the number of vectors.
+ * @param clusters An integer pointer set to one more than the largest label.
+ * @return An int pointer representing the labels, freed with PyMem_Free, or NULL if an error occurs.
+ */
+int* convert_pyobject2labels(PyObject* obj, int n, int* clusters)
+{
+    int used = 0;
+    PyObject* seq = PySequence_Fast(obj, "the labels must be a sequence of ints");
+    if(seq == NULL) return NULL;
+    if(PySequence_Fast_GET_SIZE(seq) != n)
+    {
+        Py_DECREF(seq);
+        PyErr_SetString(PyExc_ValueError, "expected one label per vector");
+        return NULL;
+    }
+    int* labels = PyMem_Malloc((size_t)n * sizeof(int));
+    char* seen = PyMem_Calloc((size_t)n, 1);
+    if(labels == NULL || seen == NULL) /* Memory allocation failed */
+    {
+        PyMem_Free(labels);
+        PyMem_Free(seen);
+        Py_DECREF(seq);
+        PyErr_NoMemory();
+        return NULL;
+    }
+    *clusters = 0;
+    for (int i=0;i<n;i++)
+    {
+        long label = PyLong_AsLong(PySequence_Fast_GET_ITEM(seq, i));
+        if(label < 0 || label >= n)
+        {
+            if(!PyErr_Occurred()) PyErr_SetString(PyExc_ValueError, "the labels must be ints in [0, number of vectors)");
+            PyMem_Free(labels);
+            PyMem_Free(seen);
+            Py_DECREF(seq);
+            return NULL;
+        }
+        labels[i] = (int)label;
+        used += !seen[label];
+        seen[label] = 1;
+        if(label >= *clusters) *clusters = (int)label + 1;
+    }
+    PyMem_Free(seen);
+    Py_DECREF(seq);
+    if(used < 2 || used > n - 1)
+    {
+        PyMem_Free(labels);
+        PyErr_Format(PyExc_ValueError, "%d labels are in use, expected 2 to the number of vectors - 1", used);
+        return NULL;
+    }
+    return labels;
+}
+
+/**
+ * Cluster the given vectors by k-means in C, with the semantics of kmeans.py.
+ *
+ * The assignment runs on every thread and the labels returned are those of the final centroids,
+ * so no second pass over the vectors is needed to find them.
+ *
+ * @param self A PyObject representing the module.
+ * @param args A PyObject holding the list or float64 array of vectors and k.
+ * @param kwargs A PyObject holding the optional max_iter (default 300), eps (default 1e-4), init, "first"
+ *               for the first k vectors as kmeans.py or "kmeans++", and the seed of kmeans++ (default 1234).
+ * @return A PyObject representing the tuple (centroids, labels), the centroids as a NumPy array if the
+ *         vectors were an array or a list of lists otherwise and the labels as a list, or NULL if an error occurs.
+ */
+static PyObject* kmeansmodule(PyObject* self, PyObject* args, PyObject* kwargs)
+{
+    static char* kwlist[] = {"vectors", "k", "max_iter", "eps", "init", "seed", NULL};
+    PyObject* vec_arr_obj;
+    int k;
+    unsigned long long seed = 1234;
+    const char* init = NULL;
+    kmeans_params_t params;
+
+    kmeans_params_default(&params);
+    if(!PyArg_ParseTupleAndKeywords(args, kwargs, "Oi|$idzK", kwlist, &vec_arr_obj, &k, &params.max_iter, &params.eps,
+                                    &init, &seed)) return NULL;
+    if(params.max_iter < 0 || !(params.eps >= 0) || seed > 0xffffffffULL)
+    {
+        PyErr_SetString(PyExc_ValueError, "max_iter and eps must be >= 0 and seed below 2**32");
+        return NULL;
+    }
+    if(init != NULL && (params.init = kmeans_init_id(init)) < 0)
+    {
+        PyErr_Format(PyExc_ValueError, "unknown init '%s', expected first or kmeans++", init);
+        return NULL;
+    }
+    params.seed = (unsigned long)seed;
+
+    Py_buffer view;
+    matrix_t* vectors_matrix = convert_pyobject2carray(vec_arr_obj, &view);
+    if(vectors_matrix == NULL) return NULL; /* Failure occured */
+    int as_array = (view.obj != NULL);
+    if(k < 1 || k > vectors_matrix->rows)
+    {
+        release_carray(vectors_matrix, &view);
+        PyErr_SetString(PyExc_ValueError, "k must be at least 1 and at most the number of vectors");
+        return NULL;
+    }
+    int n = vectors_matrix->rows;
+    int* labels = PyMem_Malloc((size_t)n * sizeof(int));
+    if(labels == NULL) /* Memory allocation failed */
+    {
+        release_carray(vectors_matrix, &view);
+        return PyErr_NoMemory();
+    }
+
+    matrix_t* centroids;
+    Py_BEGIN_ALLOW_THREADS
+    centroids = calc_kmeans(vectors_matrix, k, &params, labels, NULL);
+    Py_END_ALLOW_THREADS
+    release_carray(vectors_matrix, &view);
+    if(centroids == NULL) /* Memory allocation failed */
+    {
+        PyMem_Free(labels);
+        return PyErr_NoMemory();
+    }
+
+    PyObject* final_labels = convert_labels2pylist(labels, n);
+    PyMem_Free(labels);
+    PyObject* final_centroids;
+    if(as_array)
+    {
+        final_centroids = convert_carray2pyarray(self, centroids); /* The array owns the centroids from now on */
+    }
+    else
+    {
+        final_centroids = convert_carray2pylist(centroids);
+        matrix_destroy(centroids);
+    }
+    if(final_centroids == NULL || final_labels == NULL)
+    {
+        Py_XDECREF(final_centroids);
+        Py_XDECREF(final_labels);
+        return NULL;
+    }
+    return Py_BuildValue("(NN)", final_centroids, final_labels);
+}
+
+/**
+ * Calculate the mean silhouette of a clustering of the given vectors in C, as sklearn's silhouette_score.
+ *
+ * The distances are calculated a block at a time on every thread and never stored. With sample the score is
+ * estimated from that many vectors chosen by seed, each still scored against all the vectors.
+ *
+ * @param self A PyObject representing the module (not used).
+ * @param args A PyObject holding the list or float64 array of vectors and the sequence of their labels.
+ * @param kwargs A PyObject holding the optional sample (default 0, the exact score) and seed (default 1234).
+ * @return A PyObject representing the score as a float, or NULL if an error occurs.
+ */
+static PyObject* silhouettemodule(PyObject* self, PyObject* args, PyObject* kwargs)
+{
+    static char* kwlist[] = {"vectors", "labels", "sample", "seed", NULL};
+    PyObject *vec_arr_obj, *labels_obj;
+    int sample = 0, clusters, failed;
+    unsigned long long seed = 1234;
+    double score;
+    (void)self;
+    if(!PyArg_ParseTupleAndKeywords(args, kwargs, "OO|$iK", kwlist, &vec_arr_obj, &labels_obj, &sample, &seed)) return NULL;
+    if(sample < 0 || seed > 0xffffffffULL)
+    {
+        PyErr_SetString(PyExc_ValueError, "sample must be >= 0 and seed below 2**32");
+        return NULL;
+    }
+
+    Py_buffer view;
+    matrix_t* vectors_matrix = convert_pyobject2carray(vec_arr_obj, &view);
+    if(vectors_matrix == NULL) return NULL; /* Failure occured */
+    int* labels = convert_pyobject2labels(labels_obj, vectors_matrix->rows, &clusters);
+    if(labels == NULL)
+    {
+        release_carray(vectors_matrix, &view);
+        return NULL;
+    }
+
+    const int* sets[1] = {labels};
+    Py_BEGIN_ALLOW_THREADS
+    failed = calc_silhouette(vectors_matrix, sets, 1, clusters, sample, (unsigned long)seed, &score);
+    Py_END_ALLOW_THREADS
+    release_carray(vectors_matrix, &view);
+    PyMem_Free(labels);
+    if(failed) return PyErr_NoMemory(); /* Memory allocation failed */
+    return PyFloat_FromDouble(score);
+}
+
+/**
+ * Compare the clusterings of SymNMF and k-means of the given vectors by their silhouettes, all in one call to C.
+ *
+ * SymNMF runs as fit does with the dense W and k-means as kmeans does from the first k vectors; the transposed
+ * vectors and norms W is built from are reused for the distances, which score both labelings in one pass.
+ *
+ * @param self A PyObject representing the module (not used).
+ * @param args A PyObject holding the list or float64 array of vectors and k.
+ * @param kwargs A PyObject holding the optional seed (default 1234), sample of the silhouettes (default 0,
+ *               the exact scores) and solver, max_iter, eps and beta of symnmf.
+ * @return A PyObject representing the dict of the scores "symnmf" and "kmeans" and the label lists "symnmf_labels"
+ *         and "kmeans_labels", or NULL if an error occurs.
+ */
+static PyObject* analyzemodule(PyObject* self, PyObject* args, PyObject* kwargs)
+{
+    static char* kwlist[] = {"vectors", "k", "seed", "sample", "solver", "max_iter", "eps", "beta", NULL};
+    PyObject* vec_arr_obj;
+    int k, sample = 0, failed;
+    unsigned long long seed = 1234;
+    const char* solver = NULL;
+    double scores[2];
+    symnmf_params_t params;
+    (void)self;
+
+    symnmf_params_default(&params);
+    if(!PyArg_ParseTupleAndKeywords(args, kwargs, "Oi|$Kizidd", kwlist, &vec_arr_obj, &k, &seed, &sample, &solver,
+                                    &params.max_iter, &params.eps, &params.beta)) return NULL;
+    if(!check_params(&params, solver)) return NULL;
+    if(sample < 0 || seed > 0xffffffffULL)
+    {
+        PyErr_SetString(PyExc_ValueError, "sample must be >= 0 and seed below 2**32");
+        return NULL;
+    }
+
+    Py_buffer view;
+    matrix_t* vectors_matrix = convert_pyobject2carray(vec_arr_obj, &view);
+    if(vectors_matrix == NULL) return NULL; /* Failure occured */
+    int n = vectors_matrix->rows;
+    if(k < 2 || k >= n)
+    {
+        release_carray(vectors_matrix, &view);
+        PyErr_SetString(PyExc_ValueError, "k must be at least 2 and less than the number of vectors");
+        return NULL;
+    }
+    int* symnmf_labels = PyMem_Malloc((size_t)n * sizeof(int));
+    int* kmeans_labels = PyMem_Malloc((size_t)n * sizeof(int));
+    if(symnmf_labels == NULL || kmeans_labels == NULL) /* Memory allocation failed */
+    {
+        PyMem_Free(symnmf_labels);
+        PyMem_Free(kmeans_labels);
+        release_carray(vectors_matrix, &view);
+        return PyErr_NoMemory();
+    }
+
+    Py_BEGIN_ALLOW_THREADS
+    failed = calc_analysis(vectors_matrix, k, (unsigned long)seed, &params, sample, symnmf_labels, kmeans_labels, scores);
+    Py_END_ALLOW_THREADS
+    release_carray(vectors_matrix, &view);
+
+    PyObject* result = NULL;
+    if(failed) /* Memory allocation failed */
+    {
+        PyErr_NoMemory();
+    }
+    else
+    {
+        PyObject* final_symnmf = convert_labels2pylist(symnmf_labels, n);
+        PyObject* final_kmeans = convert_labels2pylist(kmeans_labels, n);
+        if(final_symnmf != NULL && final_kmeans != NULL)
+        {
+            result = Py_BuildValue("{s:d,s:d,s:N,s:N}", "symnmf", scores[0], "kmeans", scores[1],
+                                   "symnmf_labels", final_symnmf, "kmeans_labels", final_kmeans);
+        }
+        else
+        {
+            Py_XDECREF(final_symnmf);
+            Py_XDECREF(final_kmeans);
+        }
+    }
+    PyMem_Free(symnmf_labels);
+    PyMem_Free(kmeans_labels);
+    return result;
+}
+
+/**
+ * Save a matrix to a matrix file.
+ *
+ * @param self A PyObject representing the module or class (not used).
+ * @param args A PyObject holding the file name and the matrix, a list of lists or a float64 array.
+ * @param kwargs A PyObject holding checksum, a flag to store a checksum of the payload (default True).
+ * @return None, or NULL if an error occurs.
+ */
+static PyObject* savemodule(PyObject* self, PyObject* args, PyObject* kwargs)
+{
+    static char* kwlist[] = {"path", "matrix", "checksum", NULL};
+    const char* path;
+    PyObject* mat_obj;
+    int checksum = 1;
+    int failed;
+    Py_buffer view;
+    matrix_t* mat;
+
+    if(!PyArg_ParseTupleAndKeywords(args, kwargs, "sO|p", kwlist, &path, &mat_obj, &checksum)) return NULL;
+    if((mat = convert_pyobject2carray(mat_obj, &view)) == NULL) return NULL;
+
+    Py_BEGIN_ALLOW_THREADS
+    failed = matrix_save(path, mat, checksum);
+    Py_END_ALLOW_THREADS
+    release_carray(mat, &view);
+    if(failed)
+    {
+        return PyErr_Format(PyExc_OSError, "could not save %s", path);
+    }
+    Py_RETURN_NONE;
+}
+
+/**
+ * Load a matrix file.
+ *
+ * A dense matrix is returned as a read only NumPy array viewing the mapped file, which stays
+ * mapped as long as the array lives; np.array(load(path)) makes a writable copy. A packed symmetric matrix is expanded into a new full array.
+ *
+ * @param self A PyObject representing the module.
+ * @param args A PyObject holding the file name.
+ * @param kwargs A PyObject holding verify, a flag to check the checksum of the payload (default True).
+ * @return A PyObject representing the NumPy array, or NULL if an error occurs.
+ */
+static PyObject* loadmodule(PyObject* self, PyObject* args, PyObject* kwargs)
+{
+    static char* kwlist[] = {"path", "verify", NULL};
+    const char* path;
+    int verify = 1;
+    binfile_t* file;
+    matrix_t* dense;
+    symmatrix_t* packed;
+    PyObject* result;
+
+    if(!PyArg_ParseTupleAndKeywords(args, kwargs, "s|p", kwlist, &path, &verify)) return NULL;
+
+    Py_BEGIN_ALLOW_THREADS
+    file = binfile_open(path, verify);
+    Py_END_ALLOW_THREADS
+    if(file == NULL)
+    {
+        return PyErr_Format(PyExc_ValueError, "could not load %s", path);
+    }
+
+    if(file->layout == BINFILE_DENSE)
+    {
+        if((dense = binfile_matrix(file)) == NULL)
+        {
+            binfile_close(file);
+            return PyErr_NoMemory();
+        }
+        return wrap_carray(self, dense, file); /* The array owns the mapping from now on */
+    }
+    if((packed = binfile_symmatrix(file)) == NULL)
+    {
+        binfile_close(file);
+        return PyErr_NoMemory();
+    }
+    result = convert_symmatrix2pyarray(self, packed);
+    symmatrix_destroy(packed);
+    binfile_close(file);
+    return result;
+}
+
+/**
+ * Set the number of threads used by the calls made from the calling Python thread.
+ *
+ * @param self A PyObject representing the module or class (not used).
+ * @param args A PyObject holding one integer, 0 or less for one thread per available core.
+ * @return None, or NULL if an error occurs.
+ */
+static PyObject* setthreadsmodule(PyObject* self, PyObject* args)
+{
+    int threads;
+    if(!PyArg_ParseTuple(args, "i", &threads)) return NULL;
+
+    symnmf_set_threads(threads);
+    Py_RETURN_NONE;
+}
+
+/**
+ * Get the number of threads used by the calls made from the calling Python thread.
+ *
+ * @param self A PyObject representing the module or class (not used).
+ * @param args A PyObject representing the arguments passed to the function (none).
+ * @return A PyObject holding the number of threads.
+ */
+static PyObject* getthreadsmodule(PyObject* self, PyObject* args)
+{
+    return PyLong_FromLong(symnmf_get_threads());
+}
+
+static PyMethodDef symnmfMethods[] = {
+    {"sym",                   /* the Python method name that will be used */
+      (PyCFunction) symmodule, /* the C-function that implements the Python function and returns static PyObject*  */
+      METH_VARARGS,           /* flags indicating parameters accepted for this function */
       PyDoc_STR("Calculates similarity matrix from given vectors")}, /*  The docstring for the function */
 
     {"ddg",
@@ -284,34 +1860,154 @@ static PyMethodDef symnmfMethods[] = {
       PyDoc_STR("Calculates diagonal degree matrix from given vectors")},
     
     {"norm",
-      (PyCFunction) normmodule,
-      METH_VARARGS,
-      PyDoc_STR("Calculates normalized similarity matrix from given vectors")},
+      (PyCFunction)(void(*)(void)) normmodule,
+      METH_VARARGS | METH_KEYWORDS,
+      PyDoc_STR("Calculates normalized similarity matrix from given vectors, reusing the one cached in cache_dir (default $SYMNMF_CACHE_DIR)")},
+
+    {"sparse_sym",
+      (PyCFunction)(void(*)(void)) sparsesymmodule,
+      METH_VARARGS | METH_KEYWORDS,
+      PyDoc_STR("Calculates the sparse similarity matrix (indptr, indices, data) of the knn nearest neighbours or of the affinities >= epsilon")},
+
+    {"sparse_ddg",
+      (PyCFunction)(void(*)(void)) sparseddgmodule,
+      METH_VARARGS | METH_KEYWORDS,
+      PyDoc_STR("Calculates the diagonal of the degree matrix of the sparse similarity matrix")},
+
+    {"sparse_norm",
+      (PyCFunction)(void(*)(void)) sparsenormmodule,
+      METH_VARARGS | METH_KEYWORDS,
+      PyDoc_STR("Calculates the sparse normalized similarity matrix (indptr, indices, data)")},
+
+    {"nystrom_norm",
+      (PyCFunction)(void(*)(void)) nystromnormmodule,
+      METH_VARARGS | METH_KEYWORDS,
+      PyDoc_STR("Calculates the Nystrom approximation F*F^T - diag(shift) of the normalized similarity matrix "
+                "from a number of landmarks chosen by seed, and returns (F, shift)")},
 
     {"symnmf",
-      (PyCFunction) symnmfmodule,
+      (PyCFunction)(void(*)(void)) symnmfmodule,
+      METH_VARARGS | METH_KEYWORDS,
+      PyDoc_STR("Calculates and updates the association matrix (H) matrix from given vectors until convergence or max iterations; "
+                "takes max_iter, eps, beta and solver (mu, accelerated or hals), dtype (float64 or float32 storage of W), "
+                "and returns (H, report) with report=True")},
+
+    {"fit",
+      (PyCFunction)(void(*)(void)) fitmodule,
+      METH_VARARGS | METH_KEYWORDS,
+      PyDoc_STR("Calculates W and runs symnmf from a seeded random H, all in C; takes seed, knn or epsilon, cache_dir, "
+                "the parameters of symnmf, report, return_W, dtype, w_file, a matrix file W is built into and streamed from, "
+                "and landmarks, the number of landmarks of a Nystrom approximation of W")},
+
+    {"symnmf_batch",
+      (PyCFunction)(void(*)(void)) symnmfbatchmodule,
+      METH_VARARGS | METH_KEYWORDS,
+      PyDoc_STR("Runs symnmf concurrently from every initial H of a sequence on one shared W, returns a list of (H, ||W - H*H^T||^2)")},
+
+    {"kmeans",
+      (PyCFunction)(void(*)(void)) kmeansmodule,
+      METH_VARARGS | METH_KEYWORDS,
+      PyDoc_STR("Clusters vectors by k-means as kmeans.py does, from the first k vectors or with init='kmeans++' from a seed; "
+                "takes max_iter and eps and returns (centroids, labels), the labels of the final centroids")},
+
+    {"silhouette",
+      (PyCFunction)(void(*)(void)) silhouettemodule,
+      METH_VARARGS | METH_KEYWORDS,
+      PyDoc_STR("Calculates the mean silhouette of labels of vectors as sklearn's silhouette_score, "
+                "or its estimate from sample vectors chosen by seed")},
+
+    {"analyze",
+      (PyCFunction)(void(*)(void)) analyzemodule,
+      METH_VARARGS | METH_KEYWORDS,
+      PyDoc_STR("Clusters vectors by symnmf and by k-means and scores both by their silhouettes in one call; takes seed, "
+                "sample and the parameters of symnmf and returns a dict of the scores and labels of symnmf and kmeans")},
+
+    {"save",
+      (PyCFunction)(void(*)(void)) savemodule,
+      METH_VARARGS | METH_KEYWORDS,
+      PyDoc_STR("Saves a matrix (vectors, W or H) to a binary matrix file, with a checksum unless checksum=False")},
+
+    {"load",
+      (PyCFunction)(void(*)(void)) loadmodule,
+      METH_VARARGS | METH_KEYWORDS,
+      PyDoc_STR("Loads a binary matrix file as a NumPy array mapped from the file, verify=False skips the checksum")},
+
+    {"set_threads",
+      (PyCFunction) setthreadsmodule,
       METH_VARARGS,
-      PyDoc_STR("Calculates and updates the association matrix (H) matrix from given vectors until convergence or max iterations")},
+      PyDoc_STR("Sets the number of threads used by calls from this thread, 0 for one per core")},
+
+    {"get_threads",
+      (PyCFunction) getthreadsmodule,
+      METH_NOARGS,
+      PyDoc_STR("Returns the number of threads used by calls from this thread")},
 
     {NULL, NULL, 0, NULL}     /* The last entry must be all NULL as shown to act as a
                                  sentinel. Python looks for this entry to know that all
                                  of the functions for the module have been defined. */
 };
 
+/**
+ * Create the per-module state: the Matrix type and the instruction set of the kernels.
+ *
+ * The kernels are selected here, while the import lock is held, so the calls that
+ * later run concurrently without the GIL only ever read the selection.
+ *
+ * @param module A PyObject representing the module being initialized.
+ * @return 0 on success, -1 if an error occurs.
+ */
+static int symnmf_exec(PyObject* module)
+{
+    module_state* state = get_module_state(module);
+    state->matrix_type = PyType_FromModuleAndSpec(module, &matrix_spec, NULL);
+    if (state->matrix_type == NULL) {
+        return -1;
+    }
+    if (PyModule_AddObjectRef(module, "Matrix", state->matrix_type) < 0) {
+        return -1;
+    }
+    simd_select(-1);
+    return 0;
+}
+
+static int symnmf_traverse(PyObject* module, visitproc visit, void* arg)
+{
+    Py_VISIT(get_module_state(module)->matrix_type);
+    return 0;
+}
+
+static int symnmf_clear(PyObject* module)
+{
+    Py_CLEAR(get_module_state(module)->matrix_type);
+    return 0;
+}
+
+static void symnmf_free(void* module)
+{
+    symnmf_clear((PyObject*)module);
+}
+
+static PyModuleDef_Slot symnmfSlots[] = {
+    {Py_mod_exec, (void*)symnmf_exec},
+#if PY_VERSION_HEX >= 0x030C0000
+    {Py_mod_multiple_interpreters, Py_MOD_PER_INTERPRETER_GIL_SUPPORTED},
+#endif
+    {0, NULL}
+};
+
 static struct PyModuleDef moduledef = {
     PyModuleDef_HEAD_INIT,
     "mysymnmfsp", /* name of module */
     NULL, /* module documentation, may be NULL */
-    -1,  /* size of per-interpreter state of the module, or -1 if the module keeps state in global variables. */
-    symnmfMethods /* the PyMethodDef array from before containing the methods of the extension */
+    sizeof(module_state),  /* size of per-interpreter state of the module */
+    symnmfMethods, /* the PyMethodDef array from before containing the methods of the extension */
+    symnmfSlots, /* multi-phase initialization, see symnmf_exec */
+    symnmf_traverse,
+    symnmf_clear,
+    symnmf_free
 };
 
 PyMODINIT_FUNC PyInit_mysymnmfsp(void)
 {
-    PyObject *m;
-    m = PyModule_Create(&moduledef);
-    if (!m) {
-        return NULL;
-    }
-    return m;
+    return PyModuleDef_Init(&moduledef);
 }